@@ -10,6 +10,10 @@
 #include "engine/os.h"
 #include "engine/sync.h"
 #include "engine/stream.h"
+#include "gpu_ext.h"
+#include "memory_tracker.h"
+#include "readback.h"
+#include "render_target_pool.h"
 #include "shader_compiler.h"
 #include <Windows.h>
 #include <d3d11_1.h>
@@ -20,6 +24,7 @@
 #include "renderer/gpu/dds.h"
 #include "renderer/gpu/renderdoc_app.h"
 #include "stb/stb_image_resize.h"
+#include "texture_layout.h"
 
 #pragma comment(lib, "glslang.lib")
 #pragma comment(lib, "OSDependent.lib")
@@ -35,6 +40,8 @@ namespace Lumix {
 
 namespace gpu {
 
+static constexpr u32 TRANSIENT_UNIFORMS_SIZE = 4 * 1024 * 1024;
+static constexpr u32 TRANSIENT_TEXTURE_MAX_IDLE_FRAMES = 16;
 
 template <int N>
 static void toWChar(WCHAR (&out)[N], const char* in)
@@ -165,7 +172,11 @@ struct Buffer {
 	ID3D11ShaderResourceView* srv = nullptr;
 	ID3D11UnorderedAccessView* uav = nullptr;
 	u8* mapped_ptr = nullptr;
+	u32 size = 0;
 	bool is_constant_buffer = false;
+	// only MAPPABLE buffers are dynamic, others are updated by UpdateSubresource1, which is ordered with draws
+	bool is_dynamic = false;
+	bool is_srv = false;
 	u32 bound_to_output = 0; 
 };
 
@@ -201,6 +212,19 @@ struct Texture {
 	#endif
 };
 
+// CPU side of a texture load, see prepareTexture
+struct PreparedTexture {
+	PreparedTexture(IAllocator& allocator)
+		: layout(allocator)
+		, converted(allocator)
+	{}
+
+	// subresources point to the data passed to prepareTexture, unless pixels have to be converted
+	TextureLayout layout;
+	u32 flags = 0;
+	Array<u8> converted;
+};
+
 struct Query {
 	~Query() {
 		if (query) query->Release();
@@ -251,10 +275,10 @@ struct ShaderCompilerDX11 : ShaderCompiler {
 				}
 				std::string hlsl;
 				u32 dummy;
-				if (!glsl2hlsl(tmp, c, type, name, Ref(hlsl), Ref(dummy), Ref(dummy))) {
+				if (!glsl2hlsl(tmp, c, type, name, Ref(hlsl), Ref(dummy), Ref(dummy), Ref(dummy), Ref(dummy))) {
 					return false;
 				}
-				ID3DBlob* blob = ShaderCompiler::compile(hash, hlsl.c_str(), type, name, 0, 0);
+				ID3DBlob* blob = ShaderCompiler::compile(hash, hlsl.c_str(), type, name, 0, 0, 0, 0);
 				if (!blob) return false;
 				if (!create(device, type, blob->GetBufferPointer(), blob->GetBufferSize(), program)) return false;
 				if (type == ShaderType::VERTEX) {
@@ -310,8 +334,27 @@ struct ShaderCompilerDX11 : ShaderCompiler {
 	}
 };
 
+struct TransientTexture {
+	TextureHandle texture;
+	u32 w;
+	u32 h;
+	TextureFormat format;
+	u32 flags;
+	u32 idle_frames = 0;
+	bool used = false; // in the current frame
+};
+
+// D3D11 has no readback heap, each readback has its own staging resource and an event query
+struct Readback {
+	u32 id;
+	ID3D11Resource* staging;
+	ID3D11Query* query;
+	u32 row_size;
+	u32 row_count;
+};
+
 struct D3D {
-	bool initialized = false;
+	bool initialized = false;
 
 	struct FrameBuffer {
 		ID3D11DepthStencilView* depth_stencil = nullptr;
@@ -336,7 +379,14 @@ struct D3D {
 		: allocator(allocator)
 		, state_cache(allocator)
 		, shader_compiler(allocator)
-	{}
+		, pending_uploads(allocator)
+		, upload_contexts(allocator)
+		, update_scratch(allocator)
+		, memory_tracker(allocator)
+		, transient_textures(allocator)
+		, render_target_pool(allocator)
+		, readbacks(allocator)
+	{}
 
 	IAllocator& allocator;
 	DWORD thread;
@@ -349,14 +399,30 @@ struct D3D {
 	ID3D11Debug* debug = nullptr;
 	ID3DUserDefinedAnnotation* annotation = nullptr;
 	ID3D11Query* disjoint_query = nullptr;
+	ID3D11Buffer* draw_constants = nullptr;
+	// map discards the whole buffer, so it's always written from this copy
+	u8 draw_constants_data[MAX_DRAW_CONSTANTS_SIZE] = {};
+	Buffer transient_uniforms;
+	u8* transient_uniforms_ptr = nullptr;
+	u32 transient_uniforms_offset = 0;
+	u64 transient_uniforms_usage = 0;
+	ScratchStats scratch_stats = {};
+	// uploads recorded on loader threads, executed on the render thread
+	Mutex upload_mutex;
+	Array<ID3D11CommandList*> pending_uploads;
+	Array<ID3D11DeviceContext*> upload_contexts;
+	volatile LONG has_pending_uploads = 0;
 	bool disjoint_waiting = false;
 	u64 query_frequency = 1;
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	// constant buffer updates smaller than the buffer are padded here, see update()
+	Array<u8> update_scratch;
 
 	BufferHandle current_index_buffer = INVALID_BUFFER;
 	BufferHandle current_indirect_buffer = INVALID_BUFFER;
 	Window windows[64];
 	Window* current_window = windows;
-	ID3D11SamplerState* samplers[2*2*2*2];
+	ID3D11SamplerState* samplers[2*2*2*2] = {};
 
 	FrameBuffer current_framebuffer;
 
@@ -365,6 +431,20 @@ struct D3D {
 	HMODULE dxgi_dll;
 	ProgramHandle current_program = nullptr;
 	ShaderCompilerDX11 shader_compiler;	
+	// D3D11 does not report allocation sizes, tracked sizes are estimates
+	ResourceMemoryTracker memory_tracker;
+	IDXGIAdapter3* adapter = nullptr;
+	ResourceMemoryStats memory_stats = {};
+	MemoryBudgetCallback budget_callback = nullptr;
+	void* budget_callback_user_ptr = nullptr;
+	bool over_budget = false;
+	// there are no placed resources in D3D11, so transient textures are only reused across frames, they do not alias
+	Array<TransientTexture> transient_textures;
+	TransientStats transient_stats = {};
+	RenderTargetPool render_target_pool;
+	DynamicResolution dynamic_resolution;
+	Array<Readback> readbacks;
+	u32 next_readback_id = 1;
 	#ifdef LUMIX_DEBUG
 		StaticString<64> debug_group;
 	#endif
@@ -372,91 +452,6 @@ struct D3D {
 
 Local<D3D> d3d;
 
-namespace DDS
-{
-
-static u32 sizeDXTC(u32 w, u32 h, DXGI_FORMAT format) {
-	const bool is_dxt1 = format == DXGI_FORMAT_BC1_UNORM || format == DXGI_FORMAT_BC1_UNORM_SRGB;
-	const bool is_ati = format == DXGI_FORMAT_BC4_UNORM;
-	return ((w + 3) / 4) * ((h + 3) / 4) * (is_dxt1 || is_ati ? 8 : 16);
-}
-
-struct LoadInfo {
-	bool compressed;
-	bool swap;
-	bool palette;
-	u32 blockBytes;
-	u32 block_width;
-	u32 block_height;
-	DXGI_FORMAT format;
-	DXGI_FORMAT srgb_format;
-};
-
-static LoadInfo loadInfoDXT1 = {
-	true, false, false, 8, 4, 4, DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC1_UNORM_SRGB
-};
-static LoadInfo loadInfoDXT3 = {
-	true, false, false, 16, 4, 4, DXGI_FORMAT_BC2_UNORM, DXGI_FORMAT_BC2_UNORM_SRGB
-};
-static LoadInfo loadInfoDXT5 = {
-	true, false, false, 16, 4, 4, DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_BC3_UNORM_SRGB
-};
-static LoadInfo loadInfoATI1 = {
-	true, false, false, 8, 4, 4, DXGI_FORMAT_BC4_UNORM, DXGI_FORMAT_UNKNOWN
-};
-static LoadInfo loadInfoATI2 = {
-	true, false, false, 16, 4, 4, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_UNKNOWN
-};
-static LoadInfo loadInfoBGRA8 = {
-//	false, false, false, 4, GL_RGBA8, GL_SRGB8_ALPHA8, GL_BGRA, GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoRGBA8 = {
-//	false, false, false, 4, GL_RGBA8, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoBGR8 = {
-//	false, false, false, 3, GL_RGB8, GL_SRGB8, GL_BGR, GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoBGR5A1 = {
-//	false, true, false, 2, GL_RGB5_A1, GL_ZERO, GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV
-};
-static LoadInfo loadInfoBGR565 = {
-//	false, true, false, 2, GL_RGB5, GL_ZERO, GL_RGB, GL_UNSIGNED_SHORT_5_6_5
-};
-static LoadInfo loadInfoIndex8 = {
-//	false, false, true, 1, GL_RGB8, GL_SRGB8, GL_BGRA, GL_UNSIGNED_BYTE
-};
-
-static LoadInfo* getDXT10LoadInfo(const Header& hdr, const DXT10Header& dxt10_hdr)
-{
-	switch(dxt10_hdr.dxgi_format) {
-		case DxgiFormat::B8G8R8A8_UNORM_SRGB:
-		case DxgiFormat::B8G8R8A8_UNORM:
-			return &loadInfoBGRA8;
-			break;
-		case DxgiFormat::R8G8B8A8_UNORM:
-			return &loadInfoRGBA8;
-			break;
-		case DxgiFormat::BC1_UNORM_SRGB:
-		case DxgiFormat::BC1_UNORM:
-			return &loadInfoDXT1;
-			break;
-		case DxgiFormat::BC2_UNORM_SRGB:
-		case DxgiFormat::BC2_UNORM:
-			return &loadInfoDXT3;
-			break;
-		case DxgiFormat::BC3_UNORM_SRGB:
-		case DxgiFormat::BC3_UNORM:
-			return &loadInfoDXT5;
-			break;
-		default:
-			ASSERT(false);
-			return nullptr;
-			break;
-	}
-}
-
-} // namespace DDS
-
 static void try_load_renderdoc() {
 	HMODULE lib = LoadLibrary("renderdoc.dll");
 	if (!lib) lib = LoadLibrary("C:\\Program Files\\RenderDoc\\renderdoc.dll");
@@ -501,8 +496,6 @@ static DXGI_FORMAT toDSViewFormat(DXGI_FORMAT format) {
 }
 
 QueryHandle createQuery() {
-	checkThread();
-
 	Query* q = LUMIX_NEW(d3d->allocator, Query);
 	*q = {};
 	D3D11_QUERY_DESC desc = {};
@@ -536,18 +529,117 @@ void destroy(ProgramHandle program) {
 	LUMIX_DELETE(d3d->allocator, program)
 }
 
-void destroy(TextureHandle texture) {
-	checkThread();
+void destroy(TextureHandle texture) {
+	d3d->memory_tracker.remove(texture);
 	LUMIX_DELETE(d3d->allocator, texture);
 }
 
 void destroy(QueryHandle query) {
-	checkThread();
 	LUMIX_DELETE(d3d->allocator, query);
 }
 
+TransientSlice allocTransientUniform(u32 size) {
+	ASSERT(size <= TRANSIENT_UNIFORMS_SIZE);
+	const u32 aligned_size = (size + 255) & ~255;
+	D3D11_MAP map_type = D3D11_MAP_WRITE_NO_OVERWRITE;
+	if (d3d->transient_uniforms_offset + aligned_size > TRANSIENT_UNIFORMS_SIZE) {
+		if (d3d->transient_uniforms_ptr) d3d->device_ctx->Unmap(d3d->transient_uniforms.buffer, 0);
+		d3d->transient_uniforms_ptr = nullptr;
+		d3d->transient_uniforms_offset = 0;
+		map_type = D3D11_MAP_WRITE_DISCARD;
+	}
+	if (!d3d->transient_uniforms_ptr) {
+		if (d3d->transient_uniforms_offset == 0) map_type = D3D11_MAP_WRITE_DISCARD;
+		D3D11_MAPPED_SUBRESOURCE msr;
+		d3d->device_ctx->Map(d3d->transient_uniforms.buffer, 0, map_type, 0, &msr);
+		d3d->transient_uniforms_ptr = (u8*)msr.pData;
+	}
+
+	TransientSlice slice;
+	slice.buffer = &d3d->transient_uniforms;
+	slice.offset = d3d->transient_uniforms_offset;
+	slice.size = size;
+	slice.ptr = d3d->transient_uniforms_ptr + slice.offset;
+	d3d->transient_uniforms_offset += aligned_size;
+	d3d->transient_uniforms_usage += size;
+	return slice;
+}
+
+// DX11 uploads initial data in create* calls
+bool isUploadComplete(BufferHandle buffer) {
+	return true;
+}
+
+bool isUploadComplete(TextureHandle texture) {
+	return true;
+}
+
+// driver manages memory in DX11, there are no heaps we could report
+HeapStats getHeapStats() {
+	return {};
+}
+
+// DX11 has a single transient ring, which wraps around instead of growing
+ScratchStats getScratchStats() {
+	ScratchStats stats = d3d->scratch_stats;
+	stats.reserved = TRANSIENT_UNIFORMS_SIZE;
+	stats.page_count = 1;
+	return stats;
+}
+
+// incremented when shutdown releases upload contexts, so loader threads do not use a context of an old device
+static volatile LONG upload_generation = 1;
+
+static thread_local struct {
+	ID3D11DeviceContext* ctx = nullptr;
+	LONG generation = 0;
+} upload_ctx;
+
+// immediate context is not thread safe, loader threads record their uploads in deferred contexts
+static ID3D11DeviceContext* getUploadContext() {
+	if (d3d->thread == GetCurrentThreadId()) return d3d->device_ctx;
+	if (!upload_ctx.ctx || upload_ctx.generation != upload_generation) {
+		const HRESULT hr = d3d->device->CreateDeferredContext(0, &upload_ctx.ctx);
+		ASSERT(SUCCEEDED(hr));
+		upload_ctx.generation = upload_generation;
+		MutexGuard guard(d3d->upload_mutex);
+		d3d->upload_contexts.push(upload_ctx.ctx);
+	}
+	return upload_ctx.ctx;
+}
+
+static void submitUploadContext(ID3D11DeviceContext* ctx) {
+	if (ctx == d3d->device_ctx) return;
+	ID3D11CommandList* list;
+	const HRESULT hr = ctx->FinishCommandList(FALSE, &list);
+	ASSERT(SUCCEEDED(hr));
+	MutexGuard guard(d3d->upload_mutex);
+	d3d->pending_uploads.push(list);
+	InterlockedExchange(&d3d->has_pending_uploads, 1);
+}
+
+// must be called before textures created on loader threads are used by GPU, i.e. by every function which reads or writes a texture
+static void executePendingUploads() {
+	if (!d3d->has_pending_uploads) return;
+	MutexGuard guard(d3d->upload_mutex);
+	for (ID3D11CommandList* list : d3d->pending_uploads) {
+		d3d->device_ctx->ExecuteCommandList(list, TRUE);
+		list->Release();
+	}
+	d3d->pending_uploads.clear();
+	InterlockedExchange(&d3d->has_pending_uploads, 0);
+}
+
+// transient uniforms stay mapped while they are being written, the buffer can not be mapped when it's used by GPU
+static void unmapTransientUniforms() {
+	if (!d3d->transient_uniforms_ptr) return;
+	d3d->device_ctx->Unmap(d3d->transient_uniforms.buffer, 0);
+	d3d->transient_uniforms_ptr = nullptr;
+}
+
 void drawTriangleStripArraysInstanced(u32 indices_count, u32 instances_count) {
 	d3d->device_ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+	unmapTransientUniforms();
 	d3d->device_ctx->DrawInstanced(indices_count, instances_count, 0, 0);
 }
 
@@ -568,12 +660,14 @@ void createTextureView(TextureHandle view, TextureHandle texture) {
 
 void generateMipmaps(TextureHandle texture){
 	ASSERT(texture);
+	executePendingUploads();
 	d3d->device_ctx->GenerateMips(texture->srv);
 }
 
 void update(TextureHandle texture, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h, TextureFormat format, void* buf) {
 	ASSERT(texture);
 	ASSERT(texture->dxgi_format == getDXGIFormat(format));
+	executePendingUploads();
 
 	const bool no_mips = texture->flags & (u32)TextureFlags::NO_MIPS;
 	const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(texture->w, texture->h));
@@ -595,6 +689,7 @@ void update(TextureHandle texture, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h
 void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y) {
 	ASSERT(dst);
 	ASSERT(src);
+	executePendingUploads();
 
 	const bool no_mips = src->flags & (u32)TextureFlags::NO_MIPS;
 	const u32 src_mip_count = no_mips ? 1 : 1 + log2(maximum(src->w, src->h));
@@ -625,6 +720,7 @@ void copy(TextureHandle dst, TextureHandle src, u32 dst_x, u32 dst_y) {
 
 void readTexture(TextureHandle texture, u32 mip, Span<u8> buf) {
 	ASSERT(texture);
+	executePendingUploads();
 	D3D11_MAPPED_SUBRESOURCE data;
 	
 	const u32 faces = (texture->flags & (u32)TextureFlags::IS_CUBE) ? 6 : 1;
@@ -639,8 +735,141 @@ void readTexture(TextureHandle texture, u32 mip, Span<u8> buf) {
 		memcpy(ptr, data.pData, data.DepthPitch);
 		ptr += data.DepthPitch;
 		d3d->device_ctx->Unmap(texture->texture2D, subres);
-	}
-}
+	}
+}
+
+static ReadbackTicket pushReadback(ID3D11Resource* staging, u32 row_size, u32 row_count) {
+	Readback& r = d3d->readbacks.emplace();
+	r.id = d3d->next_readback_id;
+	d3d->next_readback_id = d3d->next_readback_id == 0xffFFffFF ? 1 : d3d->next_readback_id + 1;
+	r.staging = staging;
+	r.row_size = row_size;
+	r.row_count = row_count;
+	D3D11_QUERY_DESC desc = {};
+	desc.Query = D3D11_QUERY_EVENT;
+	HRESULT hr = d3d->device->CreateQuery(&desc, &r.query);
+	ASSERT(SUCCEEDED(hr));
+	d3d->device_ctx->End(r.query);
+	// there are no fences in D3D11, fence_value is not used
+	return {r.id, r.id};
+}
+
+ReadbackTicket readTextureAsync(TextureHandle texture, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h) {
+	checkThread();
+	ASSERT(texture);
+	ASSERT(texture->texture2D);
+	executePendingUploads();
+	D3D11_TEXTURE2D_DESC desc;
+	texture->texture2D->GetDesc(&desc);
+	ASSERT(mip < desc.MipLevels);
+	ASSERT(x + w <= maximum(desc.Width >> mip, 1u) && y + h <= maximum(desc.Height >> mip, 1u));
+	// depth textures can be copied only as a whole
+	ASSERT(!isDepthFormat(desc.Format) || (x == 0 && y == 0 && w == maximum(desc.Width >> mip, 1u) && h == maximum(desc.Height >> mip, 1u)));
+	const u32 src_subres = D3D11CalcSubresource(mip, face, desc.MipLevels);
+
+	desc.Width = w;
+	desc.Height = h;
+	desc.MipLevels = 1;
+	desc.ArraySize = 1;
+	desc.SampleDesc.Count = 1;
+	desc.SampleDesc.Quality = 0;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.BindFlags = 0;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	desc.MiscFlags = 0;
+	ID3D11Texture2D* staging;
+	HRESULT hr = d3d->device->CreateTexture2D(&desc, nullptr, &staging);
+	if (!SUCCEEDED(hr)) {
+		logError("Failed to create readback texture");
+		return {0, 0};
+	}
+
+	const D3D11_BOX box = {x, y, 0, x + w, y + h, 1};
+	d3d->device_ctx->CopySubresourceRegion(staging, 0, 0, 0, 0, texture->texture2D, src_subres, isDepthFormat(desc.Format) ? nullptr : &box);
+	// compressed formats are not supported
+	return pushReadback(staging, w * getSize(desc.Format), h);
+}
+
+ReadbackTicket readBufferAsync(BufferHandle buffer, u32 offset, u32 size) {
+	checkThread();
+	ASSERT(buffer);
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = size;
+	desc.Usage = D3D11_USAGE_STAGING;
+	desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	ID3D11Buffer* staging;
+	HRESULT hr = d3d->device->CreateBuffer(&desc, nullptr, &staging);
+	if (!SUCCEEDED(hr)) {
+		logError("Failed to create readback buffer");
+		return {0, 0};
+	}
+
+	const D3D11_BOX box = {offset, 0, 0, offset + size, 1, 1};
+	d3d->device_ctx->CopySubresourceRegion(staging, 0, 0, 0, 0, buffer->buffer, 0, &box);
+	return pushReadback(staging, size, 1);
+}
+
+static Readback* findReadback(ReadbackTicket ticket) {
+	for (Readback& r : d3d->readbacks) {
+		if (r.id == ticket.id) return &r;
+	}
+	return nullptr;
+}
+
+bool isReadbackReady(ReadbackTicket ticket) {
+	checkThread();
+	Readback* r = findReadback(ticket);
+	ASSERT(r);
+	return r && d3d->device_ctx->GetData(r->query, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
+}
+
+bool mapReadback(ReadbackTicket ticket, Ref<ReadbackData> data) {
+	checkThread();
+	Readback* r = findReadback(ticket);
+	if (!r) {
+		ASSERT(false);
+		return false;
+	}
+
+	// blocks until the copy is done
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	const HRESULT hr = d3d->device_ctx->Map(r->staging, 0, D3D11_MAP_READ, 0, &mapped);
+	if (!SUCCEEDED(hr)) {
+		logError("Failed to map readback resource");
+		return false;
+	}
+	data->data = (const u8*)mapped.pData;
+	data->row_size = r->row_size;
+	data->row_pitch = r->row_count > 1 ? mapped.RowPitch : r->row_size;
+	data->row_count = r->row_count;
+	return true;
+}
+
+void unmapReadback(ReadbackTicket ticket) {
+	checkThread();
+	Readback* r = findReadback(ticket);
+	ASSERT(r);
+	if (!r) return;
+
+	d3d->device_ctx->Unmap(r->staging, 0);
+	r->staging->Release();
+	r->query->Release();
+	d3d->readbacks.swapAndPop(u32(r - d3d->readbacks.begin()));
+}
+
+// staging memory stays mapped until unmapReadback, so this does not touch the immediate context
+void unpackReadback(const ReadbackData& data, Span<u8> out) {
+	ASSERT(out.length() == u64(data.row_size) * data.row_count);
+	unpackReadbackRows(out.begin(), data.data, data.row_size, data.row_pitch, data.row_count);
+}
+
+bool getReadbackData(ReadbackTicket ticket, Span<u8> out) {
+	ReadbackData data;
+	if (!mapReadback(ticket, Ref(data))) return false;
+	unpackReadback(data, out);
+	unmapReadback(ticket);
+	return true;
+}
 
 void queryTimestamp(QueryHandle query) {
 	checkThread();
@@ -679,6 +908,11 @@ void shutdown() {
 
 	ShFinalize();
 
+	executePendingUploads();
+	for (ID3D11DeviceContext* ctx : d3d->upload_contexts) ctx->Release();
+	d3d->upload_contexts.clear();
+	InterlockedIncrement(&upload_generation);
+
 	for (const D3D::State& s : d3d->state_cache) {
 		s.bs->Release();
 		s.dss->Release();
@@ -708,6 +942,24 @@ void shutdown() {
 	}
 
 	d3d->disjoint_query->Release();
+	d3d->draw_constants->Release();
+	for (ID3D11SamplerState* sampler : d3d->samplers) {
+		if (sampler) sampler->Release();
+	}
+	if (d3d->transient_uniforms_ptr) d3d->device_ctx->Unmap(d3d->transient_uniforms.buffer, 0);
+	d3d->memory_tracker.remove(&d3d->transient_uniforms);
+	d3d->transient_uniforms.buffer->Release();
+	d3d->transient_uniforms.buffer = nullptr;
+	for (const TransientTexture& t : d3d->transient_textures) destroy(t.texture);
+	d3d->transient_textures.clear();
+	d3d->render_target_pool.clear();
+	for (const Readback& r : d3d->readbacks) {
+		r.staging->Release();
+		r.query->Release();
+	}
+	d3d->readbacks.clear();
+	d3d->memory_tracker.logLeaks(16);
+	if (d3d->adapter) d3d->adapter->Release();
 	d3d->annotation->Release();
 	d3d->device_ctx->Release();
 
@@ -723,6 +975,23 @@ void shutdown() {
 	d3d.destroy();
 }
 
+// one sampler for each combination of POINT_FILTER, CLAMP_U, CLAMP_V and CLAMP_W
+static bool createSamplers() {
+	for (u32 flags = 0; flags < (u32)lengthOf(d3d->samplers); ++flags) {
+		D3D11_SAMPLER_DESC sampler_desc = {};
+		sampler_desc.Filter = (flags & (u32)TextureFlags::POINT_FILTER) ? D3D11_FILTER_MIN_MAG_MIP_POINT : D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+		sampler_desc.AddressU = (flags & (u32)TextureFlags::CLAMP_U) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
+		sampler_desc.AddressV = (flags & (u32)TextureFlags::CLAMP_V) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
+		sampler_desc.AddressW = (flags & (u32)TextureFlags::CLAMP_W) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
+		sampler_desc.MipLODBias = 0.f;
+		sampler_desc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+		sampler_desc.MinLOD = 0.f;
+		sampler_desc.MaxLOD = D3D11_FLOAT32_MAX;
+		if (!SUCCEEDED(d3d->device->CreateSamplerState(&sampler_desc, &d3d->samplers[flags]))) return false;
+	}
+	return true;
+}
+
 bool init(void* hwnd, u32 flags) {
 	if (d3d->initialized) {
 		// we don't support reinitialization
@@ -777,7 +1046,8 @@ bool init(void* hwnd, u32 flags) {
 	desc.SampleDesc.Quality = 0;
 	desc.Flags = DXGI_SWAP_CHAIN_FLAG_ALLOW_MODE_SWITCH;
 	desc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-	const u32 create_flags = D3D11_CREATE_DEVICE_SINGLETHREADED | (debug ? D3D11_CREATE_DEVICE_DEBUG : 0);
+	// not single threaded, resources are created from loader threads
+	const u32 create_flags = debug ? D3D11_CREATE_DEVICE_DEBUG : 0;
 	D3D_FEATURE_LEVEL feature_level;
 	ID3D11DeviceContext* ctx;
 	HRESULT hr = api_D3D11CreateDeviceAndSwapChain(NULL
@@ -874,7 +1144,45 @@ bool init(void* hwnd, u32 flags) {
 
 	d3d->device_ctx->Begin(d3d->disjoint_query);
 	d3d->disjoint_waiting = false;
-
+	if (!createSamplers()) return false;
+
+	D3D11_BUFFER_DESC draw_constants_desc = {};
+	draw_constants_desc.ByteWidth = MAX_DRAW_CONSTANTS_SIZE;
+	draw_constants_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	draw_constants_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	draw_constants_desc.Usage = D3D11_USAGE_DYNAMIC;
+	hr = d3d->device->CreateBuffer(&draw_constants_desc, nullptr, &d3d->draw_constants);
+	if(!SUCCEEDED(hr)) return false;
+	d3d->device_ctx->VSSetConstantBuffers(DRAW_CONSTANTS_BINDING, 1, &d3d->draw_constants);
+	d3d->device_ctx->PSSetConstantBuffers(DRAW_CONSTANTS_BINDING, 1, &d3d->draw_constants);
+	d3d->device_ctx->CSSetConstantBuffers(DRAW_CONSTANTS_BINDING, 1, &d3d->draw_constants);
+
+	D3D11_FEATURE_DATA_D3D11_OPTIONS& options = d3d->options;
+	d3d->device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options));
+	if (!options.MapNoOverwriteOnDynamicConstantBuffer) {
+		logError("Driver does not support D3D11_MAP_WRITE_NO_OVERWRITE on constant buffers, transient uniforms might be corrupted.");
+	}
+	D3D11_BUFFER_DESC transient_desc = {};
+	transient_desc.ByteWidth = TRANSIENT_UNIFORMS_SIZE;
+	transient_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	transient_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	transient_desc.Usage = D3D11_USAGE_DYNAMIC;
+	hr = d3d->device->CreateBuffer(&transient_desc, nullptr, &d3d->transient_uniforms.buffer);
+	if(!SUCCEEDED(hr)) return false;
+	d3d->transient_uniforms.is_constant_buffer = true;
+	d3d->memory_tracker.add(&d3d->transient_uniforms, ResourceCategory::UPLOAD, TRANSIENT_UNIFORMS_SIZE, "transient_uniforms");
+
+	// budget and usage for getMemoryStats
+	IDXGIDevice* dxgi_device;
+	if (d3d->device->QueryInterface(IID_PPV_ARGS(&dxgi_device)) == S_OK) {
+		IDXGIAdapter* adapter;
+		if (dxgi_device->GetAdapter(&adapter) == S_OK) {
+			if (adapter->QueryInterface(IID_PPV_ARGS(&d3d->adapter)) != S_OK) d3d->adapter = nullptr;
+			adapter->Release();
+		}
+		dxgi_device->Release();
+	}
+
 	d3d->shader_compiler.load(".shader_cache_dx11");
 
 	d3d->initialized = true;
@@ -900,6 +1208,7 @@ void popDebugGroup()
 void setFramebufferCube(TextureHandle cube, u32 face, u32 mip)
 {
 	ASSERT(cube);
+	executePendingUploads();
 	d3d->current_framebuffer.count = 0;
 	d3d->current_framebuffer.depth_stencil = nullptr;
 	if (cube->rtv && (cube->rtv_face != face || cube->rtv_mip) != mip) {
@@ -938,6 +1247,7 @@ void setFramebufferCube(TextureHandle cube, u32 face, u32 mip)
 void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle ds, u32 flags) {
 	ASSERT(num < (u32)lengthOf(d3d->current_framebuffer.render_targets));
 	checkThread();
+	executePendingUploads();
 
 	const bool readonly_ds = flags & (u32)FramebufferFlags::READONLY_DEPTH_STENCIL;
 	if (!attachments && !ds) {
@@ -1019,6 +1329,7 @@ void* map(BufferHandle buffer, size_t size)
 	ASSERT(buffer);
 	D3D11_MAP map = D3D11_MAP_WRITE_DISCARD;
 	ASSERT(!buffer->mapped_ptr);
+	ASSERT(buffer->is_dynamic);
 	D3D11_MAPPED_SUBRESOURCE msr;
 	d3d->device_ctx->Map(buffer->buffer, 0, map, 0, &msr);
 	buffer->mapped_ptr = (u8*)msr.pData;
@@ -1033,7 +1344,77 @@ void unmap(BufferHandle buffer)
 	buffer->mapped_ptr = nullptr;
 }
 
-bool getMemoryStats(Ref<MemoryStats> stats) { return false; }
+void unmap(BufferHandle buffer, size_t written_offset, size_t written_size) {
+	unmap(buffer);
+}
+
+// WRITE_DISCARD in map already gives us a new copy each time
+void createRotatingBuffer(BufferHandle buffer, u32 flags, size_t size) {
+	ASSERT(flags & (u32)BufferFlags::MAPPABLE);
+	createBuffer(buffer, flags, size, nullptr);
+}
+
+// placement of dynamic buffers is up to the driver
+BufferPromotionStats getBufferPromotionStats() { return {}; }
+u32 getPromotedBuffers(BufferHandle* buffers, u32 max_count) { return 0; }
+// D3D11 does not expose barriers
+BarrierStats getBarrierStats() { return {}; }
+
+static void updateMemoryStats() {
+	ResourceMemoryStats& stats = d3d->memory_stats;
+	d3d->memory_tracker.getStats(stats);
+	if (!d3d->adapter) return;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	if (d3d->adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info) == S_OK) {
+		stats.budget = info.Budget;
+		stats.usage = info.CurrentUsage;
+	}
+	if (d3d->adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &info) == S_OK) {
+		stats.non_local_budget = info.Budget;
+		stats.non_local_usage = info.CurrentUsage;
+	}
+
+	const bool over_budget = stats.budget != 0 && stats.usage > stats.budget;
+	if (over_budget && !d3d->over_budget && d3d->budget_callback) d3d->budget_callback(stats, d3d->budget_callback_user_ptr);
+	d3d->over_budget = over_budget;
+}
+
+ResourceMemoryStats getResourceMemoryStats() {
+	return d3d->memory_stats;
+}
+
+void setDebugName(BufferHandle buffer, const char* debug_name) {
+	ASSERT(buffer);
+	ASSERT(debug_name);
+	d3d->memory_tracker.setName(buffer, debug_name);
+	buffer->buffer->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)strlen(debug_name), debug_name);
+}
+
+// D3D11 runtime manages residency itself
+ResidencyStats getResidencyStats() {
+	return {};
+}
+
+void setMemoryBudgetCallback(MemoryBudgetCallback callback, void* user_ptr) {
+	d3d->budget_callback = callback;
+	d3d->budget_callback_user_ptr = user_ptr;
+}
+
+bool getMemoryStats(Ref<MemoryStats> stats) {
+	if (!d3d->adapter) return false;
+	const ResourceMemoryStats& s = d3d->memory_stats;
+	DXGI_ADAPTER_DESC1 desc;
+	if (d3d->adapter->GetDesc1(&desc) != S_OK) return false;
+
+	stats->total_available_mem = s.budget;
+	stats->current_available_mem = s.budget > s.usage ? s.budget - s.usage : 0;
+	stats->dedicated_vidmem = desc.DedicatedVideoMemory;
+	stats->buffer_mem = s.size[(u32)ResourceCategory::STATIC_BUFFER] + s.size[(u32)ResourceCategory::DYNAMIC_BUFFER];
+	stats->texture_mem = s.size[(u32)ResourceCategory::TEXTURE];
+	stats->render_target_mem = s.size[(u32)ResourceCategory::RENDER_TARGET];
+	return true;
+}
 
 void setCurrentWindow(void* window_handle)
 {
@@ -1119,6 +1500,14 @@ void setCurrentWindow(void* window_handle)
 
 u32 swapBuffers()
 {
+	d3d->scratch_stats.frame_usage = d3d->transient_uniforms_usage;
+	d3d->scratch_stats.peak_usage = maximum(d3d->scratch_stats.peak_usage, d3d->transient_uniforms_usage);
+	d3d->transient_uniforms_usage = 0;
+	executePendingUploads();
+	updateTransientTextures();
+	d3d->render_target_pool.update();
+	updateMemoryStats();
+
 	if(d3d->disjoint_waiting) {
 		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint_query_data;
 		const HRESULT res = d3d->device_ctx->GetData(d3d->disjoint_query, &disjoint_query_data, sizeof(disjoint_query_data), 0);
@@ -1212,7 +1601,9 @@ void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data)
 	}
 
 	desc.ByteWidth = (UINT)size;
+	buffer->size = (u32)size;
 	buffer->is_constant_buffer = flags & (u32)BufferFlags::UNIFORM_BUFFER;
+	buffer->is_srv = !buffer->is_constant_buffer && (flags & (u32)BufferFlags::SHADER_BUFFER);
 	if (flags & (u32)BufferFlags::UNIFORM_BUFFER) {
 		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER; 
 	}
@@ -1231,16 +1622,18 @@ void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data)
 	if (flags & (u32)BufferFlags::IMMUTABLE) {
 		desc.Usage = D3D11_USAGE_IMMUTABLE;
 	}
-	else if (flags & (u32)BufferFlags::COMPUTE_WRITE) {
-		desc.Usage = D3D11_USAGE_DEFAULT;
-	}
-	else {
+	else if (flags & (u32)BufferFlags::MAPPABLE) {
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 		desc.Usage = D3D11_USAGE_DYNAMIC;
+		buffer->is_dynamic = true;
+	}
+	else {
+		desc.Usage = D3D11_USAGE_DEFAULT;
 	}
 	D3D11_SUBRESOURCE_DATA initial_data = {};
 	initial_data.pSysMem = data;
 	d3d->device->CreateBuffer(&desc, data ? &initial_data : nullptr, &buffer->buffer);
+	d3d->memory_tracker.add(buffer, desc.Usage == D3D11_USAGE_DYNAMIC ? ResourceCategory::DYNAMIC_BUFFER : ResourceCategory::STATIC_BUFFER, desc.ByteWidth, "buffer");
 
 	if(flags & (u32)BufferFlags::SHADER_BUFFER) {
 		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
@@ -1300,205 +1693,121 @@ void VertexDecl::addAttribute(u8 idx, u8 byte_offset, u8 components_num, Attribu
 	++attributes_count;
 }
 
-ID3D11SamplerState* getSampler(u32 flags) {
-	const u32 idx = flags & 0b1111;
-	if (!d3d->samplers[idx]) {
-		D3D11_SAMPLER_DESC sampler_desc = {};
-		sampler_desc.Filter = (flags & (u32)TextureFlags::POINT_FILTER) ? D3D11_FILTER_MIN_MAG_MIP_POINT : D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-		sampler_desc.AddressU = (flags & (u32)TextureFlags::CLAMP_U) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
-		sampler_desc.AddressV = (flags & (u32)TextureFlags::CLAMP_V) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
-		sampler_desc.AddressW = (flags & (u32)TextureFlags::CLAMP_W) ? D3D11_TEXTURE_ADDRESS_CLAMP : D3D11_TEXTURE_ADDRESS_WRAP;
-		sampler_desc.MipLODBias = 0.f;
-		sampler_desc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-		sampler_desc.MinLOD = 0.f;
-		sampler_desc.MaxLOD = D3D11_FLOAT32_MAX;
-		d3d->device->CreateSamplerState(&sampler_desc, &d3d->samplers[idx]);
-	}
-
-	return d3d->samplers[idx];
+// all samplers are created in init, textures are created on loader threads too
+ID3D11SamplerState* getSampler(u32 flags) {
+	return d3d->samplers[flags & 0b1111];
 }
 
-bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, const char* debug_name) { 
-	ASSERT(debug_name && debug_name[0]);
-	ASSERT(handle);
-	checkThread();
-	DDS::Header hdr;
-
-	InputMemoryStream blob(data, size);
-	blob.read(&hdr, sizeof(hdr));
-
-	if (hdr.dwMagic != DDS::DDS_MAGIC || hdr.dwSize != 124 ||
-		!(hdr.dwFlags & DDS::DDSD_PIXELFORMAT) || !(hdr.dwFlags & DDS::DDSD_CAPS))
-	{
-		logError("Wrong dds format or corrupted dds (", debug_name, ")");
-		return false;
-	}
-
-	DDS::LoadInfo* li;
-	int layers = 1;
-
-	if (isDXT1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT1;
-	}
-	else if (isDXT3(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT3;
-	}
-	else if (isDXT5(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT5;
-	}
-	else if (isATI1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoATI1;
-	}
-	else if (isATI2(hdr.pixelFormat)) {
-		li = &DDS::loadInfoATI2;
-	}
-	else if (isBGRA8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGRA8;
-	}
-	else if (isBGR8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR8;
-	}
-	else if (isBGR5A1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR5A1;
-	}
-	else if (isBGR565(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR565;
-	}
-	else if (isINDEX8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoIndex8;
-	}
-	else if (isDXT10(hdr.pixelFormat)) {
-		DDS::DXT10Header dxt10_hdr;
-		blob.read(dxt10_hdr);
-		li = DDS::getDXT10LoadInfo(hdr, dxt10_hdr);
-		layers = dxt10_hdr.array_size;
-	}
-	else {
-		ASSERT(false);
-		return false;
-	}
-
-	const bool is_cubemap = (hdr.caps2.dwCaps2 & DDS::DDSCAPS2_CUBEMAP) != 0;
-	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
-	const DXGI_FORMAT internal_format = is_srgb ? li->srgb_format : li->format;
-	const u32 mip_count = (hdr.dwFlags & DDS::DDSD_MIPMAPCOUNT) ? hdr.dwMipMapCount : 1;
-	Texture& texture = *handle;
-	texture.flags = flags;
-	texture.w = hdr.dwWidth;
-	texture.h = hdr.dwHeight;
-	#ifdef LUMIX_DEBUG
-		texture.name = debug_name;
-	#endif
-
-	D3D11_SUBRESOURCE_DATA* srd = (D3D11_SUBRESOURCE_DATA*)_alloca(sizeof(D3D11_SUBRESOURCE_DATA) * mip_count * layers * (is_cubemap ? 6 : 1));
-	u32 srd_idx = 0;
-	for(int side = 0; side < (is_cubemap ? 6 : 1); ++side) {
-		for (int layer = 0; layer < layers; ++layer) {
-			//const GLenum tex_img_target =  is_cubemap ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + side : layers > 1 ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
-
-			if (li->compressed) {
-				/*if (size != hdr.dwPitchOrLinearSize || (hdr.dwFlags & DDS::DDSD_LINEARSIZE) == 0) {
-					CHECK_GL(glDeleteTextures(1, &texture));
-					return false;
-				}*/
-				for (u32 mip = 0; mip < mip_count; ++mip) {
-					const u32 width = maximum(1, hdr.dwWidth >> mip);
-					const u32 height = maximum(1, hdr.dwHeight >> mip);
-					const u32 size = DDS::sizeDXTC(width, height, internal_format);
-					srd[srd_idx].pSysMem = (u8*)blob.getData() + blob.getPosition();
-					srd[srd_idx].SysMemPitch = ((width + 3) / 4) * DDS::sizeDXTC(1, 1, internal_format);
-					srd[srd_idx].SysMemSlicePitch = ((height + 3) / 4) * srd[srd_idx].SysMemPitch;
-					blob.skip(size);
-					ASSERT(size == srd[srd_idx].SysMemSlicePitch);
-					++srd_idx;
-				}
-			}
-			else {
-				// TODO
-				ASSERT(false);
-			}
-		}
-	}
-
-	if (is_cubemap) {
-		D3D11_TEXTURE2D_DESC desc = {};
-
-		desc.Width = maximum(li->block_width, hdr.dwWidth);
-		desc.Height = maximum(li->block_width, hdr.dwHeight);
-		desc.ArraySize = 6;
-		desc.MipLevels = mip_count;
-		desc.CPUAccessFlags = 0;
-		desc.Format = is_srgb ? li->srgb_format : li->format;
-		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		desc.MiscFlags = 0;
-		desc.Usage = D3D11_USAGE_DEFAULT;
-		desc.SampleDesc.Count = 1;
-		desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
-		texture.dxgi_format = desc.Format;
-		HRESULT hr = d3d->device->CreateTexture2D(&desc, srd, &texture.texture2D);
-		ASSERT(SUCCEEDED(hr));
-
-		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
-		srv_desc.Format = toViewFormat(desc.Format);
-		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
-		srv_desc.TextureCube.MipLevels = mip_count;
-
-		hr = d3d->device->CreateShaderResourceView(texture.texture2D, &srv_desc, &texture.srv);
-		ASSERT(SUCCEEDED(hr));
-	} else if (layers > 1) {
-		D3D11_TEXTURE2D_DESC desc = {};
-
-		desc.Width = maximum(li->block_width, hdr.dwWidth);
-		desc.Height = maximum(li->block_width, hdr.dwHeight);
-		desc.ArraySize = layers;
-		desc.MipLevels = mip_count;
-		desc.CPUAccessFlags = 0;
-		desc.Format = is_srgb ? li->srgb_format : li->format;
-		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		desc.MiscFlags = 0;
-		desc.Usage = D3D11_USAGE_DEFAULT;
-		desc.SampleDesc.Count = 1;
-		texture.dxgi_format = desc.Format;
-		HRESULT hr = d3d->device->CreateTexture2D(&desc, srd, &texture.texture2D);
-		ASSERT(SUCCEEDED(hr));
-
-		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
-		srv_desc.Format = toViewFormat(desc.Format);
-		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
-		srv_desc.Texture2DArray.MipLevels = mip_count;
-		srv_desc.Texture2DArray.ArraySize = layers;
-		srv_desc.Texture2DArray.FirstArraySlice = 0;
-
-		hr = d3d->device->CreateShaderResourceView(texture.texture2D, &srv_desc, &texture.srv);
-		ASSERT(SUCCEEDED(hr));
-	} else {
-		D3D11_TEXTURE2D_DESC desc = {};
-		desc.Width = maximum(li->block_width, hdr.dwWidth);
-		desc.Height = maximum(li->block_width, hdr.dwHeight);
-		desc.ArraySize = layers;
-		desc.MipLevels = mip_count;
-		desc.CPUAccessFlags = 0;
-		desc.Format = is_srgb ? li->srgb_format : li->format;
-		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-		desc.MiscFlags = 0;
-		desc.SampleDesc.Count = 1;
-		desc.Usage = D3D11_USAGE_DEFAULT;
-		texture.dxgi_format = desc.Format;
-		HRESULT hr = d3d->device->CreateTexture2D(&desc, srd, &texture.texture2D);
-		ASSERT(SUCCEEDED(hr));
-
-		D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
-		srv_desc.Format = toViewFormat(desc.Format);
-		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		srv_desc.Texture2D.MipLevels = mip_count;
-
-		hr = d3d->device->CreateShaderResourceView(texture.texture2D, &srv_desc, &texture.srv);
-		ASSERT(SUCCEEDED(hr));
+PreparedTexture* prepareTexture(const void* data, u64 size, u32 flags, const char* debug_name) {
+	ASSERT(debug_name && debug_name[0]);
+	PreparedTexture* prepared = LUMIX_NEW(d3d->allocator, PreparedTexture)(d3d->allocator);
+	prepared->flags = flags;
+	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
+	// D3D11 takes tightly packed initial data
+	if (!computeTextureLayout(data, size, is_srgb, 1, 1, prepared->layout, debug_name)) {
+		LUMIX_DELETE(d3d->allocator, prepared);
+		return nullptr;
+	}
+	// D3D11 copies initial data itself, tightly packed rows can be used as they are
+	if (prepared->layout.conversion != PixelConversion::NONE) {
+		if (prepared->layout.staging_size > 0xffFFffFF) {
+			logError("Texture is too big (", debug_name, ")");
+			LUMIX_DELETE(d3d->allocator, prepared);
+			return nullptr;
+		}
+		prepared->converted.resize(u32(prepared->layout.staging_size));
+		writeTextureRows(prepared->layout, prepared->converted.begin());
+	}
+	return prepared;
+}
+
+void destroy(PreparedTexture* prepared) {
+	if (prepared) LUMIX_DELETE(d3d->allocator, prepared);
+}
+
+bool commitTexture(TextureHandle handle, PreparedTexture* prepared, const char* debug_name) {
+	ASSERT(debug_name && debug_name[0]);
+	ASSERT(handle);
+	ASSERT(prepared);
+	const TextureLayout& layout = prepared->layout;
+	const bool is_cubemap = layout.is_cubemap;
+	const u32 layers = layout.layers;
+	const u32 mip_count = layout.mips;
+	Texture& texture = *handle;
+	texture.flags = prepared->flags;
+	texture.w = layout.width;
+	texture.h = layout.height;
+	#ifdef LUMIX_DEBUG
+		texture.name = debug_name;
+	#endif
+
+	D3D11_SUBRESOURCE_DATA* srd = (D3D11_SUBRESOURCE_DATA*)_alloca(sizeof(D3D11_SUBRESOURCE_DATA) * layout.subresources.size());
+	for (u32 i = 0, c = layout.subresources.size(); i < c; ++i) {
+		const SubresourceLayout& sub = layout.subresources[i];
+		srd[i].pSysMem = prepared->converted.empty() ? sub.src : prepared->converted.begin() + sub.offset;
+		srd[i].SysMemPitch = sub.row_pitch;
+		srd[i].SysMemSlicePitch = sub.row_pitch * sub.row_count;
+	}
+
+	D3D11_TEXTURE2D_DESC desc = {};
+	desc.Width = layout.width;
+	desc.Height = layout.height;
+	desc.ArraySize = layout.array_size;
+	desc.MipLevels = mip_count;
+	desc.CPUAccessFlags = 0;
+	desc.Format = (DXGI_FORMAT)layout.dxgi_format;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = is_cubemap ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+	desc.Usage = D3D11_USAGE_DEFAULT;
+	desc.SampleDesc.Count = 1;
+	texture.dxgi_format = desc.Format;
+	const u64 memory_size = layout.staging_size;
+	HRESULT hr = d3d->device->CreateTexture2D(&desc, srd, &texture.texture2D);
+	destroy(prepared);
+	if (!SUCCEEDED(hr)) {
+		logError("Failed to create texture (", debug_name, ")");
+		return false;
+	}
+	d3d->memory_tracker.add(handle, ResourceCategory::TEXTURE, memory_size, debug_name);
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = toViewFormat(desc.Format);
+	if (is_cubemap) {
+		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+		srv_desc.TextureCube.MipLevels = mip_count;
+	}
+	else if (layers > 1) {
+		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		srv_desc.Texture2DArray.MipLevels = mip_count;
+		srv_desc.Texture2DArray.ArraySize = layers;
+		srv_desc.Texture2DArray.FirstArraySlice = 0;
+	}
+	else {
+		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		srv_desc.Texture2D.MipLevels = mip_count;
+	}
+	hr = d3d->device->CreateShaderResourceView(texture.texture2D, &srv_desc, &texture.srv);
+	ASSERT(SUCCEEDED(hr));
+
+	texture.sampler = getSampler(texture.flags);
+
+	return true;
+}
+
+bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, const char* debug_name) { 
+	PreparedTexture* prepared = prepareTexture(data, size, flags, debug_name);
+	if (!prepared) return false;
+	return commitTexture(handle, prepared, debug_name);
+}
+
+// ignores alignment and padding
+static u64 getTextureMemorySize(u32 w, u32 h, u32 depth, bool is_3d, u32 mips, DXGI_FORMAT format) {
+	u64 size = 0;
+	for (u32 mip = 0; mip < mips; ++mip) {
+		const u32 d = is_3d ? maximum(depth >> mip, 1u) : depth;
+		size += u64(maximum(w >> mip, 1u)) * maximum(h >> mip, 1u) * d * getSize(format);
 	}
-
-	texture.sampler = getSampler(flags);
-
-	return true;
+	return size;
 }
 
 bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, u32 flags, const void* data, const char* debug_name)
@@ -1590,7 +1899,7 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 			texture.texture3D->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)strlen(debug_name), debug_name);
 		}
 		if (data) {
-			d3d->device_ctx->UpdateSubresource(texture.texture3D, 0, nullptr, data, w * bytes_per_pixel, w  * h * bytes_per_pixel);
+			getUploadContext()->UpdateSubresource(texture.texture3D, 0, nullptr, data, w * bytes_per_pixel, w  * h * bytes_per_pixel);
 		}
 	}
 	else {
@@ -1600,7 +1909,7 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 			texture.texture2D->SetPrivateData(WKPDID_D3DDebugObjectName, (UINT)strlen(debug_name), debug_name);
 		}
 		if (data) {
-			d3d->device_ctx->UpdateSubresource(texture.texture2D, 0, nullptr, data, w * bytes_per_pixel, w  * h * bytes_per_pixel);
+			getUploadContext()->UpdateSubresource(texture.texture2D, 0, nullptr, data, w * bytes_per_pixel, w  * h * bytes_per_pixel);
 		}
 	}
 
@@ -1643,12 +1952,110 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 			d3d->device->CreateShaderResourceView(texture.texture2D, &srv_desc, &texture.srv);
 		}
 		if (data && gen_mip) {
-			d3d->device_ctx->GenerateMips(texture.srv);
+			getUploadContext()->GenerateMips(texture.srv);
 		}
-	}
+	}
+	d3d->memory_tracker.add(handle, is_render_target ? ResourceCategory::RENDER_TARGET : ResourceCategory::TEXTURE, getTextureMemorySize(w, h, is_3d ? depth : (is_cubemap ? 6 : depth), is_3d, mip_count, texture.dxgi_format), debug_name);
+	if (data) submitUploadContext(getUploadContext());
+	return true;
+}
+
+bool createTransientTextures(const TransientTextureDesc* descs, u32 count, TextureHandle* handles) {
+	u64 size = 0;
+	for (u32 i = 0; i < count; ++i) {
+		const TransientTextureDesc& td = descs[i];
+		ASSERT(td.flags & (u32)TextureFlags::RENDER_TARGET);
+		handles[i] = INVALID_TEXTURE;
+		TransientTexture* entry = nullptr;
+		for (TransientTexture& t : d3d->transient_textures) {
+			if (t.used || t.w != td.w || t.h != td.h || t.format != td.format || t.flags != td.flags) continue;
+			entry = &t;
+			break;
+		}
+		if (!entry) {
+			TextureHandle texture = allocTextureHandle();
+			if (!createTexture(texture, td.w, td.h, 1, td.format, td.flags, nullptr, td.debug_name)) {
+				destroy(texture);
+				return false;
+			}
+			entry = &d3d->transient_textures.emplace();
+			entry->texture = texture;
+			entry->w = td.w;
+			entry->h = td.h;
+			entry->format = td.format;
+			entry->flags = td.flags;
+		}
+		entry->used = true;
+		entry->idle_frames = 0;
+		handles[i] = entry->texture;
+		const bool no_mips = td.flags & (u32)TextureFlags::NO_MIPS;
+		size += getTextureMemorySize(td.w, td.h, 1, false, no_mips ? 1 : 1 + log2(maximum(td.w, td.h)), entry->texture->dxgi_format);
+	}
+	d3d->transient_stats.heap_size = size;
+	d3d->transient_stats.requested_size = size;
+	d3d->transient_stats.texture_count = count;
+	d3d->transient_stats.cached_count = d3d->transient_textures.size();
 	return true;
 }
 
+void beginTransientPass(u32 pass) {}
+
+static void updateTransientTextures() {
+	for (i32 i = d3d->transient_textures.size() - 1; i >= 0; --i) {
+		TransientTexture& t = d3d->transient_textures[i];
+		if (t.used) {
+			t.used = false;
+			continue;
+		}
+		if (++t.idle_frames <= TRANSIENT_TEXTURE_MAX_IDLE_FRAMES) continue;
+		destroy(t.texture);
+		d3d->transient_textures.swapAndPop(i);
+	}
+	d3d->transient_stats.cached_count = d3d->transient_textures.size();
+}
+
+TransientStats getTransientStats() {
+	return d3d->transient_stats;
+}
+
+void setMaxRenderResolution(u32 w, u32 h) {
+	d3d->render_target_pool.max_w = w;
+	d3d->render_target_pool.max_h = h;
+}
+
+TextureHandle acquireRenderTarget(u32 w, u32 h, TextureFormat format, u32 flags, const char* debug_name) {
+	return d3d->render_target_pool.acquire(w, h, format, flags, debug_name);
+}
+
+void releaseRenderTarget(TextureHandle texture) {
+	d3d->render_target_pool.release(texture);
+}
+
+RenderTargetPoolStats getRenderTargetPoolStats() {
+	return d3d->render_target_pool.getStats();
+}
+
+void setDynamicResolution(bool enabled, float target_frame_ms, float min_scale, float max_scale) {
+	ASSERT(min_scale > 0 && min_scale <= max_scale && max_scale <= 1);
+	DynamicResolution& dr = d3d->dynamic_resolution;
+	dr.enabled = enabled;
+	dr.target_ms = target_frame_ms;
+	dr.min_scale = min_scale;
+	dr.max_scale = max_scale;
+}
+
+void updateDynamicResolution(float gpu_frame_ms) {
+	d3d->dynamic_resolution.update(gpu_frame_ms);
+}
+
+float getDynamicResolutionScale() {
+	return d3d->dynamic_resolution.scale;
+}
+
+DynamicResolutionView getDynamicResolutionView(TextureHandle target, u32 w, u32 h) {
+	return d3d->render_target_pool.getView(target, w, h, d3d->dynamic_resolution.scale);
+}
+
 void setState(u64 state)
 {
 	auto iter = d3d->state_cache.find(state);
@@ -1838,6 +2245,7 @@ void drawTriangles(u32 bytes_offset, u32 indices_count, DataType index_type) {
 	ID3D11Buffer* b = d3d->current_index_buffer->buffer;
 	d3d->device_ctx->IASetIndexBuffer(b, dxgi_index_type, bytes_offset);
 	d3d->device_ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	unmapTransientUniforms();
 	d3d->device_ctx->DrawIndexed(indices_count, 0, 0);
 }
 
@@ -1852,6 +2260,7 @@ void drawArrays(u32 offset, u32 count, PrimitiveType type)
 		default: ASSERT(false); return;
 	}
 	d3d->device_ctx->IASetPrimitiveTopology(topology);
+	unmapTransientUniforms();
 	d3d->device_ctx->Draw(count, offset);
 }
 
@@ -1879,8 +2288,8 @@ TextureInfo getTextureInfo(const void* data)
 	return info;
 }
 
-void destroy(BufferHandle buffer) {
-	checkThread();
+void destroy(BufferHandle buffer) {
+	d3d->memory_tracker.remove(buffer);
 	LUMIX_DELETE(d3d->allocator, buffer);
 }
 
@@ -1929,6 +2338,25 @@ void bindUniformBuffer(u32 index, BufferHandle buffer, size_t offset, size_t siz
 	d3d->device_ctx->CSSetConstantBuffers1(index, 1, &b, &first, &num);
 }
 
+static void uploadDrawConstants() {
+	D3D11_MAPPED_SUBRESOURCE msr;
+	d3d->device_ctx->Map(d3d->draw_constants, 0, D3D11_MAP_WRITE_DISCARD, 0, &msr);
+	memcpy(msr.pData, d3d->draw_constants_data, sizeof(d3d->draw_constants_data));
+	d3d->device_ctx->Unmap(d3d->draw_constants, 0);
+}
+
+void setDrawConstants(const void* data, u32 size) {
+	ASSERT(size <= MAX_DRAW_CONSTANTS_SIZE);
+	memcpy(d3d->draw_constants_data, data, size);
+	uploadDrawConstants();
+}
+
+void setDynamicResolutionConstants(const DynamicResolutionView& view) {
+	const float values[] = { view.uv_scale[0], view.uv_scale[1], view.uv_max[0], view.uv_max[1] };
+	memcpy(d3d->draw_constants_data + DYNAMIC_RESOLUTION_CONSTANTS_OFFSET, values, sizeof(values));
+	uploadDrawConstants();
+}
+
 void drawIndirect(DataType index_type) {
 	DXGI_FORMAT dxgi_index_type;
 	switch(index_type) {
@@ -1943,6 +2371,7 @@ void drawIndirect(DataType index_type) {
 	ID3D11Buffer* indirect_b = d3d->current_indirect_buffer->buffer;
 	d3d->device_ctx->IASetIndexBuffer(index_b, dxgi_index_type, 0);
 	d3d->device_ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	unmapTransientUniforms();
 	d3d->device_ctx->DrawIndexedInstancedIndirect(indirect_b, 0);
 }
 
@@ -1955,6 +2384,7 @@ void bindIndexBuffer(BufferHandle handle) {
 }
 
 void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z) {
+	unmapTransientUniforms();
 	d3d->device_ctx->Dispatch(num_groups_x, num_groups_y, num_groups_z);
 }
 
@@ -1971,7 +2401,7 @@ void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u
 }
 
 void bindImageTexture(TextureHandle handle, u32 unit) {
-	
+	executePendingUploads();
 	if (handle) {
 		Texture& texture = *handle;
 		texture.bound_to_output = unit;
@@ -1986,6 +2416,7 @@ void bindImageTexture(TextureHandle handle, u32 unit) {
 }
 
 void bindTextures(const TextureHandle* handles, u32 offset, u32 count) {
+	executePendingUploads();
 	ID3D11ShaderResourceView* views[16];
 	ID3D11SamplerState* samplers[16];
 	for (u32 i = 0; i < count; ++i) {
@@ -2024,6 +2455,7 @@ void drawTrianglesInstanced(u32 indices_count, u32 instances_count, DataType ind
 	ID3D11Buffer* b = d3d->current_index_buffer->buffer;
 	d3d->device_ctx->IASetIndexBuffer(b, dxgi_index_type, 0);
 	d3d->device_ctx->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	unmapTransientUniforms();
 	d3d->device_ctx->DrawIndexedInstanced(indices_count, instances_count, 0, 0, 0);
 }
 
@@ -2049,6 +2481,7 @@ void drawElements(u32 offset, u32 count, PrimitiveType primitive_type, DataType
 	ID3D11Buffer* b = d3d->current_index_buffer->buffer;
 	d3d->device_ctx->IASetIndexBuffer(b, dxgi_index_type, 0);
 	d3d->device_ctx->IASetPrimitiveTopology(pt);
+	unmapTransientUniforms();
 	d3d->device_ctx->DrawIndexed(count, offset >> offset_shift, 0);
 }
 
@@ -2064,14 +2497,60 @@ void copy(BufferHandle dst, BufferHandle src, u32 dst_offset, u32 size) {
 	d3d->device_ctx->CopySubresourceRegion(dst->buffer, 0, dst_offset, 0, 0, src->buffer, 0, &src_box);
 }
 
-void update(BufferHandle buffer, const void* data, size_t size) {
-	checkThread();
-	ASSERT(buffer);
+void update(BufferHandle buffer, u32 offset, const void* data, size_t size) {
+	checkThread();
+	ASSERT(buffer);
 	ASSERT(!buffer->mapped_ptr);
+	ASSERT(offset + size <= buffer->size);
+	if (size == 0) return;
+	if (offset == 0 && size == buffer->size) {
+		update(buffer, data, size);
+		return;
+	}
 
-	if (buffer->uav) {
-		d3d->device_ctx->UpdateSubresource1(buffer->buffer, 0, nullptr, data, (UINT)size, (UINT)size, D3D11_COPY_DISCARD);
-	}
+	if (!buffer->is_dynamic) {
+		// a box on a constant buffer needs ConstantBufferPartialUpdate and 16 byte granularity
+		ASSERT(!buffer->is_constant_buffer || d3d->options.ConstantBufferPartialUpdate);
+		ASSERT(!buffer->is_constant_buffer || (offset % 16 == 0 && size % 16 == 0));
+		// the driver copies it in order with draws, the rest of the buffer is preserved
+		const D3D11_BOX box = {offset, 0, 0, offset + (UINT)size, 1, 1};
+		d3d->device_ctx->UpdateSubresource1(buffer->buffer, 0, &box, data, (UINT)size, (UINT)size, 0);
+		return;
+	}
+
+	// WRITE_DISCARD would drop the rest of the buffer, NO_OVERWRITE writes the memory draws might still read,
+	// so the range must not be used by draws since the last map or full update, see gpu_ext.h
+	// D3D11.0 does not support NO_OVERWRITE on dynamic constant and shader resource buffers
+	ASSERT(!buffer->is_constant_buffer || d3d->options.MapNoOverwriteOnDynamicConstantBuffer);
+	ASSERT(!buffer->is_srv || d3d->options.MapNoOverwriteOnDynamicBufferSRV);
+	D3D11_MAPPED_SUBRESOURCE msr;
+	d3d->device_ctx->Map(buffer->buffer, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &msr);
+	memcpy((u8*)msr.pData + offset, data, size);
+	d3d->device_ctx->Unmap(buffer->buffer, 0);
+}
+
+void update(BufferHandle buffer, const void* data, size_t size) {
+	checkThread();
+	ASSERT(buffer);
+	ASSERT(!buffer->mapped_ptr);
+
+	ASSERT(size <= buffer->size);
+
+	if (!buffer->is_dynamic) {
+		if (size == buffer->size) {
+			d3d->device_ctx->UpdateSubresource1(buffer->buffer, 0, nullptr, data, (UINT)size, (UINT)size, D3D11_COPY_DISCARD);
+		}
+		else if (!buffer->is_constant_buffer) {
+			const D3D11_BOX box = {0, 0, 0, (UINT)size, 1, 1};
+			d3d->device_ctx->UpdateSubresource1(buffer->buffer, 0, &box, data, (UINT)size, (UINT)size, D3D11_COPY_DISCARD);
+		}
+		else {
+			// a box on a constant buffer is not supported everywhere, the rest is discarded anyway, so the whole buffer is uploaded
+			d3d->update_scratch.resize(buffer->size);
+			memcpy(d3d->update_scratch.begin(), data, size);
+			d3d->device_ctx->UpdateSubresource1(buffer->buffer, 0, nullptr, d3d->update_scratch.begin(), buffer->size, buffer->size, D3D11_COPY_DISCARD);
+		}
+	}
 	else {
 		D3D11_MAPPED_SUBRESOURCE msr;
 		d3d->device_ctx->Map(buffer->buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &msr);
@@ -8,10 +8,18 @@
 #include "engine/math.h"
 #include "engine/stream.h"
 #include "engine/sync.h"
+#include "gpu_ext.h"
+#include "memory_tracker.h"
+#include "mip_generator.h"
+#include "readback.h"
 #include "renderer/gpu/dds.h"
 #include "renderer/gpu/gpu.h"
+#include "render_target_pool.h"
+#include "residency.h"
 #include "shader_compiler.h"
-#include "stb/stb_image_resize.h"
+#include "texture_layout.h"
+#include "tlsf.h"
+#include "transient_layout.h"
 #include <Windows.h>
 #include <cassert>
 #include <d3d12.h>
@@ -49,9 +57,24 @@ namespace gpu {
 
 static constexpr u32 NUM_BACKBUFFERS = 3;
 static constexpr u32 SCRATCH_BUFFER_SIZE = 4 * 1024 * 1024;
+static constexpr u32 SCRATCH_PAGE_MAX_IDLE_FRAMES = 16;
+static constexpr u32 TRANSIENT_TEXTURE_MAX_IDLE_FRAMES = 16;
+static constexpr u64 MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+static constexpr u64 MAX_PLACED_RESOURCE_SIZE = 16 * 1024 * 1024;
+static constexpr u32 MEGA_BUFFER_SIZE = 32 * 1024 * 1024;
+static constexpr u32 MAX_MEGA_BUFFER_ALLOCATION = 1024 * 1024;
+static constexpr u64 UPLOAD_RING_SIZE = 64 * 1024 * 1024;
+static constexpr u64 READBACK_RING_SIZE = 32 * 1024 * 1024;
+// MAPPABLE buffers are considered for promotion to default heap once per this many frames
+static constexpr u32 PROMOTION_WINDOW_FRAMES = 60;
+static constexpr u32 PROMOTION_MIN_SIZE = 64 * 1024;
+static constexpr u32 PROMOTION_READS_PER_WRITE = 8;
 static constexpr u32 MAX_DESCRIPTORS = 128 * 1024;
 static constexpr u32 QUERY_COUNT = 2048;
 static constexpr u32 INVALID_HEAP_ID = 0xffFFffFF;
+static constexpr u32 MAX_CBVS = 5;
+static constexpr u32 MAX_SRVS = 10;
+static constexpr u8 INVALID_ROOT_PARAM = 0xff;
 
 template <int N> static void toWChar(WCHAR (&out)[N], const char* in) {
 	const char* c = in;
@@ -76,10 +99,20 @@ static DXGI_FORMAT toViewFormat(DXGI_FORMAT format) {
 	switch (format) {
 		case DXGI_FORMAT_R24G8_TYPELESS: return DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
 		case DXGI_FORMAT_R32_TYPELESS: return DXGI_FORMAT_R32_FLOAT;
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS: return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
 	}
 	return format;
 }
 
+// UAVs can not be sRGB, sRGB textures with UAVs are typeless and their UAVs are UNORM
+static DXGI_FORMAT toUAVFormat(DXGI_FORMAT format) {
+	switch (format) {
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS: return DXGI_FORMAT_R8G8B8A8_UNORM;
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return DXGI_FORMAT_R8G8B8A8_UNORM;
+	}
+	return toViewFormat(format);
+}
+
 static DXGI_FORMAT toDSViewFormat(DXGI_FORMAT format) {
 	switch (format) {
 		case DXGI_FORMAT_R24G8_TYPELESS: return DXGI_FORMAT_D24_UNORM_S8_UINT;
@@ -88,6 +121,9 @@ static DXGI_FORMAT toDSViewFormat(DXGI_FORMAT format) {
 	return format;
 }
 
+static void queueBarrier(ID3D12GraphicsCommandList* cmd_list, const D3D12_RESOURCE_BARRIER& barrier);
+
+// the transition is recorded later, together with others, see queueBarrier
 static void switchState(ID3D12GraphicsCommandList* cmd_list, ID3D12Resource* resource, D3D12_RESOURCE_STATES old_state, D3D12_RESOURCE_STATES new_state) {
 	D3D12_RESOURCE_BARRIER barrier;
 	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
@@ -96,7 +132,7 @@ static void switchState(ID3D12GraphicsCommandList* cmd_list, ID3D12Resource* res
 	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
 	barrier.Transition.StateBefore = old_state;
 	barrier.Transition.StateAfter = new_state;
-	cmd_list->ResourceBarrier(1, &barrier);
+	queueBarrier(cmd_list, barrier);
 }
 
 static u32 getSize(DXGI_FORMAT format) {
@@ -106,6 +142,7 @@ static u32 getSize(DXGI_FORMAT format) {
 		case DXGI_FORMAT_R24G8_TYPELESS: return 4;
 		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return 4;
 		case DXGI_FORMAT_R8G8B8A8_UNORM: return 4;
+		case DXGI_FORMAT_R8G8B8A8_TYPELESS: return 4;
 		case DXGI_FORMAT_R16G16B16A16_UNORM: return 8;
 		case DXGI_FORMAT_R16G16B16A16_FLOAT: return 8;
 		case DXGI_FORMAT_R32G32_FLOAT: return 8;
@@ -190,6 +227,22 @@ struct Query {
 };
 
 struct Program {
+	enum Stage : u32 {
+		VERTEX,
+		FRAGMENT,
+		GEOMETRY,
+		COMPUTE,
+
+		COUNT
+	};
+
+	struct Reflection {
+		u32 used_srvs = 0;
+		u32 readonly = 0xffFFffFF;
+		u32 cbvs = 0;
+		u32 draw_constants_size = 0;
+	};
+
 	Program(IAllocator& allocator)
 		: vs(allocator)
 		, ps(allocator)
@@ -205,29 +258,166 @@ struct Program {
 	u32 attribute_count = 0;
 	u32 readonly_binding_flags = 0xffFFffFF;
 	u32 used_srvs_flags = 0xffFFffFF;
+	Reflection reflection[Stage::COUNT];
+	ID3D12RootSignature* root_signature = nullptr;
+	u8 cbv_params[MAX_CBVS];
+	u8 sampler_param = INVALID_ROOT_PARAM;
+	u8 srv_param = INVALID_ROOT_PARAM;
+	u8 uav_param = INVALID_ROOT_PARAM;
+	u8 draw_constants_param = INVALID_ROOT_PARAM;
+	u8 draw_constants_count = 0;
+	u8 srv_count = 0;
 	#ifdef LUMIX_DEBUG
 		StaticString<64> name;
 	#endif
 };
 
+enum class MemoryCategory : u8 {
+	DEFAULT_BUFFERS,
+	UPLOAD_BUFFERS,
+	TEXTURES
+};
+
+struct MemoryBlock {
+	MemoryBlock(IAllocator& allocator)
+		: tlsf(allocator)
+	{}
+
+	ID3D12Heap* heap = nullptr;
+	MemoryCategory category;
+	TLSF tlsf;
+	// placed resources are made resident and evicted with their heap
+	ResidencyEntry residency;
+};
+
+// block == nullptr for committed resources
+struct GPUAllocation {
+	MemoryBlock* block = nullptr;
+	u32 node = TLSF::INVALID_NODE;
+	u64 size = 0;
+};
+
+// one big resource shared by many small immutable buffers, see createBuffer
+struct MegaBuffer {
+	MegaBuffer(IAllocator& allocator)
+		: tlsf(allocator)
+	{}
+
+	ID3D12Resource* resource = nullptr;
+	D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	GPUAllocation allocation;
+	TLSF tlsf;
+	ResidencyEntry residency;
+};
+
+struct MegaBufferRange {
+	MegaBuffer* mega = nullptr;
+	u32 node = TLSF::INVALID_NODE;
+};
+
 struct Buffer {
 	D3D12_RESOURCE_STATES setState(ID3D12GraphicsCommandList* cmd_list, D3D12_RESOURCE_STATES new_state) {
-		if (state == new_state) return state;
-		D3D12_RESOURCE_STATES old_state = state;
-		switchState(cmd_list, resource, state, new_state);
-		state = new_state;
+		// views into a mega buffer share the state of the whole resource
+		D3D12_RESOURCE_STATES& current = mega_range.mega ? mega_range.mega->state : state;
+		if (current == new_state) return current;
+		D3D12_RESOURCE_STATES old_state = current;
+		switchState(cmd_list, resource, current, new_state);
+		current = new_state;
 		return old_state;
 	}
 
+	D3D12_GPU_VIRTUAL_ADDRESS getGPUAddress() const { return resource->GetGPUVirtualAddress() + offset; }
+
 	ID3D12Resource* resource = nullptr;
+	u32 offset = 0;
+	MegaBufferRange mega_range;
 	u8* mapped_ptr = nullptr;
+	// MAPPABLE buffers are in upload heap and stay mapped for their whole life
+	u8* persistent_ptr = nullptr;
+	// rotating buffers have one copy per frame in flight, `offset` and `heap_id` belong to the current copy
+	u32 copy_count = 1;
+	u32 copy_idx = 0;
+	u32 copy_stride = 0;
+	u64 rotated_frame = 0;
+	u32 copy_heap_ids[NUM_BACKBUFFERS];
+	// range written through map since the last time it was consumed, begin >= end if nothing was written
+	u32 written_begin = 0xffFFffFF;
+	u32 written_end = 0;
+	// there are updates in D3D::buffer_updates, they must be flushed before the buffer is used
+	bool pending_updates = false;
+	// MAPPABLE buffer read by GPU much more often than written can be promoted, then `resource` is in default heap,
+	// CPU writes `upload_resource` and written range is copied to `resource` in flushUpdates
+	ID3D12Resource* upload_resource = nullptr;
+	GPUAllocation upload_allocation;
+	u32 upload_heap_id = INVALID_HEAP_ID;
+	bool shadow_dirty = false;
+	// in the current promotion window
+	u32 gpu_reads = 0;
+	u32 cpu_writes = 0;
+	u32 mappable_idx = 0xffFFffFF; // in D3D::mappable_buffers
 	u32 size = 0;
 	D3D12_RESOURCE_STATES state;
 	u32 heap_id = INVALID_HEAP_ID;
+	GPUAllocation allocation;
+	// only for committed resources, see getResidency
+	ResidencyEntry residency;
+	// initial data is copied on the copy queue, graphics queue waits for it on first use
+	u64 upload_fence = 0;
+	bool upload_pending = false;
+};
+
+struct ScratchPage {
+	Buffer buffer;
+	u8* ptr = nullptr;
+	u32 idle_frames = 0;
+};
+
+struct TextureView {
+	u32 key;
+	u32 id;
+};
+
+// states of all subresources saved by Texture::setState, so a temporary transition of the whole texture can be undone
+struct TextureStates {
+	TextureStates(IAllocator& allocator) : subresource_states(allocator) {}
+
+	bool any(D3D12_RESOURCE_STATES s) const {
+		if (subresource_states.empty()) return state == s;
+		for (D3D12_RESOURCE_STATES i : subresource_states) {
+			if (i == s) return true;
+		}
+		return false;
+	}
+
+	D3D12_RESOURCE_STATES state;
+	// empty if all subresources were in `state`
+	Array<D3D12_RESOURCE_STATES> subresource_states;
 };
 
 struct Texture {
+	Texture(IAllocator& allocator)
+		: rtvs(allocator)
+		, dsvs(allocator)
+		, mip_uavs(allocator)
+		, subresource_states(allocator)
+	{}
+
+	u32 getSubresourceCount() const { return flags & (u32)TextureFlags::IS_3D ? mips : mips * depth; }
+	u32 getSubresource(u32 mip, u32 face) const { return flags & (u32)TextureFlags::IS_3D ? mip : mip + face * mips; }
+	D3D12_RESOURCE_STATES getState(u32 subresource) const { return subresource_states.empty() ? state : subresource_states[subresource]; }
+
+	// if subresources are in different states, returns the state of the first one
 	D3D12_RESOURCE_STATES setState(ID3D12GraphicsCommandList* cmd_list, D3D12_RESOURCE_STATES new_state) {
+		endSplit(cmd_list);
+		if (!subresource_states.empty()) {
+			const D3D12_RESOURCE_STATES old_state = subresource_states[0];
+			for (u32 i = 0, c = subresource_states.size(); i < c; ++i) {
+				if (subresource_states[i] != new_state) switchSubresource(cmd_list, i, subresource_states[i], new_state);
+			}
+			subresource_states.clear();
+			state = new_state;
+			return old_state;
+		}
 		if (state == new_state) return state;
 		D3D12_RESOURCE_STATES old_state = state;
 		switchState(cmd_list, resource, state, new_state);
@@ -235,14 +425,120 @@ struct Texture {
 		return old_state;
 	}
 
+	// like setState, `saved` gets the state of each subresource for restoreStates
+	void setState(ID3D12GraphicsCommandList* cmd_list, D3D12_RESOURCE_STATES new_state, TextureStates& saved) {
+		endSplit(cmd_list);
+		saved.state = state;
+		saved.subresource_states.clear();
+		for (D3D12_RESOURCE_STATES s : subresource_states) saved.subresource_states.push(s);
+		setState(cmd_list, new_state);
+	}
+
+	void restoreStates(ID3D12GraphicsCommandList* cmd_list, const TextureStates& saved) {
+		if (saved.subresource_states.empty()) {
+			setState(cmd_list, saved.state);
+			return;
+		}
+		for (u32 i = 0, c = saved.subresource_states.size(); i < c; ++i) {
+			setSubresourceState(cmd_list, i, saved.subresource_states[i]);
+		}
+	}
+
+	// other subresources keep their state, e.g. a cubemap face is rendered while other mips are sampled
+	D3D12_RESOURCE_STATES setSubresourceState(ID3D12GraphicsCommandList* cmd_list, u32 subresource, D3D12_RESOURCE_STATES new_state) {
+		ASSERT(subresource < getSubresourceCount());
+		endSplit(cmd_list);
+		if (getState(subresource) == new_state) return new_state;
+		if (subresource_states.empty()) {
+			subresource_states.resize(getSubresourceCount());
+			for (D3D12_RESOURCE_STATES& s : subresource_states) s = state;
+		}
+		const D3D12_RESOURCE_STATES old_state = subresource_states[subresource];
+		switchSubresource(cmd_list, subresource, old_state, new_state);
+		subresource_states[subresource] = new_state;
+		collapseStates();
+		return old_state;
+	}
+
+	// subresources in `keep_state` are not transitioned, so the texture can be sampled while some of its subresources are render targets
+	void setStateExcept(ID3D12GraphicsCommandList* cmd_list, D3D12_RESOURCE_STATES new_state, D3D12_RESOURCE_STATES keep_state) {
+		endSplit(cmd_list);
+		if (subresource_states.empty()) {
+			if (state != keep_state) setState(cmd_list, new_state);
+			return;
+		}
+		for (u32 i = 0, c = subresource_states.size(); i < c; ++i) {
+			D3D12_RESOURCE_STATES& s = subresource_states[i];
+			if (s == keep_state || s == new_state) continue;
+			switchSubresource(cmd_list, i, s, new_state);
+			s = new_state;
+		}
+		collapseStates();
+	}
+
+	// the second half of a transition started by beginSplitTransition, must be called before the texture is used
+	void endSplit(ID3D12GraphicsCommandList* cmd_list) {
+		if (!split_pending) return;
+		split_pending = false;
+		D3D12_RESOURCE_BARRIER barrier;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_END_ONLY;
+		barrier.Transition.pResource = resource;
+		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+		barrier.Transition.StateBefore = split_before;
+		barrier.Transition.StateAfter = state;
+		queueBarrier(cmd_list, barrier);
+	}
+
 	ID3D12Resource* resource;
+	// valid only if `subresource_states` is empty
 	D3D12_RESOURCE_STATES state;
 	u32 heap_id;
 	DXGI_FORMAT dxgi_format;
 	u16 flags;
+	u32 w = 0;
+	u32 h = 0;
+	u32 depth = 1; // DepthOrArraySize, i.e. 6 per cube or depth of 3D textures
+	u32 mips = 1;
+	GPUAllocation allocation;
+	ResidencyEntry residency;
+	u64 upload_fence = 0;
+	bool upload_pending = false;
+	// there are updates in D3D::texture_updates, they must be flushed before the texture is used
+	bool pending_updates = false;
+	Array<TextureView> rtvs;
+	Array<TextureView> dsvs;
+	// srv_heap descriptors for generateMipmaps, one UAV per mip, two mips share a slot
+	Array<u32> mip_uavs;
+	// empty while all subresources are in `state`
+	Array<D3D12_RESOURCE_STATES> subresource_states;
+	// `state` is already the target of a split transition, endSplit records its end
+	bool split_pending = false;
+	// in D3D::split_textures, stays there after endSplit until the end of the frame
+	bool split_listed = false;
+	D3D12_RESOURCE_STATES split_before;
 	#ifdef LUMIX_DEBUG
 		StaticString<64> name;
 	#endif
+
+	void switchSubresource(ID3D12GraphicsCommandList* cmd_list, u32 subresource, D3D12_RESOURCE_STATES old_state, D3D12_RESOURCE_STATES new_state) {
+		D3D12_RESOURCE_BARRIER barrier;
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		barrier.Transition.pResource = resource;
+		barrier.Transition.Subresource = subresource;
+		barrier.Transition.StateBefore = old_state;
+		barrier.Transition.StateAfter = new_state;
+		queueBarrier(cmd_list, barrier);
+	}
+
+	void collapseStates() {
+		for (D3D12_RESOURCE_STATES s : subresource_states) {
+			if (s != subresource_states[0]) return;
+		}
+		state = subresource_states[0];
+		subresource_states.clear();
+	}
 };
 
 struct FrameBuffer {
@@ -254,6 +550,38 @@ struct FrameBuffer {
 	u32 count = 0;
 };
 
+static void trackPipeline(ID3D12PipelineState* pso, u64 bytecode_size);
+
+// render targets which live only for a part of the frame share one heap, see createTransientTextures
+struct TransientPool {
+	struct Entry {
+		TextureHandle texture;
+		u32 w;
+		u32 h;
+		TextureFormat format;
+		u32 flags;
+		u64 offset;
+		u32 first_pass;
+		u32 idle_frames = 0;
+		bool used = false; // in the current frame
+	};
+
+	TransientPool(IAllocator& allocator)
+		: entries(allocator)
+		, layout(allocator)
+		, barriers(allocator)
+	{}
+
+	ID3D12Heap* heap = nullptr;
+	u64 heap_size = 0;
+	// placed textures are kept across frames, so they are not recreated if the frame graph does not change
+	Array<Entry> entries;
+	Array<TransientResource> layout;
+	Array<D3D12_RESOURCE_BARRIER> barriers;
+	TransientStats stats = {};
+	bool created = false; // in the current frame
+};
+
 struct PSOCache {
 	PSOCache(IAllocator& allocator)
 		: cache(allocator)
@@ -275,6 +603,7 @@ struct PSOCache {
 		ID3D12PipelineState* pso;
 		HRESULT hr = device->CreateComputePipelineState(&desc, IID_PPV_ARGS(&pso));
 		ASSERT(hr == S_OK);
+		trackPipeline(pso, desc.CS.BytecodeLength);
 		cache.insert(hash, pso);
 		return pso;
 	}
@@ -447,6 +776,7 @@ struct PSOCache {
 		ID3D12PipelineState* pso;
 		HRESULT hr = device->CreateGraphicsPipelineState(&desc, IID_PPV_ARGS(&pso));
 		ASSERT(hr == S_OK);
+		trackPipeline(pso, desc.VS.BytecodeLength + desc.PS.BytecodeLength + desc.GS.BytecodeLength);
 		cache.insert(hash, pso);
 		last = pso;
 		return pso;
@@ -481,6 +811,7 @@ struct ShaderCompilerDX12 : ShaderCompiler {
 		, Ref<Program> program)
 	{
 		program->used_srvs_flags = 0;
+		program->readonly_binding_flags = 0xffFFffFF;
 		program->attribute_count = decl.attributes_count;
 		for (u8 i = 0; i < decl.attributes_count; ++i) {
 			const Attribute& attr = decl.attributes[i];
@@ -494,7 +825,8 @@ struct ShaderCompilerDX12 : ShaderCompiler {
 			program->attributes[i].InstanceDataStepRate = instanced ? 1 : 0;
 		}
 
-		auto compile_stage = [&](ShaderType type, Ref<OutputMemoryStream> out) -> bool {
+		auto compile_stage = [&](ShaderType type, Ref<OutputMemoryStream> out, Ref<Program::Reflection> reflection) -> bool {
+			reflection.value = {};
 			const char* tmp[128];
 			const u32 c = filter(input, type, tmp);
 			if (c == 0) {
@@ -506,28 +838,32 @@ struct ShaderCompilerDX12 : ShaderCompiler {
 				auto iter = m_cache.find(hash);
 				if (iter.isValid()) {
 					set(type, iter.value().data.data(), iter.value().data.size(), program);
-					program->readonly_binding_flags = iter.value().readonly_bitset;
-					program->used_srvs_flags = iter.value().used_srvs_bitset;
-					return true;
+					reflection->readonly = iter.value().readonly_bitset;
+					reflection->used_srvs = iter.value().used_srvs_bitset;
+					reflection->cbvs = iter.value().cbv_bitset;
+					reflection->draw_constants_size = iter.value().draw_constants_size;
 				}
-
-				std::string hlsl;
-				if (!glsl2hlsl(tmp, c, type, name, Ref(hlsl), Ref(program->readonly_binding_flags), Ref(program->used_srvs_flags))) {
-					return false;
+				else {
+					std::string hlsl;
+					if (!glsl2hlsl(tmp, c, type, name, Ref(hlsl), Ref(reflection->readonly), Ref(reflection->used_srvs), Ref(reflection->cbvs), Ref(reflection->draw_constants_size))) {
+						return false;
+					}
+					ID3DBlob* blob = ShaderCompiler::compile(hash, hlsl.c_str(), type, name, reflection->readonly, reflection->used_srvs, reflection->cbvs, reflection->draw_constants_size);
+					if (!blob) return false;
+					set(type, blob->GetBufferPointer(), blob->GetBufferSize(), program);
+					blob->Release();
 				}
-				ID3DBlob* blob = ShaderCompiler::compile(hash, hlsl.c_str(), type, name, program->readonly_binding_flags, program->used_srvs_flags);
-				if (!blob) return false;
-				set(type, blob->GetBufferPointer(), blob->GetBufferSize(), program);
-				blob->Release();
+				program->used_srvs_flags |= reflection->used_srvs;
+				program->readonly_binding_flags &= reflection->readonly;
 				return true;
 			}
 			return false;
 		};
 
-		bool compiled = compile_stage(ShaderType::VERTEX, Ref(program->vs));
-		compiled = compiled && compile_stage(ShaderType::FRAGMENT, Ref(program->ps));
-		compiled = compiled && compile_stage(ShaderType::COMPUTE, Ref(program->cs));
-		compiled = compiled && compile_stage(ShaderType::GEOMETRY, Ref(program->gs));
+		bool compiled = compile_stage(ShaderType::VERTEX, Ref(program->vs), Ref(program->reflection[Program::VERTEX]));
+		compiled = compiled && compile_stage(ShaderType::FRAGMENT, Ref(program->ps), Ref(program->reflection[Program::FRAGMENT]));
+		compiled = compiled && compile_stage(ShaderType::COMPUTE, Ref(program->cs), Ref(program->reflection[Program::COMPUTE]));
+		compiled = compiled && compile_stage(ShaderType::GEOMETRY, Ref(program->gs), Ref(program->reflection[Program::GEOMETRY]));
 		return compiled;
 	}
 };
@@ -573,12 +909,18 @@ struct HeapAllocator {
 	}
 
 	void free(u32 id) {
+		MutexGuard guard(mutex);
 		free_list.push(id);
 	}
 
+	// can be called from any thread
 	u32 alloc(ID3D12Device* device, ID3D12Resource* res, const D3D12_SHADER_RESOURCE_VIEW_DESC& srv_desc, const D3D12_UNORDERED_ACCESS_VIEW_DESC* uav_desc) {
-		u32 id = free_list.back();
-		free_list.pop();
+		u32 id;
+		{
+			MutexGuard guard(mutex);
+			id = free_list.back();
+			free_list.pop();
+		}
 
 		D3D12_CPU_DESCRIPTOR_HANDLE cpu = backing_heap->GetCPUDescriptorHandleForHeapStart();
 		cpu.ptr += id * increment;
@@ -591,6 +933,26 @@ struct HeapAllocator {
 		return id;
 	}
 
+	// both views of the slot are UAVs, `uav1` can be null
+	u32 allocUAVs(ID3D12Device* device, ID3D12Resource* res, const D3D12_UNORDERED_ACCESS_VIEW_DESC& uav0, const D3D12_UNORDERED_ACCESS_VIEW_DESC* uav1) {
+		u32 id;
+		{
+			MutexGuard guard(mutex);
+			id = free_list.back();
+			free_list.pop();
+		}
+
+		D3D12_CPU_DESCRIPTOR_HANDLE cpu = backing_heap->GetCPUDescriptorHandleForHeapStart();
+		cpu.ptr += id * increment;
+		device->CreateUnorderedAccessView(res, nullptr, &uav0, cpu);
+		if (uav1) {
+			cpu.ptr += increment;
+			device->CreateUnorderedAccessView(res, nullptr, uav1, cpu);
+		}
+
+		return id;
+	}
+
 	void copy(ID3D12Device* device, u32 id) {
 		ASSERT(count < max_count);
 		D3D12_CPU_DESCRIPTOR_HANDLE src_cpu = backing_cpu_begin;
@@ -663,6 +1025,7 @@ struct HeapAllocator {
 		return true;
 	}
 
+	Mutex mutex;
 	Array<u32> free_list;
 	D3D12_DESCRIPTOR_HEAP_TYPE heap_type;
 	ID3D12DescriptorHeap* heap = nullptr;
@@ -679,6 +1042,50 @@ struct HeapAllocator {
 	u32 frame = 0;
 };
 
+struct ViewHeap {
+	ViewHeap(IAllocator& allocator)
+		: free_list(allocator) {}
+
+	bool init(ID3D12Device* device, D3D12_DESCRIPTOR_HEAP_TYPE type, u32 num_descriptors) {
+		D3D12_DESCRIPTOR_HEAP_DESC desc;
+		desc.NumDescriptors = num_descriptors;
+		desc.Type = type;
+		desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+		desc.NodeMask = 1;
+		if (device->CreateDescriptorHeap(&desc, IID_PPV_ARGS(&heap)) != S_OK) return false;
+
+		increment = device->GetDescriptorHandleIncrementSize(type);
+		cpu_begin = heap->GetCPUDescriptorHandleForHeapStart();
+		free_list.reserve(num_descriptors);
+		for (u32 i = num_descriptors; i > 0; --i) {
+			free_list.push(i - 1);
+		}
+		return true;
+	}
+
+	u32 alloc() {
+		ASSERT(free_list.size() > 0);
+		const u32 id = free_list.back();
+		free_list.pop();
+		return id;
+	}
+
+	void free(u32 id) {
+		free_list.push(id);
+	}
+
+	D3D12_CPU_DESCRIPTOR_HANDLE getCPU(u32 id) const {
+		D3D12_CPU_DESCRIPTOR_HANDLE res = cpu_begin;
+		res.ptr += id * increment;
+		return res;
+	}
+
+	ID3D12DescriptorHeap* heap = nullptr;
+	D3D12_CPU_DESCRIPTOR_HANDLE cpu_begin;
+	Array<u32> free_list;
+	u32 increment = 0;
+};
+
 static ID3D12Resource* createBuffer(ID3D12Device* device, const void* data, u64 size, D3D12_HEAP_TYPE type) {
 	D3D12_HEAP_PROPERTIES upload_heap_props;
 	upload_heap_props.Type = type;
@@ -722,7 +1129,12 @@ struct Frame {
 	Frame(IAllocator& allocator)
 		: to_release(allocator)
 		, to_heap_release(allocator)
+		, to_rtv_release(allocator)
+		, to_dsv_release(allocator)
 		, to_resolve(allocator)
+		, to_free_memory(allocator)
+		, to_free_ranges(allocator)
+		, scratch_pages(allocator)
 	{}
 
 	void clear();
@@ -730,11 +1142,6 @@ struct Frame {
 	bool init(ID3D12Device* device) {
 		if (device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&cmd_allocator)) != S_OK) return false;
 
-		scratch_buffer = createBuffer(device, nullptr, SCRATCH_BUFFER_SIZE, D3D12_HEAP_TYPE_UPLOAD);
-
-		scratch_buffer->Map(0, nullptr, (void**)&scratch_buffer_begin);
-		scratch_buffer_ptr = scratch_buffer_begin;
-
 		query_buffer = createBuffer(device, nullptr, sizeof(u64) * QUERY_COUNT, D3D12_HEAP_TYPE_READBACK);
 
 		return true;
@@ -776,48 +1183,360 @@ struct Frame {
 		ASSERT(hr == S_OK);
 	}
 
-	ID3D12Resource* scratch_buffer = nullptr;
-	u8* scratch_buffer_ptr = nullptr;
-	u8* scratch_buffer_begin = nullptr;
+	// first page is owned by the frame, the rest is returned to the pool once the frame is finished
+	Array<ScratchPage*> scratch_pages;
+	u32 scratch_offset = 0;
+	u64 scratch_usage = 0;
 	ID3D12CommandAllocator* cmd_allocator = nullptr;
 	Array<IUnknown*> to_release;
 	Array<u32> to_heap_release;
+	Array<u32> to_rtv_release;
+	Array<u32> to_dsv_release;
+	Array<GPUAllocation> to_free_memory;
+	Array<MegaBufferRange> to_free_ranges;
 	HANDLE fence_event = nullptr;
 	Array<Query*> to_resolve;
 	ID3D12Resource* query_buffer;
 	u8* query_buffer_ptr;
 };
 
+// uploads initial data of buffers and textures, so big streaming bursts do not serialize on the graphics queue
+// staging memory is a persistent ring, parts of it are reclaimed once the copy fence passes them
+// methods are not synchronized, lock `mutex` around them, since resources are created from loader threads
+struct CopyQueue {
+	struct Batch {
+		ID3D12CommandAllocator* allocator;
+		u64 fence_value;
+		u64 ring_end;
+	};
+
+	struct PendingRelease {
+		ID3D12Resource* resource;
+		u64 fence_value;
+		GPUAllocation allocation; // size == 0 if the resource does not own any memory
+	};
+
+	struct Staging {
+		ID3D12Resource* resource;
+		u64 offset;
+		u8* ptr;
+		u64 ring_pos; // DEDICATED if `resource` is not the ring
+	};
+
+	static constexpr u64 DEDICATED = ~u64(0);
+
+	CopyQueue(IAllocator& allocator)
+		: in_flight(allocator)
+		, free_allocators(allocator)
+		, to_release(allocator)
+		, reservations(allocator)
+	{}
+
+	bool init(ID3D12Device* device) {
+		this->device = device;
+		D3D12_COMMAND_QUEUE_DESC desc = {};
+		desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+		desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+		desc.NodeMask = 1;
+		if (device->CreateCommandQueue(&desc, IID_PPV_ARGS(&queue)) != S_OK) return false;
+		if (device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)) != S_OK) return false;
+
+		ID3D12CommandAllocator* allocator;
+		if (device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&allocator)) != S_OK) return false;
+		free_allocators.push(allocator);
+		if (device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, allocator, nullptr, IID_PPV_ARGS(&cmd_list)) != S_OK) return false;
+		cmd_list->Close();
+
+		ring = createBuffer(device, nullptr, UPLOAD_RING_SIZE, D3D12_HEAP_TYPE_UPLOAD);
+		if (!ring) return false;
+		ring->SetName(L"upload_ring");
+		ring->Map(0, nullptr, (void**)&ring_ptr);
+		event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+		return true;
+	}
+
+	void shutdown() {
+		flush();
+		wait(next_fence_value - 1);
+		ASSERT(in_flight.size() == 0);
+		for (ID3D12CommandAllocator* allocator : free_allocators) allocator->Release();
+		ring->Unmap(0, nullptr);
+		ring->Release();
+		cmd_list->Release();
+		fence->Release();
+		queue->Release();
+		CloseHandle(event);
+	}
+
+	// fence value signaled when commands recorded right now are finished
+	u64 getFenceValue() const { return next_fence_value; }
+	bool isComplete(u64 value) const { return fence->GetCompletedValue() >= value; }
+
+	ID3D12GraphicsCommandList* getCmdList() {
+		if (recording) return cmd_list;
+
+		if (free_allocators.size() > 0) {
+			allocator = free_allocators.back();
+			free_allocators.pop();
+		}
+		else {
+			const HRESULT hr = device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&allocator));
+			ASSERT(hr == S_OK);
+		}
+		allocator->Reset();
+		cmd_list->Reset(allocator, nullptr);
+		recording = true;
+		return cmd_list;
+	}
+
+	// `mutex` must be locked only for this and releaseStaging, not while the staging is written,
+	// it never waits for GPU, if the ring is full, the staging is a dedicated buffer
+	Staging allocStaging(u64 size, u64 align) {
+		Staging staging;
+		if (size <= UPLOAD_RING_SIZE) {
+			reclaim();
+			const u64 pos = allocRing(size, align);
+			if (pos != DEDICATED) {
+				reservations.push(pos);
+				staging.resource = ring;
+				staging.offset = pos % UPLOAD_RING_SIZE;
+				staging.ptr = ring_ptr + staging.offset;
+				staging.ring_pos = pos;
+				return staging;
+			}
+			// so the copy queue frees some space for the next allocations
+			flush();
+		}
+
+		staging.resource = createBuffer(device, nullptr, size, D3D12_HEAP_TYPE_UPLOAD);
+		staging.offset = 0;
+		staging.ring_pos = DEDICATED;
+		staging.resource->Map(0, nullptr, (void**)&staging.ptr);
+		return staging;
+	}
+
+	// call when copies from `staging` are recorded
+	void releaseStaging(const Staging& staging) {
+		if (staging.ring_pos == DEDICATED) to_release.push({staging.resource, next_fence_value});
+		else reservations.eraseItem(staging.ring_pos);
+	}
+
+	void flush() {
+		if (!recording) return;
+		cmd_list->Close();
+		ID3D12CommandList* lists[] = { cmd_list };
+		queue->ExecuteCommandLists(lengthOf(lists), lists);
+		queue->Signal(fence, next_fence_value);
+		// reserved ranges are copied by later batches, so this one frees the ring only up to the first of them
+		u64 ring_end = head;
+		for (u64 pos : reservations) ring_end = minimum(ring_end, pos);
+		in_flight.push({allocator, next_fence_value, ring_end});
+		++next_fence_value;
+		recording = false;
+	}
+
+	// defined after D3D, released resources are untracked in d3d->memory_tracker
+	void reclaim();
+
+	// blocks CPU
+	void wait(u64 value) {
+		if (value >= next_fence_value) flush();
+		if (fence->GetCompletedValue() < value) {
+			fence->SetEventOnCompletion(value, event);
+			WaitForSingleObject(event, INFINITE);
+		}
+		reclaim();
+	}
+
+	u64 allocRing(u64 size, u64 align) {
+		// nothing uses the ring, start from its beginning, so an allocation which does not fit behind head fits
+		if (in_flight.empty() && !recording && reservations.empty()) head = tail = 0;
+		u64 pos = (head + align - 1) & ~(align - 1);
+		// allocations do not wrap around the end of the ring
+		if (pos % UPLOAD_RING_SIZE + size > UPLOAD_RING_SIZE) pos = (pos / UPLOAD_RING_SIZE + 1) * UPLOAD_RING_SIZE;
+		if (pos + size > tail + UPLOAD_RING_SIZE) return DEDICATED;
+		head = pos + size;
+		return pos;
+	}
+
+	// commands submitted to `dst` after this call wait for the copy
+	void waitOnGPU(ID3D12CommandQueue* dst, u64 value) {
+		if (value >= next_fence_value) flush();
+		if (value <= gpu_waited_value) return;
+		dst->Wait(fence, value);
+		gpu_waited_value = value;
+	}
+
+	Mutex mutex;
+	ID3D12Device* device = nullptr;
+	ID3D12CommandQueue* queue = nullptr;
+	ID3D12Fence* fence = nullptr;
+	ID3D12GraphicsCommandList* cmd_list = nullptr;
+	ID3D12CommandAllocator* allocator = nullptr;
+	bool recording = false;
+	u64 next_fence_value = 1;
+	u64 gpu_waited_value = 0;
+	HANDLE event = nullptr;
+	ID3D12Resource* ring = nullptr;
+	u8* ring_ptr = nullptr;
+	// positions in ring are not wrapped, offset in buffer is position % UPLOAD_RING_SIZE
+	u64 head = 0;
+	u64 tail = 0;
+	Array<Batch> in_flight;
+	Array<ID3D12CommandAllocator*> free_allocators;
+	Array<PendingRelease> to_release;
+	// ring positions returned by allocStaging, which are not released yet
+	Array<u64> reservations;
+};
+
+// CPU side of a texture load, see prepareTexture
+struct PreparedTexture {
+	PreparedTexture(IAllocator& allocator)
+		: layout(allocator)
+	{}
+
+	TextureLayout layout;
+	u32 flags = 0;
+	// in the copy queue's ring, reserved until commitTexture records copies from it or the texture is destroyed
+	CopyQueue::Staging staging = {};
+};
+
 struct SRV {
 	TextureHandle texture;
 	BufferHandle buffer;
 };
 
+// destination of readTextureAsync and readBufferAsync, persistently mapped, created on first use
+// readbacks are consumed in any order, ring space is reclaimed in allocation order
+struct ReadbackRing {
+	struct Readback {
+		u32 id;
+		u64 fence_value;
+		ID3D12Resource* resource; // `ring`, or a dedicated buffer if the readback does not fit
+		u64 offset;
+		u64 ring_end; // 0 for dedicated buffers
+		u32 row_size;
+		u32 row_pitch;
+		u32 row_count;
+		bool mapped;
+		bool consumed;
+	};
+
+	ReadbackRing(IAllocator& allocator)
+		: pending(allocator)
+	{}
+
+	ID3D12Resource* ring = nullptr;
+	u8* ring_ptr = nullptr;
+	u64 head = 0;
+	u64 tail = 0;
+	u32 next_id = 1;
+	Array<Readback> pending;
+};
+
+// copy from the frame's scratch memory, recorded by update(TextureHandle...)
+struct TextureUpdate {
+	Texture* texture;
+	u32 subresource;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+	ID3D12Resource* src;
+	u32 x, y, z;
+};
+
+// copy from the frame's scratch memory, adjacent updates of a buffer are merged
+struct BufferUpdate {
+	Buffer* buffer;
+	u32 dst_offset; // in `buffer->resource`
+	ID3D12Resource* src;
+	u32 src_offset;
+	u32 size;
+};
+
+// everything a program's root signature is built from, programs with the same layout share the signature
+struct RootSignatureLayout {
+	u8 cbv_visibility[MAX_CBVS];
+	u8 srv_visibility;
+	u8 uav_visibility;
+	u8 draw_constants_visibility;
+	u8 draw_constants_count;
+	u8 srv_count;
+	u8 flags;
+};
+
+struct CachedRootSignature {
+	RootSignatureLayout layout;
+	ID3D12RootSignature* signature;
+};
+
 struct D3D {
 
 	struct Window {
 		void* handle = nullptr;
 		IDXGISwapChain3* swapchain = nullptr;
 		ID3D12Resource* backbuffers[NUM_BACKBUFFERS] = {};
+		u32 rtvs[NUM_BACKBUFFERS] = {INVALID_HEAP_ID, INVALID_HEAP_ID, INVALID_HEAP_ID};
 		IVec2 size = IVec2(800, 600);
 	};
 
+	struct RootState {
+		ID3D12RootSignature* signature = nullptr;
+		u32 dirty_cbvs = 0xffFFffFF;
+		bool dirty_samplers = true;
+		bool dirty_draw_constants = true;
+	};
+
+	// built-in compute downsampler used by generateMipmaps, created on first use
+	struct MipGenerator {
+		ID3D12RootSignature* root_signature = nullptr;
+		ID3D12PipelineState* pso = nullptr;
+		bool failed = false;
+	};
+
 	D3D(IAllocator& allocator) 
 		: allocator(allocator) 
+		, root_signatures(allocator)
+		, colliding_root_signatures(allocator)
 		, srv_heap(allocator)
 		, ds_heap(allocator)
 		, sampler_heap(allocator)
 		, rtv_heap(allocator)
 		, shader_compiler(allocator)
 		, frames(allocator)
+		, free_scratch_pages(allocator)
+		, memory_blocks(allocator)
+		, mega_buffers(allocator)
+		, copy_queue(allocator)
 		, pso_cache(allocator)
+		, memory_tracker(allocator)
+		, residency(allocator)
+		, to_evict(allocator)
+		, transient_pool(allocator)
+		, render_target_pool(allocator)
+		, readback(allocator)
+		, texture_updates(allocator)
+		, buffer_updates(allocator)
+		, mappable_buffers(allocator)
+		, pending_barriers(allocator)
+		, dirty_shadows(allocator)
+		, update_barriers(allocator)
+		, split_textures(allocator)
+		, deferred_texture_destroys(allocator)
+		, deferred_buffer_destroys(allocator)
 	{}
 
 	IAllocator& allocator;
 	DWORD thread;
 	RENDERDOC_API_1_0_2* rdoc_api = nullptr;
 	ID3D12Device* device = nullptr;
-	ID3D12RootSignature* root_signature = nullptr;
+	// keyed by layout hash, layouts are compared on a hash match
+	HashMap<u32, CachedRootSignature> root_signatures;
+	// layouts whose hash collides with a different layout in root_signatures
+	Array<CachedRootSignature> colliding_root_signatures;
+	D3D_ROOT_SIGNATURE_VERSION root_signature_version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+	RootState graphics_root;
+	RootState compute_root;
+	D3D12_GPU_VIRTUAL_ADDRESS current_cbvs[MAX_CBVS] = {};
+	u32 draw_constants[MAX_DRAW_CONSTANTS_SIZE / sizeof(u32)] = {};
 	ID3D12Debug* debug = nullptr;
 	ID3D12Fence* fence = nullptr;
 	u64 fence_value = 0;
@@ -826,16 +1545,28 @@ struct D3D {
 	BufferHandle current_indirect_buffer = INVALID_BUFFER;
 	BufferHandle current_index_buffer = INVALID_BUFFER;
 	ProgramHandle current_program = INVALID_PROGRAM;
-	SRV current_srvs[10];
-	u32 current_sampler_flags[10] = {};
-	bool dirty_samplers = true;
+	SRV current_srvs[MAX_SRVS];
+	u32 current_sampler_flags[MAX_SRVS] = {};
 	u64 current_state = 0;
+	// restored after readTexture executes the command list
+	D3D12_VIEWPORT current_viewport = {};
+	D3D12_RECT current_scissor = {};
 	PSOCache pso_cache;
 	Window windows[64];
 	Window* current_window = windows;
 	FrameBuffer current_framebuffer;
 	Array<Frame> frames;
 	Frame* frame;
+	Array<ScratchPage*> free_scratch_pages;
+	ScratchStats scratch_stats = {};
+	Array<MemoryBlock*> memory_blocks;
+	Array<MegaBuffer*> mega_buffers;
+	CopyQueue copy_queue;
+	// guards memory blocks and frame's release lists, resources can be created from any thread,
+	// destroy() off the render thread is deferred, see destroyDeferred
+	Mutex resource_mutex;
+	u64 committed_size = 0;
+	u32 committed_count = 0;
 	ID3D12GraphicsCommandList* cmd_list = nullptr;
 	HMODULE d3d_dll;
 	HMODULE dxgi_dll;
@@ -843,69 +1574,674 @@ struct D3D {
 	ID3D12QueryHeap* query_heap;
 	u32 query_count = 0;
 	SamplerAllocator sampler_heap;
-	HeapAllocator rtv_heap;
-	HeapAllocator ds_heap;
+	ViewHeap rtv_heap;
+	ViewHeap ds_heap;
 	ShaderCompilerDX12 shader_compiler;
+	MipGenerator mip_generator;
+	ResourceMemoryTracker memory_tracker;
+	IDXGIAdapter3* adapter = nullptr;
+	ResourceMemoryStats memory_stats = {};
+	MemoryBudgetCallback budget_callback = nullptr;
+	void* budget_callback_user_ptr = nullptr;
+	bool over_budget = false;
+	ResidencyManager residency;
+	// EnqueueMakeResident needs ID3D12Device3, older runtimes fall back to blocking MakeResident
+	ID3D12Device3* device3 = nullptr;
+	ID3D12Fence* residency_fence = nullptr;
+	u64 residency_fence_value = 0;
+	u64 residency_waited_value = 0;
+	Array<void*> to_evict;
+	u64 frame_counter = 0;
+	TransientPool transient_pool;
+	RenderTargetPool render_target_pool;
+	DynamicResolution dynamic_resolution;
+	ReadbackRing readback;
+	Array<TextureUpdate> texture_updates;
+	Array<BufferUpdate> buffer_updates;
+	// guarded by resource_mutex
+	Array<Buffer*> mappable_buffers;
+	Array<Buffer*> dirty_shadows;
+	BufferPromotionStats promotion_stats = {};
+	// recorded in one ResourceBarrier call right before a command which depends on them, see flushBarriers
+	Array<D3D12_RESOURCE_BARRIER> pending_barriers;
+	BarrierStats barrier_stats = {}; // current frame
+	BarrierStats last_barrier_stats = {};
+	Array<D3D12_RESOURCE_BARRIER> update_barriers;
+	// textures with a split transition which was not ended yet, it must end in the same frame
+	Array<Texture*> split_textures;
+	// destroyed off the render thread, guarded by resource_mutex
+	Array<Texture*> deferred_texture_destroys;
+	Array<Buffer*> deferred_buffer_destroys;
 };
 
 static Local<D3D> d3d;
 
-void Frame::begin() {
-	wait();
-	query_buffer->Map(0, nullptr, (void**)&query_buffer_ptr);
-
-	for (u32 i = 0, c = to_resolve.size(); i < c; ++i) {
-		QueryHandle q = to_resolve[i];
-		memcpy(&q->timestamp, query_buffer_ptr + i * 8, sizeof(q->timestamp));
-	}
-	to_resolve.clear();
+// API object which must be resident when the resource is used
+static ResidencyEntry& getResidency(ResidencyEntry& own, const GPUAllocation& allocation) {
+	return allocation.block ? allocation.block->residency : own;
+}
 
-	for (IUnknown* res : to_release) res->Release();
-	for (u32 i : to_heap_release) d3d->srv_heap.free(i);
-	to_release.clear();
-	to_heap_release.clear();
+static ResidencyEntry& getResidency(Texture& texture) {
+	return getResidency(texture.residency, texture.allocation);
 }
 
-void Frame::clear() {
-	for (IUnknown* res : to_release) res->Release();
-	for (u32 i : to_heap_release) d3d->srv_heap.free(i);
-		
-	to_release.clear();
-	to_heap_release.clear();
+static ResidencyEntry& getResidency(Buffer& buffer) {
+	MegaBuffer* mega = buffer.mega_range.mega;
+	if (mega) return getResidency(mega->residency, mega->allocation);
+	return getResidency(buffer.residency, buffer.allocation);
+}
 
-	scratch_buffer->Release();
-	query_buffer->Release();
+// committed resources in default heap, placed resources are managed with their heap, upload heap is never evicted
+static void addResidency(ResidencyEntry& entry, ID3D12Resource* resource, const GPUAllocation& allocation) {
+	if (allocation.block) return;
+	d3d->residency.add(entry, (ID3D12Pageable*)resource, allocation.size, d3d->frame_counter);
 }
 
+// caller must hold resource_mutex, so the object can not be evicted again before it's resident
+// graphics queue waits for residency_fence in swapBuffers, other users must pass `wait`
+static void makeResident(ResidencyEntry& entry, bool wait) {
+	if (!entry.resident) {
+		d3d->residency.markResident(entry);
+		ID3D12Pageable* object = (ID3D12Pageable*)entry.object;
+		if (d3d->device3) {
+			++d3d->residency_fence_value;
+			const HRESULT hr = d3d->device3->EnqueueMakeResident(D3D12_RESIDENCY_FLAG_NONE, 1, &object, d3d->residency_fence, d3d->residency_fence_value);
+			ASSERT(hr == S_OK);
+		}
+		else {
+			const HRESULT hr = d3d->device->MakeResident(1, &object);
+			ASSERT(hr == S_OK);
+		}
+	}
+	if (wait && d3d->residency_fence->GetCompletedValue() < d3d->residency_fence_value) {
+		d3d->residency_fence->SetEventOnCompletion(d3d->residency_fence_value, nullptr);
+	}
+}
 
-LUMIX_FORCE_INLINE static D3D12_GPU_DESCRIPTOR_HANDLE allocSamplers(SamplerAllocator& heap, const SRV* srvs, u32 count) {
-	u16 flags[10];
-	ASSERT(count <= lengthOf(flags));
-	for (u32 i = 0; i < count; ++i) {
-		if (srvs[i].texture) {
-			ASSERT(srvs[i].texture);
-			flags[i] = srvs[i].texture->flags;
-		} else {
-			flags[i] = 0;
+// transition A->B followed by B->C becomes A->C, A->B followed by B->A cancels out
+static void queueBarrier(ID3D12GraphicsCommandList* cmd_list, const D3D12_RESOURCE_BARRIER& barrier) {
+	ASSERT(cmd_list == d3d->cmd_list);
+	++d3d->barrier_stats.requested;
+	Array<D3D12_RESOURCE_BARRIER>& pending = d3d->pending_barriers;
+	if (barrier.Type == D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) {
+		for (i32 i = pending.size() - 1; i >= 0; --i) {
+			D3D12_RESOURCE_BARRIER& prev = pending[i];
+			// UAV and aliasing barriers must stay between the transitions around them
+			if (prev.Type != D3D12_RESOURCE_BARRIER_TYPE_TRANSITION) break;
+			if (prev.Transition.pResource != barrier.Transition.pResource) continue;
+			if (prev.Transition.Subresource != barrier.Transition.Subresource) break;
+			if (prev.Flags != barrier.Flags) {
+				// no command was recorded between the begin and the end, so there is nothing to overlap
+				if (prev.Flags != D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY || barrier.Flags != D3D12_RESOURCE_BARRIER_FLAG_END_ONLY) break;
+				if (prev.Transition.StateBefore != barrier.Transition.StateBefore || prev.Transition.StateAfter != barrier.Transition.StateAfter) break;
+				prev.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+				--d3d->barrier_stats.split;
+				return;
+			}
+			if (prev.Flags != D3D12_RESOURCE_BARRIER_FLAG_NONE) break;
+			if (prev.Transition.StateAfter != barrier.Transition.StateBefore) break;
+			prev.Transition.StateAfter = barrier.Transition.StateAfter;
+			if (prev.Transition.StateBefore == prev.Transition.StateAfter) pending.erase(i);
+			return;
 		}
 	}
+	pending.push(barrier);
+}
 
-	const u32 hash = crc32(flags, sizeof(flags[0]) * count);
-	auto iter = heap.sampler_map.find(hash);
-	if (iter.isValid()) {
-		D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
-		gpu.ptr += iter.value();
-		return gpu;
+static void flushBarriers() {
+	Array<D3D12_RESOURCE_BARRIER>& pending = d3d->pending_barriers;
+	if (pending.empty()) return;
+	d3d->cmd_list->ResourceBarrier(pending.size(), pending.begin());
+	d3d->barrier_stats.recorded += pending.size();
+	++d3d->barrier_stats.batches;
+	pending.clear();
+}
+
+BarrierStats getBarrierStats() {
+	return d3d->last_barrier_stats;
+}
+
+// used when the next state is known, but not when the texture is used next, e.g. render targets of the previous framebuffer,
+// the GPU can do the transition while it executes commands recorded in between, see Texture::endSplit
+static void beginSplitTransition(Texture& texture, D3D12_RESOURCE_STATES new_state) {
+	// splitting per subresource is not worth it, there are only a few such textures
+	if (!texture.subresource_states.empty() || texture.split_pending) {
+		texture.setState(d3d->cmd_list, new_state);
+		return;
 	}
+	if (texture.state == new_state) return;
 
-	ASSERT(heap.count + count <= heap.max_count);
-	D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
-	D3D12_CPU_DESCRIPTOR_HANDLE cpu = heap.cpu;
-	gpu.ptr += heap.count * heap.increment;
-	cpu.ptr += heap.count * heap.increment;
-	D3D12_GPU_DESCRIPTOR_HANDLE res = gpu;
-	u32 offset = heap.count * heap.increment;
-	heap.count += count;
+	D3D12_RESOURCE_BARRIER barrier;
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_BEGIN_ONLY;
+	barrier.Transition.pResource = texture.resource;
+	barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+	barrier.Transition.StateBefore = texture.state;
+	barrier.Transition.StateAfter = new_state;
+	queueBarrier(d3d->cmd_list, barrier);
+	++d3d->barrier_stats.split;
+
+	texture.split_before = texture.state;
+	texture.state = new_state;
+	texture.split_pending = true;
+	if (!texture.split_listed) {
+		texture.split_listed = true;
+		d3d->split_textures.push(&texture);
+	}
+}
+
+static void endSplitTransitions() {
+	for (Texture* texture : d3d->split_textures) {
+		texture->endSplit(d3d->cmd_list);
+		texture->split_listed = false;
+	}
+	d3d->split_textures.clear();
+}
+
+static void countRead(Texture&) {}
+static void countRead(Buffer& buffer) { ++buffer.gpu_reads; }
+
+// records the last frame the resource is used in, evicted resources are made resident again
+template <typename T>
+static void markUsed(T& resource) {
+	countRead(resource);
+	ResidencyEntry& entry = getResidency(resource);
+	if (!entry.isManaged() || d3d->residency.use(entry, d3d->frame_counter)) return;
+	MutexGuard guard(d3d->resource_mutex);
+	makeResident(entry, false);
+}
+
+// resources uploaded on the copy queue are in COMMON state until first used on the graphics queue
+template <typename T>
+static void resolveUpload(T& resource) {
+	if (!resource.upload_pending) return;
+	{
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.waitOnGPU(d3d->cmd_queue, resource.upload_fence);
+	}
+	switchState(d3d->cmd_list, resource.resource, D3D12_RESOURCE_STATE_COMMON, resource.state);
+	resource.upload_pending = false;
+	d3d->residency.unpin(getResidency(resource));
+}
+
+static void pushUpdateBarrier(ID3D12Resource* resource, u32 subresource, D3D12_RESOURCE_STATES state) {
+	if (state == D3D12_RESOURCE_STATE_COPY_DEST) return;
+	// views into one mega buffer share a resource
+	for (const D3D12_RESOURCE_BARRIER& barrier : d3d->update_barriers) {
+		if (barrier.Transition.pResource == resource && barrier.Transition.Subresource == subresource) return;
+	}
+	D3D12_RESOURCE_BARRIER& barrier = d3d->update_barriers.emplace();
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.Transition.pResource = resource;
+	barrier.Transition.Subresource = subresource;
+	barrier.Transition.StateBefore = state;
+	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_COPY_DEST;
+}
+
+// all updated resources are transitioned in one batch, transitions back are left pending, so they can merge with the next use
+static void flushUpdates() {
+	if (!d3d->dirty_shadows.empty()) {
+		MutexGuard guard(d3d->resource_mutex);
+		for (Buffer* buffer : d3d->dirty_shadows) {
+			buffer->shadow_dirty = false;
+			if (buffer->written_begin >= buffer->written_end) continue;
+			BufferUpdate& u = d3d->buffer_updates.emplace();
+			u.buffer = buffer;
+			u.dst_offset = buffer->written_begin;
+			u.src = buffer->upload_resource;
+			u.src_offset = buffer->written_begin;
+			u.size = buffer->written_end - buffer->written_begin;
+			buffer->pending_updates = true;
+			buffer->written_begin = 0xffFFffFF;
+			buffer->written_end = 0;
+		}
+		d3d->dirty_shadows.clear();
+	}
+	if (d3d->texture_updates.empty() && d3d->buffer_updates.empty()) return;
+
+	Array<D3D12_RESOURCE_BARRIER>& barriers = d3d->update_barriers;
+	barriers.clear();
+	for (const TextureUpdate& u : d3d->texture_updates) {
+		Texture& t = *u.texture;
+		t.pending_updates = false;
+		t.endSplit(d3d->cmd_list);
+		// if subresources are in different states, only the updated ones are transitioned, others can be e.g. render targets
+		if (t.subresource_states.empty()) pushUpdateBarrier(t.resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, t.state);
+		else pushUpdateBarrier(t.resource, u.subresource, t.subresource_states[u.subresource]);
+	}
+	for (const BufferUpdate& u : d3d->buffer_updates) {
+		Buffer& b = *u.buffer;
+		if (!b.pending_updates) continue;
+		b.pending_updates = false;
+		pushUpdateBarrier(b.resource, D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, b.mega_range.mega ? b.mega_range.mega->state : b.state);
+	}
+	for (const D3D12_RESOURCE_BARRIER& barrier : barriers) queueBarrier(d3d->cmd_list, barrier);
+	flushBarriers();
+
+	// in the order of update calls, so overlapping updates of one resource are applied in the right order
+	for (const TextureUpdate& u : d3d->texture_updates) {
+		D3D12_TEXTURE_COPY_LOCATION dst = {};
+		dst.pResource = u.texture->resource;
+		dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+		dst.SubresourceIndex = u.subresource;
+
+		D3D12_TEXTURE_COPY_LOCATION src = {};
+		src.pResource = u.src;
+		src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+		src.PlacedFootprint = u.footprint;
+		d3d->cmd_list->CopyTextureRegion(&dst, u.x, u.y, u.z, &src, nullptr);
+	}
+	for (const BufferUpdate& u : d3d->buffer_updates) {
+		d3d->cmd_list->CopyBufferRegion(u.buffer->resource, u.dst_offset, u.src, u.src_offset, u.size);
+	}
+
+	for (D3D12_RESOURCE_BARRIER& barrier : barriers) {
+		barrier.Transition.StateAfter = barrier.Transition.StateBefore;
+		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
+		queueBarrier(d3d->cmd_list, barrier);
+	}
+	d3d->texture_updates.clear();
+	d3d->buffer_updates.clear();
+}
+
+static void resolveUpdates(Texture& texture) {
+	if (texture.pending_updates) flushUpdates();
+}
+
+static void resolveUpdates(Buffer& buffer) {
+	if (buffer.pending_updates || buffer.shadow_dirty) flushUpdates();
+}
+
+// CPU wrote [begin, end) of a MAPPABLE buffer
+static void markWritten(Buffer& buffer, u32 begin, u32 end) {
+	buffer.written_begin = minimum(buffer.written_begin, begin);
+	buffer.written_end = maximum(buffer.written_end, end);
+	++buffer.cpu_writes;
+	if (!buffer.upload_resource || buffer.shadow_dirty) return;
+	MutexGuard guard(d3d->resource_mutex);
+	buffer.shadow_dirty = true;
+	d3d->dirty_shadows.push(&buffer);
+}
+
+// drivers do not report PSO memory, most of it is compiled shader code, so the bytecode size is used as an estimate
+// GetCachedBlob would be more precise, but it serializes the whole PSO
+static void trackPipeline(ID3D12PipelineState* pso, u64 bytecode_size) {
+	d3d->memory_tracker.add(pso, ResourceCategory::PIPELINE, bytecode_size, "pso");
+}
+
+static void trackDescriptorHeap(ID3D12DescriptorHeap* heap, const char* name) {
+	if (!heap) return;
+	const D3D12_DESCRIPTOR_HEAP_DESC desc = heap->GetDesc();
+	const u64 size = u64(desc.NumDescriptors) * d3d->device->GetDescriptorHandleIncrementSize(desc.Type);
+	d3d->memory_tracker.add(heap, ResourceCategory::DESCRIPTOR_HEAP, size, name);
+}
+
+static ScratchPage* createScratchPage(u32 size) {
+	ScratchPage* page = LUMIX_NEW(d3d->allocator, ScratchPage);
+	page->buffer.resource = createBuffer(d3d->device, nullptr, size, D3D12_HEAP_TYPE_UPLOAD);
+	page->buffer.size = size;
+	page->buffer.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	page->buffer.resource->SetName(L"scratch");
+	page->buffer.resource->Map(0, nullptr, (void**)&page->ptr);
+	d3d->memory_tracker.add(page->buffer.resource, ResourceCategory::UPLOAD, size, "scratch");
+	d3d->scratch_stats.reserved += size;
+	++d3d->scratch_stats.page_count;
+	return page;
+}
+
+static void destroyScratchPage(ScratchPage* page) {
+	d3d->scratch_stats.reserved -= page->buffer.size;
+	--d3d->scratch_stats.page_count;
+	page->buffer.resource->Unmap(0, nullptr);
+	d3d->memory_tracker.remove(page->buffer.resource);
+	page->buffer.resource->Release();
+	LUMIX_DELETE(d3d->allocator, page);
+}
+
+static ScratchPage* acquireScratchPage(u32 min_size) {
+	for (i32 i = d3d->free_scratch_pages.size() - 1; i >= 0; --i) {
+		ScratchPage* page = d3d->free_scratch_pages[i];
+		if (page->buffer.size < min_size) continue;
+		d3d->free_scratch_pages.swapAndPop(i);
+		page->idle_frames = 0;
+		return page;
+	}
+	return createScratchPage(maximum(SCRATCH_BUFFER_SIZE, min_size));
+}
+
+// when the current page is full, another one is chained to the frame instead of failing
+static u8* allocScratch(u32 size, u32 align, Ref<Buffer*> buffer, Ref<u32> offset) {
+	Frame& frame = *d3d->frame;
+	ScratchPage* page = frame.scratch_pages.back();
+	u32 aligned = (frame.scratch_offset + align - 1) & ~(align - 1);
+	if (aligned + size > page->buffer.size) {
+		page = acquireScratchPage(size);
+		frame.scratch_pages.push(page);
+		aligned = 0;
+	}
+	frame.scratch_offset = aligned + size;
+	frame.scratch_usage += size;
+	buffer = &page->buffer;
+	offset = aligned;
+	return page->ptr + aligned;
+}
+
+static MemoryBlock* createMemoryBlock(MemoryCategory category) {
+	D3D12_HEAP_DESC desc = {};
+	desc.SizeInBytes = MEMORY_BLOCK_SIZE;
+	desc.Properties.Type = category == MemoryCategory::UPLOAD_BUFFERS ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+	desc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	desc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	// resource heap tier 1 does not allow mixing buffers and textures in one heap
+	desc.Flags = category == MemoryCategory::TEXTURES ? D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES : D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+
+	ID3D12Heap* heap;
+	if (d3d->device->CreateHeap(&desc, IID_PPV_ARGS(&heap)) != S_OK) return nullptr;
+
+	MemoryBlock* block = LUMIX_NEW(d3d->allocator, MemoryBlock)(d3d->allocator);
+	block->heap = heap;
+	block->category = category;
+	block->tlsf.init(MEMORY_BLOCK_SIZE);
+	if (category != MemoryCategory::UPLOAD_BUFFERS) {
+		d3d->residency.add(block->residency, (ID3D12Pageable*)heap, MEMORY_BLOCK_SIZE, d3d->frame_counter);
+	}
+	d3d->memory_blocks.push(block);
+	return block;
+}
+
+static bool allocMemory(MemoryCategory category, const D3D12_RESOURCE_ALLOCATION_INFO& info, Ref<GPUAllocation> allocation, Ref<u64> offset) {
+	for (MemoryBlock* block : d3d->memory_blocks) {
+		if (block->category != category) continue;
+		const TLSF::Allocation a = block->tlsf.alloc(info.SizeInBytes, info.Alignment);
+		if (!a.isValid()) continue;
+		allocation->block = block;
+		allocation->node = a.node;
+		allocation->size = a.size;
+		offset = a.offset;
+		return true;
+	}
+
+	MemoryBlock* block = createMemoryBlock(category);
+	if (!block) return false;
+	const TLSF::Allocation a = block->tlsf.alloc(info.SizeInBytes, info.Alignment);
+	ASSERT(a.isValid());
+	allocation->block = block;
+	allocation->node = a.node;
+	allocation->size = a.size;
+	offset = a.offset;
+	return true;
+}
+
+// must not be called before GPU is done with the resource placed in the allocation
+// caller must hold resource_mutex
+static void freeMemory(const GPUAllocation& allocation) {
+	MemoryBlock* block = allocation.block;
+	if (!block) {
+		d3d->committed_size -= allocation.size;
+		--d3d->committed_count;
+		return;
+	}
+
+	block->tlsf.free(allocation.node);
+	if (!block->tlsf.isEmpty()) return;
+
+	// keep one empty block per category, so we do not create and destroy heaps all the time
+	for (MemoryBlock* b : d3d->memory_blocks) {
+		if (b == block || b->category != block->category || !b->tlsf.isEmpty()) continue;
+		d3d->memory_blocks.eraseItem(block);
+		d3d->residency.remove(block->residency);
+		block->heap->Release();
+		LUMIX_DELETE(d3d->allocator, block);
+		return;
+	}
+}
+
+static void freeMemoryLocked(const GPUAllocation& allocation) {
+	MutexGuard guard(d3d->resource_mutex);
+	freeMemory(allocation);
+}
+
+void CopyQueue::reclaim() {
+	const u64 completed = fence->GetCompletedValue();
+	while (in_flight.size() > 0 && in_flight[0].fence_value <= completed) {
+		tail = in_flight[0].ring_end;
+		free_allocators.push(in_flight[0].allocator);
+		in_flight.erase(0);
+	}
+	for (i32 i = to_release.size() - 1; i >= 0; --i) {
+		if (to_release[i].fence_value > completed) continue;
+		d3d->memory_tracker.remove(to_release[i].resource);
+		to_release[i].resource->Release();
+		if (to_release[i].allocation.size) freeMemoryLocked(to_release[i].allocation);
+		to_release.swapAndPop(i);
+	}
+}
+
+// small resources are placed in shared heaps, big ones and render targets get their own committed resource
+static HRESULT createResource(D3D12_HEAP_TYPE type
+	, D3D12_RESOURCE_DESC desc
+	, D3D12_RESOURCE_STATES state
+	, const D3D12_CLEAR_VALUE* clear_value
+	, Ref<GPUAllocation> allocation
+	, ID3D12Resource** resource)
+{
+	const bool is_buffer = desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER;
+	// placed RT/DS textures would have to be cleared or discarded before first use, because memory can be reused
+	const bool is_rt_ds = desc.Flags & (D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET | D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL);
+	const bool can_place = !is_rt_ds && (type == D3D12_HEAP_TYPE_DEFAULT || (type == D3D12_HEAP_TYPE_UPLOAD && is_buffer));
+
+	D3D12_RESOURCE_ALLOCATION_INFO info = {};
+	if (can_place) {
+		if (!is_buffer && desc.SampleDesc.Count == 1) {
+			desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+			info = d3d->device->GetResourceAllocationInfo(0, 1, &desc);
+			if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT) desc.Alignment = 0;
+		}
+		if (desc.Alignment == 0) info = d3d->device->GetResourceAllocationInfo(0, 1, &desc);
+	}
+
+	if (can_place && info.SizeInBytes <= MAX_PLACED_RESOURCE_SIZE) {
+		const MemoryCategory category = !is_buffer
+			? MemoryCategory::TEXTURES
+			: type == D3D12_HEAP_TYPE_UPLOAD ? MemoryCategory::UPLOAD_BUFFERS : MemoryCategory::DEFAULT_BUFFERS;
+		u64 offset;
+		d3d->resource_mutex.enter();
+		const bool allocated = allocMemory(category, info, allocation, Ref(offset));
+		if (allocated) {
+			// the heap can be evicted, and the copy queue does not wait for residency_fence
+			ResidencyEntry& residency = allocation->block->residency;
+			if (residency.isManaged()) {
+				d3d->residency.use(residency, d3d->frame_counter);
+				makeResident(residency, true);
+			}
+		}
+		d3d->resource_mutex.exit();
+		if (allocated) {
+			const HRESULT hr = d3d->device->CreatePlacedResource(allocation->block->heap, offset, &desc, state, clear_value, IID_PPV_ARGS(resource));
+			if (hr == S_OK) return hr;
+			MutexGuard guard(d3d->resource_mutex);
+			freeMemory(allocation.value);
+		}
+	}
+
+	desc.Alignment = 0;
+	D3D12_HEAP_PROPERTIES props = {};
+	props.Type = type;
+	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	const HRESULT hr = d3d->device->CreateCommittedResource(&props, D3D12_HEAP_FLAG_NONE, &desc, state, clear_value, IID_PPV_ARGS(resource));
+	if (hr != S_OK) return hr;
+
+	GPUAllocation committed;
+	committed.size = d3d->device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+	allocation = committed;
+	MutexGuard guard(d3d->resource_mutex);
+	d3d->committed_size += committed.size;
+	++d3d->committed_count;
+	return hr;
+}
+
+// mapped upload buffer, release it through CopyQueue::to_release after the copy from it is recorded
+static bool createStagingBuffer(u64 size, ID3D12Resource** resource, Ref<GPUAllocation> allocation, u8** ptr) {
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+	desc.Width = size;
+	desc.Height = 1;
+	desc.DepthOrArraySize = 1;
+	desc.MipLevels = 1;
+	desc.SampleDesc.Count = 1;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+	if (createResource(D3D12_HEAP_TYPE_UPLOAD, desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, allocation, resource) != S_OK) return false;
+	d3d->memory_tracker.add(*resource, ResourceCategory::UPLOAD, allocation->size, "staging");
+
+	D3D12_RANGE read_range = {};
+	const HRESULT hr = (*resource)->Map(0, &read_range, (void**)ptr);
+	ASSERT(hr == S_OK);
+	return true;
+}
+
+static bool allocMegaBufferRange(u32 size, u32 align, Ref<MegaBufferRange> range, Ref<u32> offset) {
+	MegaBuffer* mega = nullptr;
+	TLSF::Allocation a;
+	for (MegaBuffer* m : d3d->mega_buffers) {
+		a = m->tlsf.alloc(size, align);
+		if (!a.isValid()) continue;
+		mega = m;
+		break;
+	}
+
+	if (!mega) {
+		D3D12_RESOURCE_DESC desc = {};
+		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		desc.Width = MEGA_BUFFER_SIZE;
+		desc.Height = 1;
+		desc.DepthOrArraySize = 1;
+		desc.MipLevels = 1;
+		desc.Format = DXGI_FORMAT_UNKNOWN;
+		desc.SampleDesc.Count = 1;
+		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+		mega = LUMIX_NEW(d3d->allocator, MegaBuffer)(d3d->allocator);
+		if (createResource(D3D12_HEAP_TYPE_DEFAULT, desc, mega->state, nullptr, Ref(mega->allocation), &mega->resource) != S_OK) {
+			LUMIX_DELETE(d3d->allocator, mega);
+			return false;
+		}
+		mega->resource->SetName(L"mega_buffer");
+		d3d->memory_tracker.add(mega->resource, ResourceCategory::STATIC_BUFFER, mega->allocation.size, "mega_buffer");
+		addResidency(mega->residency, mega->resource, mega->allocation);
+		mega->tlsf.init(MEGA_BUFFER_SIZE);
+		d3d->mega_buffers.push(mega);
+		a = mega->tlsf.alloc(size, align);
+		ASSERT(a.isValid());
+	}
+
+	range->mega = mega;
+	range->node = a.node;
+	offset = u32(a.offset);
+	return true;
+}
+
+void Frame::begin() {
+	wait();
+
+	ScratchStats& stats = d3d->scratch_stats;
+	stats.frame_usage = scratch_usage;
+	stats.peak_usage = maximum(stats.peak_usage, scratch_usage);
+	for (u32 i = 1, c = scratch_pages.size(); i < c; ++i) {
+		d3d->free_scratch_pages.push(scratch_pages[i]);
+	}
+	scratch_pages.resize(1);
+	scratch_offset = 0;
+	scratch_usage = 0;
+
+	for (i32 i = d3d->free_scratch_pages.size() - 1; i >= 0; --i) {
+		ScratchPage* page = d3d->free_scratch_pages[i];
+		if (++page->idle_frames <= SCRATCH_PAGE_MAX_IDLE_FRAMES) continue;
+		destroyScratchPage(page);
+		d3d->free_scratch_pages.swapAndPop(i);
+	}
+	query_buffer->Map(0, nullptr, (void**)&query_buffer_ptr);
+
+	for (u32 i = 0, c = to_resolve.size(); i < c; ++i) {
+		QueryHandle q = to_resolve[i];
+		memcpy(&q->timestamp, query_buffer_ptr + i * 8, sizeof(q->timestamp));
+	}
+	to_resolve.clear();
+
+	MutexGuard guard(d3d->resource_mutex);
+	for (IUnknown* res : to_release) {
+		d3d->memory_tracker.remove(res);
+		res->Release();
+	}
+	for (u32 i : to_heap_release) d3d->srv_heap.free(i);
+	for (u32 i : to_rtv_release) d3d->rtv_heap.free(i);
+	for (u32 i : to_dsv_release) d3d->ds_heap.free(i);
+	for (const GPUAllocation& a : to_free_memory) freeMemory(a);
+	for (const MegaBufferRange& r : to_free_ranges) r.mega->tlsf.free(r.node);
+	to_release.clear();
+	to_heap_release.clear();
+	to_rtv_release.clear();
+	to_dsv_release.clear();
+	to_free_memory.clear();
+	to_free_ranges.clear();
+}
+
+void Frame::clear() {
+	MutexGuard guard(d3d->resource_mutex);
+	for (IUnknown* res : to_release) {
+		d3d->memory_tracker.remove(res);
+		res->Release();
+	}
+	for (u32 i : to_heap_release) d3d->srv_heap.free(i);
+	for (u32 i : to_rtv_release) d3d->rtv_heap.free(i);
+	for (u32 i : to_dsv_release) d3d->ds_heap.free(i);
+	for (const GPUAllocation& a : to_free_memory) freeMemory(a);
+	for (const MegaBufferRange& r : to_free_ranges) r.mega->tlsf.free(r.node);
+		
+	to_release.clear();
+	to_heap_release.clear();
+	to_rtv_release.clear();
+	to_dsv_release.clear();
+	to_free_memory.clear();
+	to_free_ranges.clear();
+
+	for (ScratchPage* page : scratch_pages) destroyScratchPage(page);
+	scratch_pages.clear();
+	query_buffer->Release();
+}
+
+
+LUMIX_FORCE_INLINE static D3D12_GPU_DESCRIPTOR_HANDLE allocSamplers(SamplerAllocator& heap, const SRV* srvs, u32 count) {
+	u16 flags[10];
+	ASSERT(count <= lengthOf(flags));
+	for (u32 i = 0; i < count; ++i) {
+		if (srvs[i].texture) {
+			ASSERT(srvs[i].texture);
+			flags[i] = srvs[i].texture->flags;
+		} else {
+			flags[i] = 0;
+		}
+	}
+
+	const u32 hash = crc32(flags, sizeof(flags[0]) * count);
+	auto iter = heap.sampler_map.find(hash);
+	if (iter.isValid()) {
+		D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
+		gpu.ptr += iter.value();
+		return gpu;
+	}
+
+	ASSERT(heap.count + count <= heap.max_count);
+	D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
+	D3D12_CPU_DESCRIPTOR_HANDLE cpu = heap.cpu;
+	gpu.ptr += heap.count * heap.increment;
+	cpu.ptr += heap.count * heap.increment;
+	D3D12_GPU_DESCRIPTOR_HANDLE res = gpu;
+	u32 offset = heap.count * heap.increment;
+	heap.count += count;
 
 	for (u32 i = 0; i < count; ++i) {
 		if (srvs[i].texture) {
@@ -943,12 +2279,17 @@ LUMIX_FORCE_INLINE static D3D12_GPU_DESCRIPTOR_HANDLE allocSRV(const Program& pr
 		const bool is_readonly = program.readonly_binding_flags & (1 << i);
 		if (srvs[i].buffer) {
 			Buffer& b = *srvs[i].buffer;
+			markUsed(b);
 			heap.copy(d3d->device, b.resource ? b.heap_id + (is_readonly ? 0 : 1) : 1);
 			b.setState(d3d->cmd_list, is_readonly ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 		} else if (srvs[i].texture) {
 			Texture& t = *srvs[i].texture;
+			markUsed(t);
 			heap.copy(d3d->device, t.resource ? t.heap_id + (is_readonly ? 0 : 1) : 0);
-			if (t.state & D3D12_RESOURCE_STATE_DEPTH_READ) {
+			if (!t.subresource_states.empty()) {
+				t.setStateExcept(d3d->cmd_list, is_readonly ? D3D12_RESOURCE_STATE_GENERIC_READ : D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_RENDER_TARGET);
+			}
+			else if (t.state & D3D12_RESOURCE_STATE_DEPTH_READ) {
 				//t.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_DEPTH_READ);
 			}
 			else {
@@ -963,110 +2304,84 @@ LUMIX_FORCE_INLINE static D3D12_GPU_DESCRIPTOR_HANDLE allocSRV(const Program& pr
 }
 
 
-static D3D12_CPU_DESCRIPTOR_HANDLE allocDSV(HeapAllocator& heap, const Texture& texture) {
-	ASSERT(heap.count + 1 <= heap.max_count);
-	D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
-	D3D12_CPU_DESCRIPTOR_HANDLE cpu = heap.cpu;
-	gpu.ptr += heap.count * heap.increment;
-	cpu.ptr += heap.count * heap.increment;
-	D3D12_CPU_DESCRIPTOR_HANDLE res = cpu;
-	++heap.count;
+// view of all slices of array and 3D textures, e.g. for layered rendering with SV_RenderTargetArrayIndex
+static constexpr u32 ALL_SLICES = 0xffFF;
 
-	ASSERT(texture.resource);
-	ASSERT(texture.resource);
-	if (texture.resource) {
-		D3D12_DEPTH_STENCIL_VIEW_DESC desc = {};
-		desc.Format = toDSViewFormat(texture.dxgi_format);
-		desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
-		desc.Texture2D.MipSlice = 0;
-		d3d->device->CreateDepthStencilView(texture.resource, &desc, cpu);
-	}
-	return res;
+static u32 getViewKey(u32 mip, u32 slice, bool readonly) {
+	ASSERT(mip < 0x100 && slice < 0x10000);
+	return mip | (slice << 8) | (readonly ? 1 << 24 : 0);
 }
 
-static D3D12_CPU_DESCRIPTOR_HANDLE allocRTV(HeapAllocator& heap, ID3D12Resource* resource) {
-	ASSERT(heap.count + 1 <= heap.max_count);
-	D3D12_GPU_DESCRIPTOR_HANDLE gpu = heap.gpu;
-	D3D12_CPU_DESCRIPTOR_HANDLE cpu = heap.cpu;
-	gpu.ptr += heap.count * heap.increment;
-	cpu.ptr += heap.count * heap.increment;
-	D3D12_CPU_DESCRIPTOR_HANDLE res = cpu;
-	++heap.count;
-
-	ASSERT(resource);
-	if (resource) {
-		d3d->device->CreateRenderTargetView(resource, nullptr, cpu);
+static D3D12_CPU_DESCRIPTOR_HANDLE getDSV(Texture& texture, u32 mip, u32 slice, bool readonly) {
+	ASSERT(texture.resource);
+	const u32 key = getViewKey(mip, slice, readonly);
+	for (const TextureView& view : texture.dsvs) {
+		if (view.key == key) return d3d->ds_heap.getCPU(view.id);
 	}
-	return res;
-}
-
 
-namespace DDS {
+	D3D12_DEPTH_STENCIL_VIEW_DESC desc = {};
+	desc.Format = toDSViewFormat(texture.dxgi_format);
+	if (readonly) {
+		desc.Flags = D3D12_DSV_FLAG_READ_ONLY_DEPTH;
+		if (desc.Format == DXGI_FORMAT_D24_UNORM_S8_UINT) desc.Flags |= D3D12_DSV_FLAG_READ_ONLY_STENCIL;
+	}
+	if ((texture.flags & (u32)TextureFlags::IS_CUBE) || texture.depth > 1) {
+		desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2DARRAY;
+		desc.Texture2DArray.MipSlice = mip;
+		desc.Texture2DArray.FirstArraySlice = slice;
+		desc.Texture2DArray.ArraySize = 1;
+	}
+	else {
+		ASSERT(slice == 0);
+		desc.ViewDimension = D3D12_DSV_DIMENSION_TEXTURE2D;
+		desc.Texture2D.MipSlice = mip;
+	}
 
-static u32 sizeDXTC(u32 w, u32 h, DXGI_FORMAT format) {
-	const bool is_dxt1 = format == DXGI_FORMAT_BC1_UNORM || format == DXGI_FORMAT_BC1_UNORM_SRGB;
-	const bool is_ati = format == DXGI_FORMAT_BC4_UNORM;
-	return ((w + 3) / 4) * ((h + 3) / 4) * (is_dxt1 || is_ati ? 8 : 16);
+	TextureView& view = texture.dsvs.emplace();
+	view.key = key;
+	view.id = d3d->ds_heap.alloc();
+	const D3D12_CPU_DESCRIPTOR_HANDLE cpu = d3d->ds_heap.getCPU(view.id);
+	d3d->device->CreateDepthStencilView(texture.resource, &desc, cpu);
+	return cpu;
 }
 
-struct LoadInfo {
-	bool compressed;
-	bool swap;
-	bool palette;
-	u32 blockBytes;
-	u32 block_width;
-	u32 block_height;
-	DXGI_FORMAT format;
-	DXGI_FORMAT srgb_format;
-};
-
-static LoadInfo loadInfoDXT1 = {true, false, false, 8, 4, 4, DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC1_UNORM_SRGB};
-static LoadInfo loadInfoDXT3 = {true, false, false, 16, 4, 4, DXGI_FORMAT_BC2_UNORM, DXGI_FORMAT_BC2_UNORM_SRGB};
-static LoadInfo loadInfoDXT5 = {true, false, false, 16, 4, 4, DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_BC3_UNORM_SRGB};
-static LoadInfo loadInfoATI1 = {true, false, false, 8, 4, 4, DXGI_FORMAT_BC4_UNORM, DXGI_FORMAT_UNKNOWN};
-static LoadInfo loadInfoATI2 = {true, false, false, 16, 4, 4, DXGI_FORMAT_BC5_UNORM, DXGI_FORMAT_UNKNOWN};
-static LoadInfo loadInfoBGRA8 = {
-	//	false, false, false, 4, GL_RGBA8, GL_SRGB8_ALPHA8, GL_BGRA,
-	// GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoRGBA8 = {
-	//	false, false, false, 4, GL_RGBA8, GL_SRGB8_ALPHA8, GL_RGBA,
-	// GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoBGR8 = {
-	//	false, false, false, 3, GL_RGB8, GL_SRGB8, GL_BGR, GL_UNSIGNED_BYTE
-};
-static LoadInfo loadInfoBGR5A1 = {
-	//	false, true, false, 2, GL_RGB5_A1, GL_ZERO, GL_BGRA,
-	// GL_UNSIGNED_SHORT_1_5_5_5_REV
-};
-static LoadInfo loadInfoBGR565 = {
-	//	false, true, false, 2, GL_RGB5, GL_ZERO, GL_RGB, GL_UNSIGNED_SHORT_5_6_5
-};
-static LoadInfo loadInfoIndex8 = {
-	//	false, false, true, 1, GL_RGB8, GL_SRGB8, GL_BGRA, GL_UNSIGNED_BYTE
-};
-
-static LoadInfo* getDXT10LoadInfo(const Header& hdr, const DXT10Header& dxt10_hdr) {
-	switch (dxt10_hdr.dxgi_format) {
-		case DxgiFormat::B8G8R8A8_UNORM_SRGB:
-		case DxgiFormat::B8G8R8A8_UNORM: return &loadInfoBGRA8; break;
-		case DxgiFormat::R8G8B8A8_UNORM: return &loadInfoRGBA8; break;
-		case DxgiFormat::BC1_UNORM_SRGB:
-		case DxgiFormat::BC1_UNORM: return &loadInfoDXT1; break;
-		case DxgiFormat::BC2_UNORM_SRGB:
-		case DxgiFormat::BC2_UNORM: return &loadInfoDXT3; break;
-		case DxgiFormat::BC3_UNORM_SRGB:
-		case DxgiFormat::BC3_UNORM: return &loadInfoDXT5; break;
-		default:
-			ASSERT(false);
-			return nullptr;
-			break;
+static D3D12_CPU_DESCRIPTOR_HANDLE getRTV(Texture& texture, u32 mip, u32 slice) {
+	ASSERT(texture.resource);
+	const u32 key = getViewKey(mip, slice, false);
+	for (const TextureView& view : texture.rtvs) {
+		if (view.key == key) return d3d->rtv_heap.getCPU(view.id);
 	}
-}
 
+	D3D12_RENDER_TARGET_VIEW_DESC desc = {};
+	desc.Format = toViewFormat(texture.dxgi_format);
+	const bool all_slices = slice == ALL_SLICES;
+	if (texture.flags & (u32)TextureFlags::IS_3D) {
+		desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE3D;
+		desc.Texture3D.MipSlice = mip;
+		desc.Texture3D.FirstWSlice = all_slices ? 0 : slice;
+		desc.Texture3D.WSize = all_slices ? UINT(-1) : 1;
+	}
+	else if ((texture.flags & (u32)TextureFlags::IS_CUBE) || texture.depth > 1) {
+		desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2DARRAY;
+		desc.Texture2DArray.MipSlice = mip;
+		desc.Texture2DArray.FirstArraySlice = all_slices ? 0 : slice;
+		desc.Texture2DArray.ArraySize = all_slices ? texture.depth : 1;
+		desc.Texture2DArray.PlaneSlice = 0;
+	}
+	else {
+		ASSERT(slice == 0 || all_slices);
+		desc.ViewDimension = D3D12_RTV_DIMENSION_TEXTURE2D;
+		desc.Texture2D.MipSlice = mip;
+		desc.Texture2D.PlaneSlice = 0;
+	}
 
-} // namespace DDS
+	TextureView& view = texture.rtvs.emplace();
+	view.key = key;
+	view.id = d3d->rtv_heap.alloc();
+	const D3D12_CPU_DESCRIPTOR_HANDLE cpu = d3d->rtv_heap.getCPU(view.id);
+	d3d->device->CreateRenderTargetView(texture.resource, &desc, cpu);
+	return cpu;
+}
 
 void launchRenderDoc() {
 	if (d3d->rdoc_api) {
@@ -1088,9 +2403,9 @@ static void try_load_renderdoc() {
 }
 
 QueryHandle createQuery() {
-	checkThread();
-	ASSERT(d3d->query_count < QUERY_COUNT);
 	Query* q = LUMIX_NEW(d3d->allocator, Query);
+	MutexGuard guard(d3d->resource_mutex);
+	ASSERT(d3d->query_count < QUERY_COUNT);
 	q->idx = d3d->query_count;
 	++d3d->query_count;
 	return q;
@@ -1121,16 +2436,38 @@ void destroy(ProgramHandle program) {
 }
 
 void destroy(TextureHandle texture) {
-	checkThread();
 	ASSERT(texture);
+	if (d3d->thread != GetCurrentThreadId()) {
+		// texture_updates and split_textures are not locked, they are used only on the render thread
+		MutexGuard guard(d3d->resource_mutex);
+		d3d->deferred_texture_destroys.push(texture);
+		return;
+	}
 	Texture& t = *texture;
-	if (t.resource) d3d->frame->to_release.push(t.resource);
+	// texture_updates and split_textures point to the texture
+	resolveUpdates(t);
+	t.endSplit(d3d->cmd_list);
+	if (t.split_listed) d3d->split_textures.eraseItem(&t);
+	if (t.upload_pending) {
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.wait(t.upload_fence);
+		d3d->residency.unpin(getResidency(t));
+	}
+	d3d->residency.remove(t.residency);
+	MutexGuard guard(d3d->resource_mutex);
+	if (t.resource) {
+		d3d->frame->to_release.push(t.resource);
+		// transient textures do not own their memory
+		if (t.allocation.size) d3d->frame->to_free_memory.push(t.allocation);
+	}
 	if (t.heap_id != INVALID_HEAP_ID) d3d->frame->to_heap_release.push(t.heap_id);
+	for (const TextureView& view : t.rtvs) d3d->frame->to_rtv_release.push(view.id);
+	for (const TextureView& view : t.dsvs) d3d->frame->to_dsv_release.push(view.id);
+	for (u32 i = 0; i < (u32)t.mip_uavs.size(); i += 2) d3d->frame->to_heap_release.push(t.mip_uavs[i]);
 	LUMIX_DELETE(d3d->allocator, texture);
 }
 
 void destroy(QueryHandle query) {
-	checkThread();
 	// frame should not have a pointer to query, because higher level destroys all queries at once on shutdown
 	ASSERT(query->timestamp); 
 	LUMIX_DELETE(d3d->allocator, query);
@@ -1152,87 +2489,385 @@ void createTextureView(TextureHandle view_handle, TextureHandle texture_handle)
 	ASSERT(false); // TODO
 }
 
-void generateMipmaps(TextureHandle handle) {
-	// Texture& t = d3d->textures[handle.value];
-	// d3d->device_ctx->GenerateMips(t.srv);
-	ASSERT(false); // TODO
-}
-
 void update(TextureHandle texture_handle, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h, TextureFormat format, void* buf) {
-	// Texture& texture = d3d->textures[texture_handle.value];
-	// ASSERT(texture.dxgi_format == getDXGIFormat(format));
-	// const bool no_mips = texture.flags & (u32)TextureFlags::NO_MIPS;
-	// const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(texture.w,
-	// texture.h)); const UINT subres = D3D11CalcSubresource(mip, face,
-	// mip_count); const u32 bytes_per_pixel = getSize(texture.dxgi_format);
-	// const UINT row_pitch = w * bytes_per_pixel;
-	// const UINT depth_pitch = row_pitch * h;
-	// D3D11_BOX box;
-	// box.left = x;
-	// box.top = y;
-	// box.right = x + w;
-	// box.bottom = y + h;
-	// box.front = 0;
-	// box.back = 1;
-	//
-	// d3d->device_ctx->UpdateSubresource(texture.texture2D, subres, &box, buf,
-	// row_pitch, depth_pitch);
-	ASSERT(false); // TODO
+	checkThread();
+	ASSERT(texture_handle);
+	Texture& texture = *texture_handle;
+	// sRGB textures with UAVs are typeless
+	ASSERT(toViewFormat(texture.dxgi_format) == toViewFormat(getDXGIFormat(format)));
+	ASSERT(mip < texture.mips);
+	ASSERT(x + w <= maximum(texture.w >> mip, 1u) && y + h <= maximum(texture.h >> mip, 1u));
+	resolveUpload(texture);
+	markUsed(texture);
+
+	D3D12_RESOURCE_DESC desc = texture.resource->GetDesc();
+	const bool is_3d = texture.flags & (u32)TextureFlags::IS_3D;
+	// `face` is a slice of 3D textures
+	const u32 subresource = is_3d ? mip : D3D12CalcSubresource(mip, face, 0, desc.MipLevels, desc.DepthOrArraySize);
+	desc.Width = w;
+	desc.Height = h;
+	desc.DepthOrArraySize = 1;
+	desc.MipLevels = 1;
+	desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+	UINT row_count;
+	UINT64 row_size;
+	UINT64 total_size;
+	d3d->device->GetCopyableFootprints(&desc, 0, 1, 0, &footprint, &row_count, &row_size, &total_size);
+
+	// rows in scratch memory are D3D12_TEXTURE_DATA_PITCH_ALIGNMENT aligned
+	Buffer* src;
+	u32 src_offset;
+	u8* dst = allocScratch((u32)total_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, Ref(src), Ref(src_offset));
+	const u8* src_rows = (const u8*)buf;
+	for (u32 row = 0; row < row_count; ++row) {
+		memcpy(dst + row * footprint.Footprint.RowPitch, src_rows + row * row_size, row_size);
+	}
+	footprint.Offset = src_offset;
+	// copied in a batch with other updates when the texture is used or at the end of the frame
+	texture.pending_updates = true;
+
+	// region right below the previous update, with rows right after its rows in scratch memory, extends its copy
+	const u32 z = is_3d ? face : 0;
+	if (!d3d->texture_updates.empty()) {
+		TextureUpdate& prev = d3d->texture_updates.back();
+		const D3D12_SUBRESOURCE_FOOTPRINT& pf = prev.footprint.Footprint;
+		const bool adjacent = prev.texture == &texture
+			&& prev.subresource == subresource
+			&& prev.src == src->resource
+			&& prev.x == x && prev.z == z && prev.y + pf.Height == y
+			&& pf.Width == footprint.Footprint.Width
+			&& pf.RowPitch == footprint.Footprint.RowPitch
+			&& prev.footprint.Offset + u64(pf.RowPitch) * pf.Height == src_offset;
+		if (adjacent) {
+			prev.footprint.Footprint.Height += footprint.Footprint.Height;
+			return;
+		}
+	}
+
+	TextureUpdate& u = d3d->texture_updates.emplace();
+	u.texture = &texture;
+	u.subresource = subresource;
+	u.footprint = footprint;
+	u.src = src->resource;
+	u.x = x;
+	u.y = y;
+	u.z = z;
 }
 
 void copy(TextureHandle dst_handle, TextureHandle src_handle, u32 dst_x, u32 dst_y) {
-	// Texture& dst = d3d->textures[dst_handle.value];
-	// Texture& src = d3d->textures[src_handle.value];
-	// const bool no_mips = src.flags & (u32)TextureFlags::NO_MIPS;
-	// const u32 src_mip_count = no_mips ? 1 : 1 + log2(maximum(src.w, src.h));
-	// const u32 dst_mip_count = no_mips ? 1 : 1 + log2(maximum(dst.w, dst.h));
-	//
-	// u32 mip = 0;
-	// while ((src.w >> mip) != 0 || (src.h >> mip) != 0) {
-	//	const u32 w = maximum(src.w >> mip, 1);
-	//	const u32 h = maximum(src.h >> mip, 1);
-	//
-	//	if (src.flags & (u32)TextureFlags::IS_CUBE) {
-	//		for (u32 face = 0; face < 6; ++face) {
-	//			const UINT src_subres = D3D11CalcSubresource(mip, face,
-	// src_mip_count); 			const UINT dst_subres = D3D11CalcSubresource(mip, face,
-	// dst_mip_count); 			d3d->device_ctx->CopySubresourceRegion(dst.texture2D,
-	// dst_subres, dst_x, dst_y, 0, src.texture2D,
-	// src_subres, nullptr);
-	//		}
-	//	}
-	//	else {
-	//		const UINT src_subres = D3D11CalcSubresource(mip, 0, src_mip_count);
-	//		const UINT dst_subres = D3D11CalcSubresource(mip, 0, dst_mip_count);
-	//		d3d->device_ctx->CopySubresourceRegion(dst.texture2D, dst_subres,
-	// dst_x, dst_y, 0, src.texture2D, src_subres,
-	// nullptr);
-	//	}
-	//	++mip;
-	//	if (src.flags & (u32)TextureFlags::NO_MIPS) break;
-	//	if (dst.flags & (u32)TextureFlags::NO_MIPS) break;
-	//}
-	ASSERT(false); // TODO
+	checkThread();
+	ASSERT(dst_handle);
+	ASSERT(src_handle);
+	// every subresource would be copied onto itself
+	ASSERT(dst_handle != src_handle);
+	Texture& dst = *dst_handle;
+	Texture& src = *src_handle;
+	resolveUpload(dst);
+	resolveUpload(src);
+	resolveUpdates(dst);
+	resolveUpdates(src);
+	markUsed(dst);
+	markUsed(src);
+
+	// e.g. a mip of the source can be a render target while other mips are sampled
+	TextureStates dst_states(d3d->allocator);
+	TextureStates src_states(d3d->allocator);
+	dst.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_DEST, dst_states);
+	src.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_SOURCE, src_states);
+	flushBarriers();
+
+	const D3D12_RESOURCE_DESC src_desc = src.resource->GetDesc();
+	const D3D12_RESOURCE_DESC dst_desc = dst.resource->GetDesc();
+	// cube faces are array slices, a 3D subresource contains all slices
+	const bool is_3d = src_desc.Dimension == D3D12_RESOURCE_DIMENSION_TEXTURE3D;
+	const u32 slices = is_3d ? 1 : minimum(src_desc.DepthOrArraySize, dst_desc.DepthOrArraySize);
+	for (u32 mip = 0; mip < src_desc.MipLevels && mip < dst_desc.MipLevels; ++mip) {
+		for (u32 face = 0; face < slices; ++face) {
+			D3D12_TEXTURE_COPY_LOCATION dst_loc = {};
+			dst_loc.pResource = dst.resource;
+			dst_loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			dst_loc.SubresourceIndex = D3D12CalcSubresource(mip, face, 0, dst_desc.MipLevels, dst_desc.DepthOrArraySize);
+
+			D3D12_TEXTURE_COPY_LOCATION src_loc = {};
+			src_loc.pResource = src.resource;
+			src_loc.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			src_loc.SubresourceIndex = D3D12CalcSubresource(mip, face, 0, src_desc.MipLevels, src_desc.DepthOrArraySize);
+			d3d->cmd_list->CopyTextureRegion(&dst_loc, dst_x, dst_y, 0, &src_loc, nullptr);
+		}
+	}
+
+	dst.restoreStates(d3d->cmd_list, dst_states);
+	src.restoreStates(d3d->cmd_list, src_states);
 }
 
+// recorded in the current frame, so it's complete when the frame's fence passes
+static ReadbackRing::Readback& allocReadback(u64 size, u64 align) {
+	ReadbackRing& rb = d3d->readback;
+	if (!rb.ring) {
+		rb.ring = createBuffer(d3d->device, nullptr, READBACK_RING_SIZE, D3D12_HEAP_TYPE_READBACK);
+		rb.ring->SetName(L"readback_ring");
+		d3d->memory_tracker.add(rb.ring, ResourceCategory::READBACK, READBACK_RING_SIZE, "readback_ring");
+		// readback heap is cached, it can stay mapped
+		const HRESULT hr = rb.ring->Map(0, nullptr, (void**)&rb.ring_ptr);
+		ASSERT(hr == S_OK);
+	}
+
+	ReadbackRing::Readback& r = rb.pending.emplace();
+	r.id = rb.next_id;
+	rb.next_id = rb.next_id == 0xffFFffFF ? 1 : rb.next_id + 1;
+	r.fence_value = d3d->fence_value + 1;
+	r.mapped = false;
+	r.consumed = false;
+
+	u64 pos = (rb.head + align - 1) & ~(align - 1);
+	// allocations do not wrap around the end of the ring
+	if (pos % READBACK_RING_SIZE + size > READBACK_RING_SIZE) pos = (pos / READBACK_RING_SIZE + 1) * READBACK_RING_SIZE;
+	if (size <= READBACK_RING_SIZE && pos + size <= rb.tail + READBACK_RING_SIZE) {
+		r.resource = rb.ring;
+		r.offset = pos % READBACK_RING_SIZE;
+		r.ring_end = pos + size;
+		rb.head = pos + size;
+		return r;
+	}
+
+	// ring is full of readbacks which were not consumed yet, or the readback is too big
+	r.resource = createBuffer(d3d->device, nullptr, size, D3D12_HEAP_TYPE_READBACK);
+	d3d->memory_tracker.add(r.resource, ResourceCategory::READBACK, size, "readback");
+	r.offset = 0;
+	r.ring_end = 0;
+	return r;
+}
+
+ReadbackTicket readTextureAsync(TextureHandle handle, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h) {
+	checkThread();
+	ASSERT(handle);
+	Texture& texture = *handle;
+	ASSERT(mip < texture.mips);
+	ASSERT(x + w <= maximum(texture.w >> mip, 1u) && y + h <= maximum(texture.h >> mip, 1u));
+	ASSERT(!(texture.flags & (u32)TextureFlags::IS_3D));
+	// depth textures can be copied only as a whole
+	ASSERT(!isDepthFormat(texture.dxgi_format) || (x == 0 && y == 0 && w == maximum(texture.w >> mip, 1u) && h == maximum(texture.h >> mip, 1u)));
+	resolveUpload(texture);
+	resolveUpdates(texture);
+	markUsed(texture);
+
+	D3D12_RESOURCE_DESC desc = texture.resource->GetDesc();
+	const u32 subresource = D3D12CalcSubresource(mip, face, 0, desc.MipLevels, desc.DepthOrArraySize);
+	desc.Width = w;
+	desc.Height = h;
+	desc.DepthOrArraySize = 1;
+	desc.MipLevels = 1;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint;
+	UINT row_count;
+	UINT64 row_size;
+	UINT64 total_size;
+	d3d->device->GetCopyableFootprints(&desc, 0, 1, 0, &footprint, &row_count, &row_size, &total_size);
+
+	ReadbackRing::Readback& r = allocReadback(total_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
+	r.row_size = (u32)row_size;
+	r.row_pitch = footprint.Footprint.RowPitch;
+	r.row_count = row_count;
+	footprint.Offset = r.offset;
+
+	D3D12_TEXTURE_COPY_LOCATION dst = {};
+	dst.pResource = r.resource;
+	dst.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+	dst.PlacedFootprint = footprint;
+
+	D3D12_TEXTURE_COPY_LOCATION src = {};
+	src.pResource = texture.resource;
+	src.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+	src.SubresourceIndex = subresource;
+
+	const D3D12_BOX box = {x, y, 0, x + w, y + h, 1};
+	// GENERIC_READ includes COPY_SOURCE, only the copied subresource is transitioned
+	texture.endSplit(d3d->cmd_list);
+	const D3D12_RESOURCE_STATES old_state = texture.getState(subresource);
+	const bool transition = !(old_state & D3D12_RESOURCE_STATE_COPY_SOURCE);
+	if (transition) texture.setSubresourceState(d3d->cmd_list, subresource, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	flushBarriers();
+	d3d->cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, &box);
+	if (transition) texture.setSubresourceState(d3d->cmd_list, subresource, old_state);
+	return {r.id, r.fence_value};
+}
+
+ReadbackTicket readBufferAsync(BufferHandle handle, u32 offset, u32 size) {
+	checkThread();
+	ASSERT(handle);
+	Buffer& buffer = *handle;
+	ASSERT(offset + size <= buffer.size);
+	resolveUpload(buffer);
+	resolveUpdates(buffer);
+	markUsed(buffer);
+
+	ReadbackRing::Readback& r = allocReadback(size, 16);
+	r.row_size = size;
+	r.row_pitch = size;
+	r.row_count = 1;
+
+	// mappable buffers are in upload heap, they must stay in GENERIC_READ, which includes COPY_SOURCE
+	const D3D12_RESOURCE_STATES state = buffer.mega_range.mega ? buffer.mega_range.mega->state : buffer.state;
+	const bool transition = !(state & D3D12_RESOURCE_STATE_COPY_SOURCE);
+	const D3D12_RESOURCE_STATES old_state = transition ? buffer.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_SOURCE) : state;
+	flushBarriers();
+	d3d->cmd_list->CopyBufferRegion(r.resource, r.offset, buffer.resource, buffer.offset + offset, size);
+	if (transition) buffer.setState(d3d->cmd_list, old_state);
+	return {r.id, r.fence_value};
+}
+
+bool isReadbackReady(ReadbackTicket ticket) {
+	ASSERT(ticket.id);
+	return d3d->fence->GetCompletedValue() >= ticket.fence_value;
+}
+
+static ReadbackRing::Readback* findReadback(ReadbackTicket ticket) {
+	for (ReadbackRing::Readback& r : d3d->readback.pending) {
+		if (r.id == ticket.id && !r.consumed) return &r;
+	}
+	return nullptr;
+}
+
+bool mapReadback(ReadbackTicket ticket, Ref<ReadbackData> data) {
+	checkThread();
+	ReadbackRing& rb = d3d->readback;
+	ReadbackRing::Readback* r = findReadback(ticket);
+	if (!r) {
+		ASSERT(false);
+		return false;
+	}
+	ASSERT(!r->mapped);
+	if (r->fence_value > d3d->fence_value) {
+		logError("Readback can not be waited for in the frame which issued it");
+		return false;
+	}
+	if (d3d->fence->GetCompletedValue() < r->fence_value) {
+		d3d->fence->SetEventOnCompletion(r->fence_value, nullptr);
+	}
+
+	u8* ptr = rb.ring_ptr + r->offset;
+	if (r->resource != rb.ring) {
+		const D3D12_RANGE range = {0, SIZE_T(r->row_pitch) * r->row_count};
+		const HRESULT hr = r->resource->Map(0, &range, (void**)&ptr);
+		ASSERT(hr == S_OK);
+	}
+	r->mapped = true;
+	data->data = ptr;
+	data->row_size = r->row_size;
+	data->row_pitch = r->row_pitch;
+	data->row_count = r->row_count;
+	return true;
+}
+
+void unmapReadback(ReadbackTicket ticket) {
+	checkThread();
+	ReadbackRing& rb = d3d->readback;
+	ReadbackRing::Readback* r = findReadback(ticket);
+	ASSERT(r && r->mapped);
+	if (!r) return;
+
+	if (r->resource != rb.ring) {
+		const D3D12_RANGE written = {};
+		r->resource->Unmap(0, &written);
+		// GPU is done with it
+		d3d->memory_tracker.remove(r->resource);
+		r->resource->Release();
+	}
+	r->consumed = true;
+
+	while (!rb.pending.empty() && rb.pending[0].consumed) {
+		if (rb.pending[0].ring_end) rb.tail = rb.pending[0].ring_end;
+		rb.pending.erase(0);
+	}
+	// idle ring starts over, otherwise a readback which does not fit before the end of the ring
+	// would not fit after the wrap either and would get a dedicated buffer
+	if (rb.pending.empty()) {
+		rb.head = 0;
+		rb.tail = 0;
+	}
+}
+
+void unpackReadback(const ReadbackData& data, Span<u8> out) {
+	ASSERT(out.length() == u64(data.row_size) * data.row_count);
+	unpackReadbackRows(out.begin(), data.data, data.row_size, data.row_pitch, data.row_count);
+}
+
+bool getReadbackData(ReadbackTicket ticket, Span<u8> out) {
+	ReadbackData data;
+	if (!mapReadback(ticket, Ref(data))) return false;
+	unpackReadback(data, out);
+	unmapReadback(ticket);
+	return true;
+}
+
+// executes commands recorded so far and waits for the GPU, recording then continues in the same frame
+// vertex buffers are not tracked, they must be bound again
+static void submitAndWait() {
+	d3d->pso_cache.last = nullptr;
+	flushUpdates();
+	if (d3d->residency_waited_value != d3d->residency_fence_value) {
+		d3d->cmd_queue->Wait(d3d->residency_fence, d3d->residency_fence_value);
+		d3d->residency_waited_value = d3d->residency_fence_value;
+	}
+	endSplitTransitions();
+	flushBarriers();
+	HRESULT hr = d3d->cmd_list->Close();
+	ASSERT(hr == S_OK);
+	d3d->cmd_queue->ExecuteCommandLists(1, (ID3D12CommandList* const*)&d3d->cmd_list);
+	++d3d->fence_value;
+	hr = d3d->cmd_queue->Signal(d3d->fence, d3d->fence_value);
+	ASSERT(hr == S_OK);
+	d3d->fence->SetEventOnCompletion(d3d->fence_value, nullptr);
+
+	// GPU is idle, so the allocator can be reused
+	d3d->frame->cmd_allocator->Reset();
+	d3d->cmd_list->Reset(d3d->frame->cmd_allocator, nullptr);
+	d3d->graphics_root = {};
+	d3d->compute_root = {};
+	ID3D12DescriptorHeap* heaps[] = {d3d->srv_heap.heap, d3d->sampler_heap.heap};
+	d3d->cmd_list->SetDescriptorHeaps(lengthOf(heaps), heaps);
+	d3d->cmd_list->OMSetStencilRef(u8(d3d->current_state >> 34));
+	const FrameBuffer& fb = d3d->current_framebuffer;
+	if (fb.count > 0 || fb.depth_stencil.ptr) {
+		d3d->cmd_list->OMSetRenderTargets(fb.count, fb.render_targets, FALSE, fb.depth_stencil.ptr ? &fb.depth_stencil : nullptr);
+	}
+	d3d->cmd_list->RSSetViewports(1, &d3d->current_viewport);
+	d3d->cmd_list->RSSetScissorRects(1, &d3d->current_scissor);
+}
+
+// blocking, all faces of `mip` are written to `buf` one after another
 void readTexture(TextureHandle handle, u32 mip, Span<u8> buf) {
-	// Texture& texture = d3d->textures[handle.value];
-	//
-	// D3D11_MAPPED_SUBRESOURCE data;
-	//
-	// const u32 faces = (texture.flags & (u32)TextureFlags::IS_CUBE) ? 6 : 1;
-	// const bool no_mips = texture.flags & (u32)TextureFlags::NO_MIPS;
-	// const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(texture.w,
-	// texture.h)); u8* ptr = buf.begin();
-	//
-	// for (u32 face = 0; face < faces; ++face) {
-	//	const UINT subres = D3D11CalcSubresource(mip, face, mip_count);
-	//	d3d->device_ctx->Map(texture.texture2D, subres, D3D11_MAP_READ, 0,
-	//&data); 	ASSERT(data.DepthPitch == buf.length() / faces); 	memcpy(ptr,
-	// data.pData, data.DepthPitch); 	ptr += data.DepthPitch;
-	//	d3d->device_ctx->Unmap(texture.texture2D, subres);
-	//}
-	ASSERT(false); // TODO
+	checkThread();
+	ASSERT(handle);
+	Texture& texture = *handle;
+	const u32 faces = texture.flags & (u32)TextureFlags::IS_CUBE ? 6 : 1;
+	const u32 w = maximum(texture.w >> mip, 1u);
+	const u32 h = maximum(texture.h >> mip, 1u);
+	ReadbackTicket tickets[6];
+	for (u32 face = 0; face < faces; ++face) {
+		tickets[face] = readTextureAsync(handle, mip, face, 0, 0, w, h);
+	}
+	submitAndWait();
+	const u32 face_size = u32(buf.length() / faces);
+	for (u32 face = 0; face < faces; ++face) {
+		getReadbackData(tickets[face], Span(buf.begin() + face * face_size, face_size));
+	}
+}
+
+static void releaseReadbacks() {
+	ReadbackRing& rb = d3d->readback;
+	for (const ReadbackRing::Readback& r : rb.pending) {
+		if (r.consumed || r.resource == rb.ring) continue;
+		d3d->memory_tracker.remove(r.resource);
+		r.resource->Release();
+	}
+	rb.pending.clear();
+	if (rb.ring) {
+		d3d->memory_tracker.remove(rb.ring);
+		rb.ring->Unmap(0, nullptr);
+		rb.ring->Release();
+		rb.ring = nullptr;
+	}
 }
 
 void queryTimestamp(QueryHandle query) {
@@ -1270,23 +2905,59 @@ void preinit(IAllocator& allocator, bool load_renderdoc) {
 	d3d->frame = d3d->frames.begin();
 }
 
+static void releaseTransientTextures();
+static void updateTransientPool();
+static void updateBufferPromotion();
+static void destroyDeferred();
+
 void shutdown() {
+	destroyDeferred();
 	d3d->shader_compiler.save(".shader_cache_dx");
 	ShFinalize();
 
+	releaseTransientTextures();
+	d3d->render_target_pool.clear();
+	d3d->copy_queue.shutdown();
 	for (Frame& frame : d3d->frames) {
 		frame.clear();
 	}
 	d3d->frames.clear();
+	for (ScratchPage* page : d3d->free_scratch_pages) destroyScratchPage(page);
+	d3d->free_scratch_pages.clear();
+	for (MegaBuffer* mega : d3d->mega_buffers) {
+		d3d->memory_tracker.remove(mega->resource);
+		d3d->residency.remove(mega->residency);
+		mega->resource->Release();
+		freeMemory(mega->allocation);
+		LUMIX_DELETE(d3d->allocator, mega);
+	}
+	d3d->mega_buffers.clear();
+	releaseReadbacks();
+	d3d->memory_tracker.logLeaks(16);
+	for (MemoryBlock* block : d3d->memory_blocks) {
+		block->heap->Release();
+		LUMIX_DELETE(d3d->allocator, block);
+	}
+	d3d->memory_blocks.clear();
 
 	for (D3D::Window& w : d3d->windows) {
 		if (!w.handle) continue;
 		w.swapchain->Release();
 	}
 	
-	d3d->root_signature->Release();
+	for (const CachedRootSignature& cached : d3d->root_signatures) {
+		cached.signature->Release();
+	}
+	for (const CachedRootSignature& cached : d3d->colliding_root_signatures) {
+		cached.signature->Release();
+	}
+	if (d3d->mip_generator.pso) d3d->mip_generator.pso->Release();
+	if (d3d->mip_generator.root_signature) d3d->mip_generator.root_signature->Release();
+	if (d3d->adapter) d3d->adapter->Release();
+	if (d3d->device3) d3d->device3->Release();
 	d3d->query_heap->Release();
 	d3d->fence->Release();
+	d3d->residency_fence->Release();
 	d3d->cmd_queue->Release();
 	d3d->cmd_list->Release();
 	if(d3d->debug) d3d->debug->Release();
@@ -1305,59 +2976,71 @@ void shutdown() {
 	d3d.destroy();
 }
 
-ID3D12RootSignature* createRootSignature() {
-	constexpr u32 MAX_SAMPLERS = 32;
-	constexpr u32 MAX_CBV = 16;
-	D3D12_DESCRIPTOR_RANGE descRange[] = {
-		{D3D12_DESCRIPTOR_RANGE_TYPE_CBV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND},
-		{D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, MAX_SAMPLERS, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND},
-		{D3D12_DESCRIPTOR_RANGE_TYPE_SRV, MAX_SAMPLERS, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND},
-		{D3D12_DESCRIPTOR_RANGE_TYPE_UAV, MAX_SAMPLERS, 0, 0, D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND},
-		//{ D3D12_DESCRIPTOR_RANGE_TYPE_CBV,     MAX_CBV, 1, 0,
-		// D3D12_DESCRIPTOR_RANGE_OFFSET_APPEND },
-	};
+static D3D12_SHADER_VISIBILITY getVisibility(u32 stages) {
+	switch (stages) {
+		case 1 << Program::VERTEX: return D3D12_SHADER_VISIBILITY_VERTEX;
+		case 1 << Program::FRAGMENT: return D3D12_SHADER_VISIBILITY_PIXEL;
+		case 1 << Program::GEOMETRY: return D3D12_SHADER_VISIBILITY_GEOMETRY;
+		default: return D3D12_SHADER_VISIBILITY_ALL;
+	}
+}
 
-	D3D12_ROOT_PARAMETER rootParameter[] = {
-		{D3D12_ROOT_PARAMETER_TYPE_CBV, {{0, 0}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_CBV, {{0, 0}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_CBV, {{0, 0}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_CBV, {{0, 0}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_CBV, {{0, 0}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, {{1, &descRange[1]}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, {{1, &descRange[2]}}, D3D12_SHADER_VISIBILITY_ALL},
-		{D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, {{1, &descRange[3]}}, D3D12_SHADER_VISIBILITY_ALL},
-		//{ D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE, { { 1, &descRange[4] }
-		//}, D3D12_SHADER_VISIBILITY_ALL },
-	};
-	rootParameter[0].Descriptor.RegisterSpace = 0;
-	rootParameter[0].Descriptor.ShaderRegister = 0;
-	rootParameter[1].Descriptor.RegisterSpace = 0;
-	rootParameter[1].Descriptor.ShaderRegister = 1;
-	rootParameter[2].Descriptor.RegisterSpace = 0;
-	rootParameter[2].Descriptor.ShaderRegister = 2;
-	rootParameter[3].Descriptor.RegisterSpace = 0;
-	rootParameter[3].Descriptor.ShaderRegister = 3;
-	rootParameter[4].Descriptor.RegisterSpace = 0;
-	rootParameter[4].Descriptor.ShaderRegister = 4;
-
-	D3D12_ROOT_SIGNATURE_DESC desc;
-	desc.NumParameters = lengthOf(rootParameter);
-	desc.pParameters = rootParameter;
-	desc.NumStaticSamplers = 0;
-	desc.pStaticSamplers = nullptr; //&staticSampler;
-	desc.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT;
-
-#define DECL_D3D_API(f) auto api_##f = (decltype(f)*)GetProcAddress(d3d->d3d_dll, #f);
+static ID3D12RootSignature* serializeRootSignature(const D3D12_VERSIONED_ROOT_SIGNATURE_DESC& desc) {
+	#define DECL_D3D_API(f) auto api_##f = (decltype(f)*)GetProcAddress(d3d->d3d_dll, #f);
 
+	DECL_D3D_API(D3D12SerializeVersionedRootSignature);
 	DECL_D3D_API(D3D12SerializeRootSignature);
+	#undef DECL_D3D_API
 
 	ID3DBlob* blob = NULL;
 	ID3DBlob* error = NULL;
 
-	HRESULT hr = api_D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &blob, &error);
+	HRESULT hr;
+	if (d3d->root_signature_version == D3D_ROOT_SIGNATURE_VERSION_1_1 && api_D3D12SerializeVersionedRootSignature) {
+		hr = api_D3D12SerializeVersionedRootSignature(&desc, &blob, &error);
+	}
+	else {
+		const D3D12_ROOT_SIGNATURE_DESC1& desc1 = desc.Desc_1_1;
+		D3D12_DESCRIPTOR_RANGE ranges[3];
+		D3D12_ROOT_PARAMETER params[MAX_CBVS + 4];
+		ASSERT(desc1.NumParameters <= lengthOf(params));
+		u32 range_count = 0;
+		for (u32 i = 0; i < desc1.NumParameters; ++i) {
+			const D3D12_ROOT_PARAMETER1& src = desc1.pParameters[i];
+			params[i].ParameterType = src.ParameterType;
+			params[i].ShaderVisibility = src.ShaderVisibility;
+			if (src.ParameterType == D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE) {
+				ASSERT(src.DescriptorTable.NumDescriptorRanges == 1);
+				const D3D12_DESCRIPTOR_RANGE1& src_range = src.DescriptorTable.pDescriptorRanges[0];
+				D3D12_DESCRIPTOR_RANGE& range = ranges[range_count];
+				++range_count;
+				range.RangeType = src_range.RangeType;
+				range.NumDescriptors = src_range.NumDescriptors;
+				range.BaseShaderRegister = src_range.BaseShaderRegister;
+				range.RegisterSpace = src_range.RegisterSpace;
+				range.OffsetInDescriptorsFromTableStart = src_range.OffsetInDescriptorsFromTableStart;
+				params[i].DescriptorTable.NumDescriptorRanges = 1;
+				params[i].DescriptorTable.pDescriptorRanges = &range;
+			}
+			else if (src.ParameterType == D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS) {
+				params[i].Constants = src.Constants;
+			}
+			else {
+				params[i].Descriptor.ShaderRegister = src.Descriptor.ShaderRegister;
+				params[i].Descriptor.RegisterSpace = src.Descriptor.RegisterSpace;
+			}
+		}
+		D3D12_ROOT_SIGNATURE_DESC desc0;
+		desc0.NumParameters = desc1.NumParameters;
+		desc0.pParameters = params;
+		desc0.NumStaticSamplers = 0;
+		desc0.pStaticSamplers = nullptr;
+		desc0.Flags = desc1.Flags;
+		hr = api_D3D12SerializeRootSignature(&desc0, D3D_ROOT_SIGNATURE_VERSION_1, &blob, &error);
+	}
 	if (error) {
-		const char* msg = (const char*)error->GetBufferPointer();
-		ASSERT(false);
+		logError("gpu: ", (const char*)error->GetBufferPointer());
+		error->Release();
 	}
 	if (hr != S_OK) return nullptr;
 
@@ -1370,6 +3053,379 @@ ID3D12RootSignature* createRootSignature() {
 	return res;
 }
 
+static const char* MIP_GENERATOR_SRC = R"(
+cbuffer Constants : register(b0) {
+	uint2 src_size;
+	uint num_mips;
+	uint is_srgb;
+};
+
+RWTexture2DArray<float4> src : register(u0);
+RWTexture2DArray<float4> dst0 : register(u1);
+RWTexture2DArray<float4> dst1 : register(u2);
+RWTexture2DArray<float4> dst2 : register(u3);
+RWTexture2DArray<float4> dst3 : register(u4);
+
+groupshared float4 tile[64];
+
+float4 decode(float4 c) {
+	if (!is_srgb) return c;
+	float3 lo = c.rgb / 12.92;
+	float3 hi = pow((c.rgb + 0.055) / 1.055, 2.4);
+	return float4(c.rgb <= 0.04045 ? lo : hi, c.a);
+}
+
+float4 encode(float4 c) {
+	if (!is_srgb) return c;
+	float3 lo = c.rgb * 12.92;
+	float3 hi = 1.055 * pow(abs(c.rgb), 1.0 / 2.4) - 0.055;
+	return float4(c.rgb <= 0.0031308 ? lo : hi, c.a);
+}
+
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint gi : SV_GroupIndex) {
+	uint2 dst_size = max(src_size >> 1, 1);
+	// threads outside of the mip replicate its edge, so they do not skew the reduction
+	int2 p = min(id.xy, dst_size - 1);
+	// odd sizes use 3 taps, so no source texel is skipped
+	float3 wx = (src_size.x & 1) != 0 ? float3(0.25, 0.5, 0.25) : float3(0.5, 0.5, 0);
+	float3 wy = (src_size.y & 1) != 0 ? float3(0.25, 0.5, 0.25) : float3(0.5, 0.5, 0);
+	float4 c = 0;
+	[unroll] for (int y = 0; y < 3; ++y) {
+		[unroll] for (int x = 0; x < 3; ++x) {
+			float w = wx[x] * wy[y];
+			if (w > 0) c += w * decode(src[uint3(min(p * 2 + int2(x, y), int2(src_size) - 1), id.z)]);
+		}
+	}
+	bool inside = all(id.xy < dst_size);
+	if (inside) dst0[id] = encode(c);
+	if (num_mips == 1) return;
+
+	tile[gi] = c;
+	GroupMemoryBarrierWithGroupSync();
+	if ((gi & 0x9) == 0) {
+		c = 0.25 * (c + tile[gi + 1] + tile[gi + 8] + tile[gi + 9]);
+		tile[gi] = c;
+		if (inside) dst1[uint3(id.xy >> 1, id.z)] = encode(c);
+	}
+	if (num_mips == 2) return;
+
+	GroupMemoryBarrierWithGroupSync();
+	if ((gi & 0x1B) == 0) {
+		c = 0.25 * (c + tile[gi + 2] + tile[gi + 16] + tile[gi + 18]);
+		tile[gi] = c;
+		if (inside) dst2[uint3(id.xy >> 2, id.z)] = encode(c);
+	}
+	if (num_mips == 3) return;
+
+	GroupMemoryBarrierWithGroupSync();
+	if (gi == 0) {
+		c = 0.25 * (c + tile[4] + tile[32] + tile[36]);
+		if (inside) dst3[uint3(id.xy >> 3, id.z)] = encode(c);
+	}
+}
+)";
+
+static bool initMipGenerator() {
+	D3D::MipGenerator& gen = d3d->mip_generator;
+	if (gen.pso) return true;
+	if (gen.failed) return false;
+	gen.failed = true;
+
+	ID3DBlob* blob = nullptr;
+	ID3DBlob* errors = nullptr;
+	HRESULT hr = D3DCompile(MIP_GENERATOR_SRC, strlen(MIP_GENERATOR_SRC), "mip_generator", nullptr, nullptr, "main", "cs_5_0", D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &blob, &errors);
+	if (errors) {
+		if (FAILED(hr)) logError("gpu: ", (LPCSTR)errors->GetBufferPointer());
+		errors->Release();
+	}
+	if (FAILED(hr)) return false;
+
+	D3D12_DESCRIPTOR_RANGE1 range = {};
+	range.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV;
+	range.NumDescriptors = 5;
+	range.BaseShaderRegister = 0;
+	range.RegisterSpace = 0;
+	range.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE;
+	range.OffsetInDescriptorsFromTableStart = 0;
+
+	D3D12_ROOT_PARAMETER1 params[2] = {};
+	params[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+	params[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+	params[0].Constants.ShaderRegister = 0;
+	params[0].Constants.RegisterSpace = 0;
+	params[0].Constants.Num32BitValues = 4;
+	params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+	params[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+	params[1].DescriptorTable.NumDescriptorRanges = 1;
+	params[1].DescriptorTable.pDescriptorRanges = &range;
+
+	D3D12_VERSIONED_ROOT_SIGNATURE_DESC desc = {};
+	desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+	desc.Desc_1_1.NumParameters = lengthOf(params);
+	desc.Desc_1_1.pParameters = params;
+	desc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+	gen.root_signature = serializeRootSignature(desc);
+	if (!gen.root_signature) {
+		blob->Release();
+		return false;
+	}
+
+	D3D12_COMPUTE_PIPELINE_STATE_DESC pso_desc = {};
+	pso_desc.pRootSignature = gen.root_signature;
+	pso_desc.CS.pShaderBytecode = blob->GetBufferPointer();
+	pso_desc.CS.BytecodeLength = blob->GetBufferSize();
+	pso_desc.NodeMask = 1;
+	hr = d3d->device->CreateComputePipelineState(&pso_desc, IID_PPV_ARGS(&gen.pso));
+	blob->Release();
+	if (hr != S_OK) return false;
+	trackPipeline(gen.pso, pso_desc.CS.BytecodeLength);
+
+	gen.failed = false;
+	return true;
+}
+
+static void uavBarrier(ID3D12Resource* resource) {
+	D3D12_RESOURCE_BARRIER barrier = {};
+	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+	barrier.UAV.pResource = resource;
+	queueBarrier(d3d->cmd_list, barrier);
+}
+
+static bool supportsTypedUAVLoadStore(DXGI_FORMAT format) {
+	D3D12_FEATURE_DATA_FORMAT_SUPPORT support = {};
+	support.Format = toUAVFormat(format);
+	if (FAILED(d3d->device->CheckFeatureSupport(D3D12_FEATURE_FORMAT_SUPPORT, &support, sizeof(support)))) return false;
+	const D3D12_FORMAT_SUPPORT2 required = D3D12_FORMAT_SUPPORT2_UAV_TYPED_LOAD | D3D12_FORMAT_SUPPORT2_UAV_TYPED_STORE;
+	return (support.Support2 & required) == required;
+}
+
+// the texture must be created with TextureFlags::COMPUTE_WRITE, mips are written through UAVs
+// up to 4 mips per dispatch, whole mip chain is in UNORDERED_ACCESS state, so there are only UAV barriers between dispatches
+void generateMipmaps(TextureHandle handle) {
+	ASSERT(handle);
+	Texture& texture = *handle;
+	resolveUpload(texture);
+	resolveUpdates(texture);
+	if (texture.mips < 2) return;
+	markUsed(texture);
+
+	const D3D12_RESOURCE_DESC desc = texture.resource->GetDesc();
+	const bool compute_write = texture.flags & (u32)TextureFlags::COMPUTE_WRITE;
+	if (!compute_write || desc.Dimension != D3D12_RESOURCE_DIMENSION_TEXTURE2D || isDepthFormat(desc.Format) || !supportsTypedUAVLoadStore(desc.Format)) {
+		#ifdef LUMIX_DEBUG
+			logError("gpu: can not generate mipmaps for ", texture.name);
+		#else
+			logError("gpu: can not generate mipmaps for this texture");
+		#endif
+		return;
+	}
+	if (!initMipGenerator()) return;
+
+	if (texture.mip_uavs.empty()) {
+		texture.mip_uavs.resize(texture.mips);
+		for (u32 mip = 0; mip < texture.mips; mip += 2) {
+			D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc[2] = {};
+			for (u32 i = 0; i < 2; ++i) {
+				uav_desc[i].Format = toUAVFormat(texture.dxgi_format);
+				uav_desc[i].ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2DARRAY;
+				uav_desc[i].Texture2DArray.MipSlice = mip + i;
+				uav_desc[i].Texture2DArray.FirstArraySlice = 0;
+				uav_desc[i].Texture2DArray.ArraySize = desc.DepthOrArraySize;
+				uav_desc[i].Texture2DArray.PlaneSlice = 0;
+			}
+			const bool has_second = mip + 1 < texture.mips;
+			const u32 id = d3d->srv_heap.allocUAVs(d3d->device, texture.resource, uav_desc[0], has_second ? &uav_desc[1] : nullptr);
+			texture.mip_uavs[mip] = id;
+			if (has_second) texture.mip_uavs[mip + 1] = id + 1;
+		}
+	}
+
+	ID3D12GraphicsCommandList* cmd_list = d3d->cmd_list;
+	TextureStates old_states(d3d->allocator);
+	texture.setState(cmd_list, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, old_states);
+	cmd_list->SetComputeRootSignature(d3d->mip_generator.root_signature);
+	cmd_list->SetPipelineState(d3d->mip_generator.pso);
+
+	const bool is_srgb = texture.dxgi_format == DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	u32 src_mip = 0;
+	while (src_mip + 1 < texture.mips) {
+		const u32 src_w = maximum(texture.w >> src_mip, 1u);
+		const u32 src_h = maximum(texture.h >> src_mip, 1u);
+		const u32 dst_w = maximum(src_w >> 1, 1u);
+		const u32 dst_h = maximum(src_h >> 1, 1u);
+
+		// mips after the first one are reduced in groupshared memory, so the first one must be divisible by 2^(num_mips - 1)
+		const u32 size_bits = (dst_w == 1 ? dst_h : dst_w) | (dst_h == 1 ? dst_w : dst_h);
+		u32 num_mips = 1;
+		while (num_mips < 4 && src_mip + num_mips + 1 < texture.mips && (size_bits & (1 << (num_mips - 1))) == 0) ++num_mips;
+
+		const D3D12_GPU_DESCRIPTOR_HANDLE table = d3d->srv_heap.getGPU();
+		d3d->srv_heap.copy(d3d->device, texture.mip_uavs[src_mip]);
+		for (u32 i = 0; i < 4; ++i) {
+			// unused descriptors are not accessed, but they must be valid
+			d3d->srv_heap.copy(d3d->device, texture.mip_uavs[src_mip + 1 + minimum(i, num_mips - 1)]);
+		}
+
+		const u32 constants[] = { src_w, src_h, num_mips, is_srgb ? 1u : 0u };
+		cmd_list->SetComputeRoot32BitConstants(0, lengthOf(constants), constants, 0);
+		cmd_list->SetComputeRootDescriptorTable(1, table);
+		flushBarriers();
+		cmd_list->Dispatch((dst_w + 7) / 8, (dst_h + 7) / 8, desc.DepthOrArraySize);
+
+		src_mip += num_mips;
+		if (src_mip + 1 < texture.mips) uavBarrier(texture.resource);
+	}
+
+	texture.restoreStates(cmd_list, old_states);
+	// subresources which stay in UNORDERED_ACCESS are not transitioned
+	if (old_states.any(D3D12_RESOURCE_STATE_UNORDERED_ACCESS)) uavBarrier(texture.resource);
+
+	d3d->compute_root = {};
+	d3d->pso_cache.last = nullptr;
+}
+
+static bool createRootSignature(Program& program) {
+	const bool is_compute = program.cs.size() > 0;
+
+	RootSignatureLayout layout;
+	memset(&layout, 0, sizeof(layout));
+	u32 srv_stages = 0;
+	u32 uav_stages = 0;
+	u32 draw_constants_stages = 0;
+	u32 draw_constants_size = 0;
+	for (u32 stage = 0; stage < Program::COUNT; ++stage) {
+		const Program::Reflection& r = program.reflection[stage];
+		if (r.draw_constants_size) {
+			draw_constants_stages |= 1 << stage;
+			draw_constants_size = maximum(draw_constants_size, r.draw_constants_size);
+		}
+		for (u32 i = 0; i < MAX_CBVS; ++i) {
+			if (r.cbvs & (1 << i)) layout.cbv_visibility[i] |= 1 << stage;
+		}
+		if (r.used_srvs) srv_stages |= 1 << stage;
+		if (r.used_srvs & ~r.readonly) uav_stages |= 1 << stage;
+	}
+
+	for (u32 i = 0; i < MAX_SRVS; ++i) {
+		if (program.used_srvs_flags & (1 << i)) layout.srv_count = i + 1;
+	}
+	ASSERT((program.used_srvs_flags >> MAX_SRVS) == 0);
+	
+	for (u8& v : layout.cbv_visibility) {
+		if (v) v = 1 + (is_compute ? D3D12_SHADER_VISIBILITY_ALL : getVisibility(v));
+	}
+	if (srv_stages) layout.srv_visibility = 1 + (is_compute ? D3D12_SHADER_VISIBILITY_ALL : getVisibility(srv_stages));
+	if (uav_stages) layout.uav_visibility = 1 + (is_compute ? D3D12_SHADER_VISIBILITY_ALL : getVisibility(uav_stages));
+	if (draw_constants_stages) layout.draw_constants_visibility = 1 + (is_compute ? D3D12_SHADER_VISIBILITY_ALL : getVisibility(draw_constants_stages));
+	layout.draw_constants_count = u8((draw_constants_size + 3) / 4);
+	layout.flags = (is_compute ? 1 : 0) | (program.gs.size() > 0 ? 2 : 0);
+
+	program.srv_count = layout.srv_count;
+	program.sampler_param = INVALID_ROOT_PARAM;
+	program.srv_param = INVALID_ROOT_PARAM;
+	program.uav_param = INVALID_ROOT_PARAM;
+	program.draw_constants_param = INVALID_ROOT_PARAM;
+	program.draw_constants_count = layout.draw_constants_count;
+
+	D3D12_DESCRIPTOR_RANGE1 ranges[3] = {};
+	D3D12_ROOT_PARAMETER1 params[MAX_CBVS + 4] = {};
+	u32 param_count = 0;
+
+	// root constants go first, they are changed most often
+	if (layout.draw_constants_visibility) {
+		D3D12_ROOT_PARAMETER1& param = params[param_count];
+		param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+		param.ShaderVisibility = D3D12_SHADER_VISIBILITY(layout.draw_constants_visibility - 1);
+		param.Constants.ShaderRegister = DRAW_CONSTANTS_BINDING;
+		param.Constants.RegisterSpace = 0;
+		param.Constants.Num32BitValues = layout.draw_constants_count;
+		program.draw_constants_param = param_count;
+		++param_count;
+	}
+	for (u32 i = 0; i < MAX_CBVS; ++i) {
+		program.cbv_params[i] = INVALID_ROOT_PARAM;
+		if (!layout.cbv_visibility[i]) continue;
+
+		D3D12_ROOT_PARAMETER1& param = params[param_count];
+		param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+		param.ShaderVisibility = D3D12_SHADER_VISIBILITY(layout.cbv_visibility[i] - 1);
+		param.Descriptor.ShaderRegister = i;
+		param.Descriptor.RegisterSpace = 0;
+		// uniform buffers are updated with copies while they are bound
+		param.Descriptor.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_DATA_VOLATILE;
+		program.cbv_params[i] = param_count;
+		++param_count;
+	}
+
+	u32 range_count = 0;
+	auto add_range = [&](D3D12_DESCRIPTOR_RANGE_TYPE type, D3D12_DESCRIPTOR_RANGE_FLAGS flags, u8 visibility) -> u8 {
+		D3D12_DESCRIPTOR_RANGE1& range = ranges[range_count];
+		++range_count;
+		range.RangeType = type;
+		range.NumDescriptors = layout.srv_count;
+		range.BaseShaderRegister = 0;
+		range.RegisterSpace = 0;
+		range.Flags = flags;
+		range.OffsetInDescriptorsFromTableStart = 0;
+
+		D3D12_ROOT_PARAMETER1& param = params[param_count];
+		param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
+		param.ShaderVisibility = D3D12_SHADER_VISIBILITY(visibility - 1);
+		param.DescriptorTable.NumDescriptorRanges = 1;
+		param.DescriptorTable.pDescriptorRanges = &range;
+		++param_count;
+		return u8(param_count - 1);
+	};
+
+	if (layout.srv_visibility) {
+		program.sampler_param = add_range(D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, D3D12_DESCRIPTOR_RANGE_FLAG_NONE, layout.srv_visibility);
+		program.srv_param = add_range(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC_WHILE_SET_AT_EXECUTE, layout.srv_visibility);
+	}
+	if (layout.uav_visibility) {
+		program.uav_param = add_range(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE, layout.uav_visibility);
+	}
+
+	const u32 hash = crc32(&layout, sizeof(layout));
+	auto iter = d3d->root_signatures.find(hash);
+	const bool collision = iter.isValid() && memcmp(&iter.value().layout, &layout, sizeof(layout)) != 0;
+	if (iter.isValid() && !collision) {
+		program.root_signature = iter.value().signature;
+		return true;
+	}
+	if (collision) {
+		for (const CachedRootSignature& cached : d3d->colliding_root_signatures) {
+			if (memcmp(&cached.layout, &layout, sizeof(layout)) != 0) continue;
+			program.root_signature = cached.signature;
+			return true;
+		}
+	}
+
+	D3D12_VERSIONED_ROOT_SIGNATURE_DESC desc = {};
+	desc.Version = D3D_ROOT_SIGNATURE_VERSION_1_1;
+	desc.Desc_1_1.NumParameters = param_count;
+	desc.Desc_1_1.pParameters = params;
+	desc.Desc_1_1.NumStaticSamplers = 0;
+	desc.Desc_1_1.pStaticSamplers = nullptr;
+	if (is_compute) {
+		desc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_NONE;
+	}
+	else {
+		desc.Desc_1_1.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT
+			| D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS
+			| D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS;
+		if (program.gs.size() == 0) desc.Desc_1_1.Flags |= D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
+	}
+
+	program.root_signature = serializeRootSignature(desc);
+	if (!program.root_signature) return false;
+	const CachedRootSignature cached = {layout, program.root_signature};
+	if (collision) d3d->colliding_root_signatures.push(cached);
+	else d3d->root_signatures.insert(hash, cached);
+	return true;
+}
+
 static bool createSwapchain(HWND hwnd, Ref<D3D::Window> window) {
 	DXGI_SWAP_CHAIN_DESC1 sd = {};
 	sd.BufferCount = NUM_BACKBUFFERS;
@@ -1401,6 +3457,8 @@ static bool createSwapchain(HWND hwnd, Ref<D3D::Window> window) {
 		if (window->swapchain->GetBuffer(i, IID_PPV_ARGS(&backbuffer)) != S_OK) return false;
 		backbuffer->SetName(L"window_rb");
 		window->backbuffers[i] = backbuffer;
+		if (window->rtvs[i] == INVALID_HEAP_ID) window->rtvs[i] = d3d->rtv_heap.alloc();
+		d3d->device->CreateRenderTargetView(backbuffer, nullptr, d3d->rtv_heap.getCPU(window->rtvs[i]));
 	}
 
 	const UINT current_bb_idx = window->swapchain->GetCurrentBackBufferIndex();
@@ -1441,6 +3499,7 @@ bool init(void* hwnd, u32 flags) {
 
 	DECL_D3D_API(D3D12CreateDevice);
 	DECL_D3D_API(D3D12GetDebugInterface);
+	#undef DECL_D3D_API
 
 	if (debug) {
 		if (api_D3D12GetDebugInterface(IID_PPV_ARGS(&d3d->debug)) != S_OK) return false;
@@ -1484,8 +3543,12 @@ bool init(void* hwnd, u32 flags) {
 		}
 	}
 
-	d3d->root_signature = createRootSignature();
-	ASSERT(d3d->root_signature);
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE root_signature_feature = {};
+	root_signature_feature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
+	if (FAILED(d3d->device->CheckFeatureSupport(D3D12_FEATURE_ROOT_SIGNATURE, &root_signature_feature, sizeof(root_signature_feature)))) {
+		root_signature_feature.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_0;
+	}
+	d3d->root_signature_version = root_signature_feature.HighestVersion;
 
 	D3D12_COMMAND_QUEUE_DESC desc = {};
 	desc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
@@ -1493,17 +3556,35 @@ bool init(void* hwnd, u32 flags) {
 	desc.NodeMask = 1;
 
 	if (d3d->device->CreateCommandQueue(&desc, IID_PPV_ARGS(&d3d->cmd_queue)) != S_OK) return false;
+	if (!d3d->copy_queue.init(d3d->device)) return false;
+	d3d->memory_tracker.add(d3d->copy_queue.ring, ResourceCategory::UPLOAD, UPLOAD_RING_SIZE, "copy_ring");
 
 	if (!d3d->srv_heap.init(d3d->device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV, MAX_DESCRIPTORS, 16384)) return false;
 	if (!d3d->sampler_heap.init(d3d->device, 2048)) return false;
-	if (!d3d->rtv_heap.init(d3d->device, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, 1024, 0)) return false;
-	if (!d3d->ds_heap.init(d3d->device, D3D12_DESCRIPTOR_HEAP_TYPE_DSV, 256, 0)) return false;
+	if (!d3d->rtv_heap.init(d3d->device, D3D12_DESCRIPTOR_HEAP_TYPE_RTV, 4096)) return false;
+	if (!d3d->ds_heap.init(d3d->device, D3D12_DESCRIPTOR_HEAP_TYPE_DSV, 1024)) return false;
+	trackDescriptorHeap(d3d->srv_heap.heap, "srv_heap");
+	trackDescriptorHeap(d3d->srv_heap.backing_heap, "srv_backing_heap");
+	trackDescriptorHeap(d3d->sampler_heap.heap, "sampler_heap");
+	trackDescriptorHeap(d3d->rtv_heap.heap, "rtv_heap");
+	trackDescriptorHeap(d3d->ds_heap.heap, "dsv_heap");
+
+	// budget and usage for getMemoryStats
+	IDXGIFactory4* dxgi_factory;
+	if (CreateDXGIFactory1(IID_PPV_ARGS(&dxgi_factory)) == S_OK) {
+		if (dxgi_factory->EnumAdapterByLuid(d3d->device->GetAdapterLuid(), IID_PPV_ARGS(&d3d->adapter)) != S_OK) d3d->adapter = nullptr;
+		dxgi_factory->Release();
+	}
 
 	for (Frame& f : d3d->frames) {
 		if (!f.init(d3d->device)) return false;
+		f.scratch_pages.push(createScratchPage(SCRATCH_BUFFER_SIZE));
 	}
 
 	if (d3d->device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&d3d->fence)) != S_OK) return false;
+	if (d3d->device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&d3d->residency_fence)) != S_OK) return false;
+	if (d3d->device->QueryInterface(IID_PPV_ARGS(&d3d->device3)) != S_OK) d3d->device3 = nullptr;
+	d3d->residency.min_idle_frames = NUM_BACKBUFFERS;
 
 	if (d3d->device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, d3d->frames[0].cmd_allocator, NULL, IID_PPV_ARGS(&d3d->cmd_list)) != S_OK) return false;
 	d3d->cmd_list->Close();
@@ -1511,8 +3592,8 @@ bool init(void* hwnd, u32 flags) {
 	d3d->frame->query_buffer->Map(0, nullptr, (void**)&d3d->frame->query_buffer_ptr);
 	d3d->frame->cmd_allocator->Reset();
 	d3d->cmd_list->Reset(d3d->frame->cmd_allocator, nullptr);
-	d3d->cmd_list->SetGraphicsRootSignature(d3d->root_signature);
-	d3d->cmd_list->SetComputeRootSignature(d3d->root_signature);
+	d3d->graphics_root = {};
+	d3d->compute_root = {};
 	ID3D12DescriptorHeap* heaps[] = {d3d->srv_heap.heap, d3d->sampler_heap.heap};
 	d3d->cmd_list->SetDescriptorHeaps(lengthOf(heaps), heaps);
 
@@ -1550,61 +3631,46 @@ void popDebugGroup() {
 }
 
 void setFramebufferCube(TextureHandle cube, u32 face, u32 mip) {
+	checkThread();
+	ASSERT(cube);
 	d3d->pso_cache.last = nullptr;
-	// d3d->current_framebuffer.count = 0;
-	// d3d->current_framebuffer.depth_stencil = nullptr;
-	// Texture& t = d3d->textures[cube.value];
-	// if (t.rtv && (t.rtv_face != face || t.rtv_mip) != mip) {
-	//	t.rtv->Release();
-	//	t.rtv = nullptr;
-	//}
-	// if(!t.rtv) {
-	//	D3D11_RENDER_TARGET_VIEW_DESC desc = {};
-	//	desc.Format = t.dxgi_format;
-	//	desc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2DARRAY;
-	//	desc.Texture2DArray.MipSlice = mip;
-	//	desc.Texture2DArray.ArraySize = 1;
-	//	desc.Texture2DArray.FirstArraySlice = face;
-	//	d3d->device->CreateRenderTargetView((ID3D11Resource*)t.texture2D, &desc,
-	//&t.rtv);
-	//}
-	// ASSERT(d3d->current_framebuffer.count <
-	// (u32)lengthOf(d3d->current_framebuffer.render_targets));
-	// d3d->current_framebuffer.render_targets[d3d->current_framebuffer.count] =
-	// t.rtv;
-	//
-	// ID3D11ShaderResourceView* tmp[16] = {};
-	// d3d->device_ctx->VSGetShaderResources(0, lengthOf(tmp), tmp);
-	// for (ID3D11ShaderResourceView*& srv : tmp) {
-	//	if (t.srv == srv) {
-	//		const u32 idx = u32(&srv - tmp);
-	//		ID3D11ShaderResourceView* empty = nullptr;
-	//		d3d->device_ctx->VSSetShaderResources(idx, 1, &empty);
-	//		d3d->device_ctx->PSSetShaderResources(idx, 1, &empty);
-	//	}
-	//}
-	//
-	//++d3d->current_framebuffer.count;
-	//
-	// d3d->device_ctx->OMSetRenderTargets(d3d->current_framebuffer.count,
-	// d3d->current_framebuffer.render_targets,
-	// d3d->current_framebuffer.depth_stencil);
-	ASSERT(false); // TODO
+
+	for (TextureHandle& texture : d3d->current_framebuffer.attachments) {
+		if (texture) beginSplitTransition(*texture, D3D12_RESOURCE_STATE_GENERIC_READ);
+		texture = INVALID_TEXTURE;
+	}
+
+	Texture& t = *cube;
+	ASSERT(mip < t.mips);
+	resolveUpdates(t);
+	markUsed(t);
+	// other faces and mips keep their state, so they can be sampled while this one is rendered
+	t.setSubresourceState(d3d->cmd_list, t.getSubresource(mip, face), D3D12_RESOURCE_STATE_RENDER_TARGET);
+	d3d->current_framebuffer.attachments[0] = cube;
+	d3d->current_framebuffer.count = 1;
+	d3d->current_framebuffer.formats[0] = toViewFormat(t.dxgi_format);
+	d3d->current_framebuffer.render_targets[0] = getRTV(t, mip, face);
+	d3d->current_framebuffer.depth_stencil = {};
+	d3d->current_framebuffer.ds_format = DXGI_FORMAT_UNKNOWN;
+	d3d->cmd_list->OMSetRenderTargets(1, d3d->current_framebuffer.render_targets, FALSE, nullptr);
 }
 
 void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle depth_stencil, u32 flags) {
 	checkThread();
 	d3d->pso_cache.last = nullptr;
 
+	// the next use of the old attachments is not known yet, if they are attachments again, the split transitions cancel out
 	for (TextureHandle& texture : d3d->current_framebuffer.attachments) {
-		if (texture) texture->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_GENERIC_READ);
+		if (texture) beginSplitTransition(*texture, D3D12_RESOURCE_STATE_GENERIC_READ);
+		texture = INVALID_TEXTURE;
 	}
 
 	const bool readonly_ds = flags & (u32)FramebufferFlags::READONLY_DEPTH_STENCIL;
 	if (!attachments && !depth_stencil) {
+		D3D::Window* window = d3d->current_window;
 		d3d->current_framebuffer.count = 1;
 		d3d->current_framebuffer.formats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
-		d3d->current_framebuffer.render_targets[0] = allocRTV(d3d->rtv_heap, d3d->current_window->backbuffers[d3d->current_window->swapchain->GetCurrentBackBufferIndex()]);
+		d3d->current_framebuffer.render_targets[0] = d3d->rtv_heap.getCPU(window->rtvs[window->swapchain->GetCurrentBackBufferIndex()]);
 		d3d->current_framebuffer.depth_stencil = {};
 		d3d->current_framebuffer.ds_format = DXGI_FORMAT_UNKNOWN;
 	} else {
@@ -1614,14 +3680,18 @@ void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle depth_ste
 			ASSERT(attachments[i]);
 			Texture& t = *attachments[i];
 			ASSERT(d3d->current_framebuffer.count < (u32)lengthOf(d3d->current_framebuffer.render_targets));
+			resolveUpdates(t);
+			markUsed(t);
 			t.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_RENDER_TARGET);
-			d3d->current_framebuffer.formats[d3d->current_framebuffer.count] = t.dxgi_format;
-			d3d->current_framebuffer.render_targets[d3d->current_framebuffer.count] = allocRTV(d3d->rtv_heap, t.resource);
+			d3d->current_framebuffer.formats[d3d->current_framebuffer.count] = toViewFormat(t.dxgi_format);
+			d3d->current_framebuffer.render_targets[d3d->current_framebuffer.count] = getRTV(t, 0, ALL_SLICES);
 			++d3d->current_framebuffer.count;
 		}
 		if (depth_stencil) {
+			resolveUpdates(*depth_stencil);
+			markUsed(*depth_stencil);
 			depth_stencil->setState(d3d->cmd_list, readonly_ds ? D3D12_RESOURCE_STATE_DEPTH_READ | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE : D3D12_RESOURCE_STATE_DEPTH_WRITE);
-			d3d->current_framebuffer.depth_stencil = allocDSV(d3d->ds_heap, *depth_stencil);
+			d3d->current_framebuffer.depth_stencil = getDSV(*depth_stencil, 0, 0, readonly_ds);
 			d3d->current_framebuffer.ds_format = toDSViewFormat(depth_stencil->dxgi_format);
 		}
 		else {
@@ -1634,6 +3704,7 @@ void setFramebuffer(TextureHandle* attachments, u32 num, TextureHandle depth_ste
 }
 
 void clear(u32 flags, const float* color, float depth) {
+	flushBarriers();
 	if (flags & (u32)ClearFlags::COLOR) {
 		for (u32 i = 0; i < d3d->current_framebuffer.count; ++i) {
 			d3d->cmd_list->ClearRenderTargetView(d3d->current_framebuffer.render_targets[i], color, 0, nullptr);
@@ -1652,25 +3723,121 @@ void clear(u32 flags, const float* color, float depth) {
 	}
 }
 
+// the first write in a frame switches to the copy which is not used by frames in flight
+static bool rotate(Buffer& buffer) {
+	if (buffer.copy_count == 1 || buffer.rotated_frame == d3d->frame_counter) return false;
+	buffer.copy_idx = (buffer.copy_idx + 1) % buffer.copy_count;
+	buffer.offset = buffer.copy_idx * buffer.copy_stride;
+	buffer.heap_id = buffer.copy_heap_ids[buffer.copy_idx];
+	buffer.rotated_frame = d3d->frame_counter;
+	return true;
+}
+
 void* map(BufferHandle buffer, size_t size) {
 	ASSERT(buffer);
 	ASSERT(!buffer->mapped_ptr);
-	HRESULT hr = buffer->resource->Map(0, nullptr, (void**)&buffer->mapped_ptr);
-	ASSERT(hr == S_OK);
-	ASSERT(buffer->mapped_ptr);
+	ASSERT(!buffer->mega_range.mega);
+	ASSERT(size <= buffer->size);
+	if (!buffer->persistent_ptr) {
+		HRESULT hr = buffer->resource->Map(0, nullptr, (void**)&buffer->mapped_ptr);
+		ASSERT(hr == S_OK);
+		ASSERT(buffer->mapped_ptr);
+		return buffer->mapped_ptr;
+	}
+
+	rotate(*buffer);
+	buffer->mapped_ptr = buffer->persistent_ptr + buffer->offset;
 	return buffer->mapped_ptr;
 }
 
-void unmap(BufferHandle buffer) {
+void unmap(BufferHandle buffer, size_t written_offset, size_t written_size) {
 	ASSERT(buffer);
 	ASSERT(buffer->mapped_ptr);
-	D3D12_RANGE range = {};
-	buffer->resource->Unmap(0, &range);
+	ASSERT(written_offset + written_size <= buffer->size);
+	if (!buffer->persistent_ptr) {
+		D3D12_RANGE range = {};
+		buffer->resource->Unmap(0, &range);
+	}
+	else if (written_size > 0) {
+		markWritten(*buffer, u32(written_offset), u32(written_offset + written_size));
+	}
 	buffer->mapped_ptr = nullptr;
 }
 
+void unmap(BufferHandle buffer) {
+	ASSERT(buffer);
+	unmap(buffer, 0, buffer->size);
+}
+
+static void updateMemoryStats() {
+	ResourceMemoryStats& stats = d3d->memory_stats;
+	d3d->memory_tracker.getStats(stats);
+	if (!d3d->adapter) return;
+
+	DXGI_QUERY_VIDEO_MEMORY_INFO info;
+	if (d3d->adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info) == S_OK) {
+		stats.budget = info.Budget;
+		stats.usage = info.CurrentUsage;
+	}
+	if (d3d->adapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_NON_LOCAL, &info) == S_OK) {
+		stats.non_local_budget = info.Budget;
+		stats.non_local_usage = info.CurrentUsage;
+	}
+
+	const bool over_budget = stats.budget != 0 && stats.usage > stats.budget;
+	if (over_budget && !d3d->over_budget && d3d->budget_callback) d3d->budget_callback(stats, d3d->budget_callback_user_ptr);
+	d3d->over_budget = over_budget;
+}
+
+ResourceMemoryStats getResourceMemoryStats() {
+	return d3d->memory_stats;
+}
+
+void setDebugName(BufferHandle buffer, const char* debug_name) {
+	ASSERT(buffer);
+	ASSERT(debug_name);
+	// views into a mega buffer share its resource
+	if (buffer->mega_range.mega) return;
+	d3d->memory_tracker.setName(buffer->resource, debug_name);
+	if (buffer->upload_resource) d3d->memory_tracker.setName(buffer->upload_resource, debug_name);
+	WCHAR tmp[MAX_PATH];
+	toWChar(tmp, debug_name);
+	buffer->resource->SetName(tmp);
+}
+
+ResidencyStats getResidencyStats() {
+	return d3d->residency.getStats();
+}
+
+// must be called after the current frame waited for the oldest one, see ResidencyManager::min_idle_frames
+static void evictResources() {
+	const ResourceMemoryStats& stats = d3d->memory_stats;
+	MutexGuard guard(d3d->resource_mutex);
+	d3d->to_evict.clear();
+	d3d->residency.selectEvictions(stats.usage, stats.budget, d3d->frame_counter, d3d->to_evict);
+	if (d3d->to_evict.empty()) return;
+	const HRESULT hr = d3d->device->Evict(d3d->to_evict.size(), (ID3D12Pageable* const*)d3d->to_evict.begin());
+	ASSERT(hr == S_OK);
+}
+
+void setMemoryBudgetCallback(MemoryBudgetCallback callback, void* user_ptr) {
+	d3d->budget_callback = callback;
+	d3d->budget_callback_user_ptr = user_ptr;
+}
+
 bool getMemoryStats(Ref<MemoryStats> stats) {
-	return false;
+	if (!d3d->adapter) return false;
+	const ResourceMemoryStats& s = d3d->memory_stats;
+	DXGI_ADAPTER_DESC1 desc;
+	if (d3d->adapter->GetDesc1(&desc) != S_OK) return false;
+
+	stats->total_available_mem = s.budget;
+	stats->current_available_mem = s.budget > s.usage ? s.budget - s.usage : 0;
+	stats->dedicated_vidmem = desc.DedicatedVideoMemory;
+	stats->buffer_mem = s.size[(u32)ResourceCategory::STATIC_BUFFER] + s.size[(u32)ResourceCategory::DYNAMIC_BUFFER];
+	stats->texture_mem = s.size[(u32)ResourceCategory::TEXTURE];
+	stats->render_target_mem = s.size[(u32)ResourceCategory::RENDER_TARGET];
+	return true;
 }
 
 void setCurrentWindow(void* window_handle) {
@@ -1715,9 +3882,26 @@ void waitFrame(u32 frame_idx) {
 	f.wait();
 }
 
+// resources destroyed on other threads since the last call
+static void destroyDeferred() {
+	Array<Texture*> textures(d3d->allocator);
+	Array<Buffer*> buffers(d3d->allocator);
+	{
+		MutexGuard guard(d3d->resource_mutex);
+		for (Texture* texture : d3d->deferred_texture_destroys) textures.push(texture);
+		for (Buffer* buffer : d3d->deferred_buffer_destroys) buffers.push(buffer);
+		d3d->deferred_texture_destroys.clear();
+		d3d->deferred_buffer_destroys.clear();
+	}
+	// destroy takes resource_mutex
+	for (Texture* texture : textures) destroy(texture);
+	for (Buffer* buffer : buffers) destroy(buffer);
+}
+
 u32 swapBuffers() {
-	d3d->dirty_samplers = true;
 	d3d->pso_cache.last = nullptr;
+	destroyDeferred();
+	flushUpdates();
 	for (auto& window : d3d->windows) {
 		if (!window.handle) continue;
 
@@ -1725,17 +3909,37 @@ u32 swapBuffers() {
 		switchState(d3d->cmd_list, window.backbuffers[current_idx], D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT);
 	}
 
+	if (d3d->residency_waited_value != d3d->residency_fence_value) {
+		// objects made resident during this frame
+		d3d->cmd_queue->Wait(d3d->residency_fence, d3d->residency_fence_value);
+		d3d->residency_waited_value = d3d->residency_fence_value;
+	}
+	endSplitTransitions();
+	flushBarriers();
+	d3d->last_barrier_stats = d3d->barrier_stats;
+	d3d->barrier_stats = {};
 	d3d->frame->end(d3d->cmd_queue, d3d->cmd_list, d3d->fence, d3d->query_heap, Ref(d3d->fence_value));
+	{
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.flush();
+		d3d->copy_queue.reclaim();
+	}
+	updateMemoryStats();
 	const u32 res = u32(d3d->frame - d3d->frames.begin());
 
+	d3d->resource_mutex.enter();
 	++d3d->frame;
 	if (d3d->frame >= d3d->frames.end()) d3d->frame = d3d->frames.begin();
+	d3d->resource_mutex.exit();
+	++d3d->frame_counter;
 
 	d3d->srv_heap.nextFrame();
-	d3d->rtv_heap.nextFrame();
-	d3d->ds_heap.nextFrame();
 
 	d3d->frame->begin();
+	evictResources();
+	updateTransientPool();
+	d3d->render_target_pool.update();
+	updateBufferPromotion();
 	for (SRV& h : d3d->current_srvs) {
 		h.texture = INVALID_TEXTURE;
 		h.buffer = INVALID_BUFFER;
@@ -1762,20 +3966,19 @@ u32 swapBuffers() {
 			HRESULT hr = window.swapchain->ResizeBuffers(0, size.x, size.y, DXGI_FORMAT_UNKNOWN, DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT);
 			ASSERT(hr == S_OK);
 
-			SIZE_T rtvDescriptorSize = d3d->device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 			for (u32 i = 0; i < NUM_BACKBUFFERS; ++i) {
-				hr = d3d->windows[0].swapchain->GetBuffer(i, IID_PPV_ARGS(&d3d->windows[0].backbuffers[i]));
+				hr = window.swapchain->GetBuffer(i, IID_PPV_ARGS(&window.backbuffers[i]));
 				ASSERT(hr == S_OK);
-				d3d->windows[0].backbuffers[i]->SetName(L"window_rb");
+				window.backbuffers[i]->SetName(L"window_rb");
+				d3d->device->CreateRenderTargetView(window.backbuffers[i], nullptr, d3d->rtv_heap.getCPU(window.rtvs[i]));
 			}
 		}
 	}
 
-	d3d->frame->scratch_buffer_ptr = d3d->frame->scratch_buffer_begin;
 	d3d->frame->cmd_allocator->Reset();
 	d3d->cmd_list->Reset(d3d->frame->cmd_allocator, nullptr);
-	d3d->cmd_list->SetGraphicsRootSignature(d3d->root_signature);
-	d3d->cmd_list->SetComputeRootSignature(d3d->root_signature);
+	d3d->graphics_root = {};
+	d3d->compute_root = {};
 	ID3D12DescriptorHeap* heaps[] = {d3d->srv_heap.heap, d3d->sampler_heap.heap};
 	d3d->cmd_list->SetDescriptorHeaps(lengthOf(heaps), heaps);
 
@@ -1791,6 +3994,32 @@ u32 swapBuffers() {
 	return res;
 }
 
+// `size` bytes of `buffer.resource` starting at `offset`
+static u32 allocBufferViews(Buffer& buffer, u32 offset, size_t size, bool shader_buffer) {
+	D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+	srv_desc.Format = DXGI_FORMAT_R32_UINT;
+	srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+	srv_desc.Buffer.FirstElement = offset / sizeof(u32);
+	srv_desc.Buffer.NumElements = UINT(size / sizeof(u32));
+	srv_desc.Buffer.StructureByteStride = 0;
+	srv_desc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+
+	if (shader_buffer) {
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
+		uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
+		uav_desc.Format = DXGI_FORMAT_R32_UINT;
+		uav_desc.Buffer.CounterOffsetInBytes = 0;
+		uav_desc.Buffer.FirstElement = srv_desc.Buffer.FirstElement;
+		uav_desc.Buffer.NumElements = srv_desc.Buffer.NumElements;
+		uav_desc.Buffer.StructureByteStride = 0;
+		uav_desc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+
+		return d3d->srv_heap.alloc(d3d->device, buffer.resource, srv_desc, &uav_desc);
+	}
+	return d3d->srv_heap.alloc(d3d->device, buffer.resource, srv_desc, nullptr);
+}
+
 void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data) {
 	ASSERT(buffer);
 	ASSERT(!buffer->resource);
@@ -1798,14 +4027,32 @@ void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data)
 	buffer->size = (u32)size;
 	const bool mappable = flags & (u32)BufferFlags::MAPPABLE;
 	const bool shader_buffer = flags & (u32)BufferFlags::SHADER_BUFFER;
+	const bool immutable = flags & (u32)BufferFlags::IMMUTABLE;
 	if (shader_buffer) {
 		size = ((size + 15) / 16) * 16;
 	}	
 
-	D3D12_HEAP_PROPERTIES props = {};
-	props.Type = mappable ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	// small static buffers, e.g. mesh vertices and indices, are views into a shared mega buffer
+	// views are written on the graphics queue, so loader threads create standalone buffers
+	const bool is_render_thread = d3d->thread == GetCurrentThreadId();
+	if (immutable && data && !mappable && !shader_buffer && size <= MAX_MEGA_BUFFER_ALLOCATION && is_render_thread) {
+		const u32 align = flags & (u32)BufferFlags::UNIFORM_BUFFER ? D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT : 16;
+		if (allocMegaBufferRange((u32)size, align, Ref(buffer->mega_range), Ref(buffer->offset))) {
+			buffer->resource = buffer->mega_range.mega->resource;
+
+			D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
+			srv_desc.Format = DXGI_FORMAT_R32_UINT;
+			srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+			srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+			srv_desc.Buffer.FirstElement = buffer->offset / sizeof(u32);
+			srv_desc.Buffer.NumElements = UINT(size / sizeof(u32));
+			srv_desc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+			buffer->heap_id = d3d->srv_heap.alloc(d3d->device, buffer->resource, srv_desc, nullptr);
+
+			update(buffer, data, size);
+			return;
+		}
+	}
 
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
@@ -1818,44 +4065,175 @@ void createBuffer(BufferHandle buffer, u32 flags, size_t size, const void* data)
 	desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 	desc.Flags = shader_buffer ? D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS : D3D12_RESOURCE_FLAG_NONE;
 
-	HRESULT hr = d3d->device->CreateCommittedResource(&props, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, IID_PPV_ARGS(&buffer->resource));
-	ASSERT(hr == S_OK);
-	buffer->state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	const D3D12_HEAP_TYPE heap_type = mappable ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+	const bool async_upload = data && !mappable;
+	const D3D12_RESOURCE_STATES initial_state = async_upload ? D3D12_RESOURCE_STATE_COMMON : D3D12_RESOURCE_STATE_GENERIC_READ;
+	HRESULT hr = createResource(heap_type, desc, initial_state, nullptr, Ref(buffer->allocation), &buffer->resource);
+	ASSERT(hr == S_OK);
+	d3d->memory_tracker.add(buffer->resource, mappable ? ResourceCategory::DYNAMIC_BUFFER : ResourceCategory::STATIC_BUFFER, buffer->allocation.size, "buffer");
+	if (!mappable) addResidency(buffer->residency, buffer->resource, buffer->allocation);
+	buffer->state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	buffer->heap_id = allocBufferViews(*buffer, 0, size, shader_buffer);
+
+	if (async_upload) {
+		CopyQueue::Staging staging;
+		{
+			MutexGuard guard(d3d->copy_queue.mutex);
+			staging = d3d->copy_queue.allocStaging(buffer->size, 16);
+		}
+		// other loader threads can upload in the meantime
+		memcpy(staging.ptr, data, buffer->size);
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.getCmdList()->CopyBufferRegion(buffer->resource, 0, staging.resource, staging.offset, buffer->size);
+		d3d->copy_queue.releaseStaging(staging);
+		buffer->upload_fence = d3d->copy_queue.getFenceValue();
+		buffer->upload_pending = true;
+		d3d->residency.pin(getResidency(*buffer));
+	}
+
+	if (mappable) {
+		// upload heap is write-combined, it can stay mapped, map and unmap just return the pointer
+		D3D12_RANGE read_range = {};
+		hr = buffer->resource->Map(0, &read_range, (void**)&buffer->persistent_ptr);
+		ASSERT(hr == S_OK);
+		if (data) memcpy(buffer->persistent_ptr, data, buffer->size);
+
+		MutexGuard guard(d3d->resource_mutex);
+		buffer->mappable_idx = d3d->mappable_buffers.size();
+		d3d->mappable_buffers.push(buffer);
+	}
+}
+
+void createRotatingBuffer(BufferHandle buffer, u32 flags, size_t size) {
+	ASSERT(flags & (u32)BufferFlags::MAPPABLE);
+	const bool shader_buffer = flags & (u32)BufferFlags::SHADER_BUFFER;
+	if (shader_buffer) size = ((size + 15) / 16) * 16;
+	// each copy can be bound as a constant buffer
+	const u32 stride = u32((size + D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1) & ~u64(D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT - 1));
+	createBuffer(buffer, flags, u64(stride) * NUM_BACKBUFFERS, nullptr);
 
-	D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
-	srv_desc = {};
-	srv_desc.Format = DXGI_FORMAT_R32_UINT;
-	srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-	srv_desc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
-	srv_desc.Buffer.FirstElement = 0;
-	srv_desc.Buffer.NumElements = UINT(size / sizeof(u32));
-	srv_desc.Buffer.StructureByteStride = 0;
-	srv_desc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
+	{
+		// views of the whole resource are replaced by per-copy views
+		MutexGuard guard(d3d->resource_mutex);
+		d3d->frame->to_heap_release.push(buffer->heap_id);
+	}
+	buffer->size = (u32)size;
+	buffer->copy_count = NUM_BACKBUFFERS;
+	buffer->copy_stride = stride;
+	for (u32 i = 0; i < NUM_BACKBUFFERS; ++i) {
+		buffer->copy_heap_ids[i] = allocBufferViews(*buffer, i * stride, size, shader_buffer);
+	}
+	// the first map rotates to copy 0
+	buffer->copy_idx = NUM_BACKBUFFERS - 1;
+	buffer->offset = buffer->copy_idx * stride;
+	buffer->heap_id = buffer->copy_heap_ids[buffer->copy_idx];
+	buffer->rotated_frame = d3d->frame_counter - 1;
+}
 
-	if (shader_buffer) {
-		D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
-		uav_desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
-		uav_desc.Format = DXGI_FORMAT_R32_UINT;
-		uav_desc.Buffer.CounterOffsetInBytes = 0;
-		uav_desc.Buffer.FirstElement = 0;
-		uav_desc.Buffer.NumElements = srv_desc.Buffer.NumElements;
-		uav_desc.Buffer.StructureByteStride = 0;
-		uav_desc.Buffer.Flags = D3D12_BUFFER_UAV_FLAG_NONE;
+static void unregisterMappable(Buffer& buffer) {
+	if (buffer.mappable_idx == 0xffFFffFF) return;
+	d3d->mappable_buffers.back()->mappable_idx = buffer.mappable_idx;
+	d3d->mappable_buffers.swapAndPop(buffer.mappable_idx);
+	buffer.mappable_idx = 0xffFFffFF;
+}
+
+// createResource takes resource_mutex, so the caller must not hold it
+static void promote(Buffer& buffer) {
+	D3D12_RESOURCE_DESC desc = buffer.resource->GetDesc();
+	ID3D12Resource* shadow;
+	GPUAllocation allocation;
+	HRESULT hr = createResource(D3D12_HEAP_TYPE_DEFAULT, desc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, Ref(allocation), &shadow);
+	if (hr != S_OK) return;
+	d3d->memory_tracker.add(shadow, ResourceCategory::DYNAMIC_BUFFER, allocation.size, d3d->memory_tracker.getName(buffer.resource).data);
+
+	MutexGuard guard(d3d->resource_mutex);
+	buffer.upload_resource = buffer.resource;
+	buffer.upload_allocation = buffer.allocation;
+	buffer.upload_heap_id = buffer.heap_id;
+	buffer.resource = shadow;
+	buffer.allocation = allocation;
+	buffer.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	buffer.heap_id = allocBufferViews(buffer, 0, buffer.size, false);
+	addResidency(buffer.residency, shadow, allocation);
+
+	// whole content is copied before the first use
+	buffer.written_begin = 0;
+	buffer.written_end = buffer.size;
+	buffer.shadow_dirty = true;
+	d3d->dirty_shadows.push(&buffer);
+
+	++d3d->promotion_stats.promotions;
+	++d3d->promotion_stats.promoted_count;
+	d3d->promotion_stats.promoted_size += buffer.size;
+}
 
-		buffer->heap_id = d3d->srv_heap.alloc(d3d->device, buffer->resource, srv_desc, &uav_desc);
+// caller must hold resource_mutex
+static void demote(Buffer& buffer) {
+	if (buffer.shadow_dirty) {
+		buffer.shadow_dirty = false;
+		d3d->dirty_shadows.eraseItem(&buffer);
 	}
-	else {
-		buffer->heap_id = d3d->srv_heap.alloc(d3d->device, buffer->resource, srv_desc, nullptr);
-	
+	d3d->residency.remove(buffer.residency);
+	d3d->frame->to_release.push(buffer.resource);
+	d3d->frame->to_free_memory.push(buffer.allocation);
+	d3d->frame->to_heap_release.push(buffer.heap_id);
+
+	buffer.resource = buffer.upload_resource;
+	buffer.allocation = buffer.upload_allocation;
+	buffer.heap_id = buffer.upload_heap_id;
+	buffer.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	buffer.upload_resource = nullptr;
+	buffer.upload_heap_id = INVALID_HEAP_ID;
+
+	++d3d->promotion_stats.demotions;
+	--d3d->promotion_stats.promoted_count;
+	d3d->promotion_stats.promoted_size -= buffer.size;
+}
+
+// buffers read from upload heap go over PCIe on every use, hot ones get a copy in default heap
+static void updateBufferPromotion() {
+	if (d3d->frame_counter % PROMOTION_WINDOW_FRAMES != 0) return;
+
+	Array<Buffer*> to_promote(d3d->allocator);
+	d3d->resource_mutex.enter();
+	for (Buffer* buffer : d3d->mappable_buffers) {
+		const u32 reads = buffer->gpu_reads;
+		const u32 writes = buffer->cpu_writes;
+		buffer->gpu_reads = 0;
+		buffer->cpu_writes = 0;
+		// rotating buffers are rewritten every frame
+		if (buffer->copy_count > 1) continue;
+
+		if (!buffer->upload_resource) {
+			// read at least once per frame on average and much more often than written
+			const bool hot = reads >= PROMOTION_WINDOW_FRAMES && reads >= writes * PROMOTION_READS_PER_WRITE;
+			if (hot && buffer->size >= PROMOTION_MIN_SIZE) to_promote.push(buffer);
+		}
+		else if (reads < writes * 2) {
+			// each write costs a GPU copy, not worth it anymore
+			demote(*buffer);
+		}
 	}
+	d3d->resource_mutex.exit();
 
-	if (data) {
-		ID3D12Resource* upload_buffer = createBuffer(d3d->device, data, size, D3D12_HEAP_TYPE_UPLOAD);
-		D3D12_RESOURCE_STATES old_state = buffer->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
-		d3d->cmd_list->CopyResource(buffer->resource, upload_buffer);
-		buffer->setState(d3d->cmd_list, old_state);
-		d3d->frame->to_release.push(upload_buffer);
+	// other threads only queue buffers for destroyDeferred, which runs on this thread, so they are still alive
+	for (Buffer* buffer : to_promote) promote(*buffer);
+}
+
+BufferPromotionStats getBufferPromotionStats() {
+	MutexGuard guard(d3d->resource_mutex);
+	return d3d->promotion_stats;
+}
+
+u32 getPromotedBuffers(BufferHandle* buffers, u32 max_count) {
+	MutexGuard guard(d3d->resource_mutex);
+	u32 count = 0;
+	for (Buffer* buffer : d3d->mappable_buffers) {
+		if (!buffer->upload_resource) continue;
+		if (count < max_count) buffers[count] = buffer;
+		++count;
 	}
+	return count;
 }
 
 ProgramHandle allocProgramHandle() {
@@ -1868,7 +4246,7 @@ BufferHandle allocBufferHandle() {
 }
 
 TextureHandle allocTextureHandle() {
-	return LUMIX_NEW(d3d->allocator, Texture);
+	return LUMIX_NEW(d3d->allocator, Texture)(d3d->allocator);
 }
 
 void VertexDecl::addAttribute(u8 idx, u8 byte_offset, u8 components_num, AttributeType type, u8 flags) {
@@ -1887,107 +4265,77 @@ void VertexDecl::addAttribute(u8 idx, u8 byte_offset, u8 components_num, Attribu
 	++attributes_count;
 }
 
-bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, const char* debug_name) {
-	checkThread();
+PreparedTexture* prepareTexture(const void* data, u64 size, u32 flags, const char* debug_name) {
 	ASSERT(debug_name && debug_name[0]);
-	ASSERT(handle);
-	DDS::Header hdr;
-
-	InputMemoryStream blob(data, size);
-	blob.read(&hdr, sizeof(hdr));
+	PreparedTexture* prepared = LUMIX_NEW(d3d->allocator, PreparedTexture)(d3d->allocator);
+	prepared->flags = flags;
+	TextureLayout& layout = prepared->layout;
+	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
+	if (!computeTextureLayout(data, size, is_srgb, D3D12_TEXTURE_DATA_PITCH_ALIGNMENT, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, layout, debug_name)) {
+		LUMIX_DELETE(d3d->allocator, prepared);
+		return nullptr;
+	}
 
-	if (hdr.dwMagic != DDS::DDS_MAGIC || hdr.dwSize != 124 || !(hdr.dwFlags & DDS::DDSD_PIXELFORMAT) || !(hdr.dwFlags & DDS::DDSD_CAPS)) {
-		logError("Wrong dds format or corrupted dds (", debug_name, ")");
-		return false;
+	// rows are written directly from `data`, e.g. mapped pages of a TexturePack, to the staging ring,
+	// commitTexture only records copies from it
+	{
+		MutexGuard guard(d3d->copy_queue.mutex);
+		prepared->staging = d3d->copy_queue.allocStaging(layout.staging_size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT);
 	}
+	writeTextureRows(layout, prepared->staging.ptr);
+	return prepared;
+}
 
-	DDS::LoadInfo* li;
-	int layers = 1;
-
-	if (isDXT1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT1;
-	} else if (isDXT3(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT3;
-	} else if (isDXT5(hdr.pixelFormat)) {
-		li = &DDS::loadInfoDXT5;
-	} else if (isATI1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoATI1;
-	} else if (isATI2(hdr.pixelFormat)) {
-		li = &DDS::loadInfoATI2;
-	} else if (isBGRA8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGRA8;
-	} else if (isBGR8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR8;
-	} else if (isBGR5A1(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR5A1;
-	} else if (isBGR565(hdr.pixelFormat)) {
-		li = &DDS::loadInfoBGR565;
-	} else if (isINDEX8(hdr.pixelFormat)) {
-		li = &DDS::loadInfoIndex8;
-	} else if (isDXT10(hdr.pixelFormat)) {
-		DDS::DXT10Header dxt10_hdr;
-		blob.read(dxt10_hdr);
-		li = DDS::getDXT10LoadInfo(hdr, dxt10_hdr);
-		layers = dxt10_hdr.array_size;
-	} else {
-		ASSERT(false);
-		return false;
+void destroy(PreparedTexture* prepared) {
+	if (!prepared) return;
+	if (prepared->staging.resource) {
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.releaseStaging(prepared->staging);
 	}
+	LUMIX_DELETE(d3d->allocator, prepared);
+}
 
-	const bool is_cubemap = (hdr.caps2.dwCaps2 & DDS::DDSCAPS2_CUBEMAP) != 0;
-	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
-	const DXGI_FORMAT internal_format = is_srgb ? li->srgb_format : li->format;
-	const u32 mip_count = (hdr.dwFlags & DDS::DDSD_MIPMAPCOUNT) ? hdr.dwMipMapCount : 1;
-	Texture& texture = *handle;
-	texture.flags = flags;
+bool commitTexture(TextureHandle handle, PreparedTexture* prepared, const char* debug_name) {
+	ASSERT(debug_name && debug_name[0]);
+	ASSERT(handle);
+	ASSERT(prepared);
+	const TextureLayout& layout = prepared->layout;
+	const bool is_cubemap = layout.is_cubemap;
+	const u32 layers = layout.layers;
+	const u32 mip_count = layout.mips;
 
-	D3D12_SUBRESOURCE_DATA* srd = (D3D12_SUBRESOURCE_DATA*)_alloca(sizeof(D3D12_SUBRESOURCE_DATA) * mip_count * layers * (is_cubemap ? 6 : 1));
-	u32 srd_idx = 0;
-	for (int side = 0; side < (is_cubemap ? 6 : 1); ++side) {
-		for (int layer = 0; layer < layers; ++layer) {
-			if (li->compressed) {
-				for (u32 mip = 0; mip < mip_count; ++mip) {
-					const u32 width = maximum(1, hdr.dwWidth >> mip);
-					const u32 height = maximum(1, hdr.dwHeight >> mip);
-					const u32 size = DDS::sizeDXTC(width, height, internal_format);
-					srd[srd_idx].pData = (u8*)blob.getData() + blob.getPosition();
-					srd[srd_idx].RowPitch = ((width + 3) / 4) * DDS::sizeDXTC(1, 1, internal_format);
-					srd[srd_idx].SlicePitch = ((height + 3) / 4) * srd[srd_idx].RowPitch;
-					blob.skip(size);
-					ASSERT(size == srd[srd_idx].SlicePitch);
-					++srd_idx;
-				}
-			} else {
-				// TODO
-				ASSERT(false);
-			}
-		}
-	}
+	Texture& texture = *handle;
+	texture.flags = prepared->flags;
+	texture.w = layout.width;
+	texture.h = layout.height;
+	texture.depth = layout.array_size;
+	texture.mips = mip_count;
 
-	D3D12_HEAP_PROPERTIES props = {};
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
 	D3D12_RESOURCE_DESC desc = {};
 	desc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	desc.Width = maximum(li->block_width, hdr.dwWidth);
-	desc.Height = maximum(li->block_width, hdr.dwHeight);
-	desc.DepthOrArraySize = is_cubemap ? 6 : layers;
+	desc.Width = layout.width;
+	desc.Height = layout.height;
+	desc.DepthOrArraySize = layout.array_size;
 	desc.MipLevels = mip_count;
-	desc.Format = is_srgb ? li->srgb_format : li->format;
+	desc.Format = (DXGI_FORMAT)layout.dxgi_format;
 	desc.SampleDesc.Count = 1;
 	desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 	desc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
 	texture.dxgi_format = desc.Format;
-	HRESULT hr = d3d->device->CreateCommittedResource(&props, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&texture.resource));
-	ASSERT(SUCCEEDED(hr));
+	HRESULT hr = createResource(D3D12_HEAP_TYPE_DEFAULT, desc, D3D12_RESOURCE_STATE_COMMON, nullptr, Ref(texture.allocation), &texture.resource);
+	if (hr != S_OK) {
+		logError("Failed to create texture (", debug_name, ")");
+		destroy(prepared);
+		return false;
+	}
+	d3d->memory_tracker.add(texture.resource, ResourceCategory::TEXTURE, texture.allocation.size, debug_name);
+	addResidency(texture.residency, texture.resource, texture.allocation);
 
-	texture.dxgi_format = desc.Format;
 	D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
 	srv_desc.Format = toViewFormat(desc.Format);
-	uav_desc.Format = srv_desc.Format;
+	uav_desc.Format = toUAVFormat(desc.Format);
 	srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	if (is_cubemap) {
 		srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURECUBE;
@@ -2028,17 +4376,36 @@ bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, co
 
 	texture.heap_id = d3d->srv_heap.alloc(d3d->device, texture.resource, srv_desc, nullptr);
 
-	u64 upload_buffer_size;
-	d3d->device->GetCopyableFootprints(&desc, 0, srd_idx, 0, NULL, NULL, NULL, &upload_buffer_size);
-
-	ID3D12Resource* staging = createBuffer(d3d->device, nullptr, upload_buffer_size, D3D12_HEAP_TYPE_UPLOAD);
-
-	UpdateSubresources(d3d->cmd_list, texture.resource, staging, 0, 0, srd_idx, srd);
-
-	switchState(d3d->cmd_list, texture.resource, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
-	texture.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+	{
+		MutexGuard guard(d3d->copy_queue.mutex);
+		ID3D12GraphicsCommandList* cmd_list = d3d->copy_queue.getCmdList();
+		for (u32 i = 0, c = layout.subresources.size(); i < c; ++i) {
+			const SubresourceLayout& sub = layout.subresources[i];
+			D3D12_TEXTURE_COPY_LOCATION dst = {};
+			dst.pResource = texture.resource;
+			dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+			dst.SubresourceIndex = i;
+
+			D3D12_TEXTURE_COPY_LOCATION src = {};
+			src.pResource = prepared->staging.resource;
+			src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+			src.PlacedFootprint.Offset = prepared->staging.offset + sub.offset;
+			src.PlacedFootprint.Footprint.Format = desc.Format;
+			src.PlacedFootprint.Footprint.Width = sub.width;
+			src.PlacedFootprint.Footprint.Height = sub.height;
+			src.PlacedFootprint.Footprint.Depth = 1;
+			src.PlacedFootprint.Footprint.RowPitch = sub.row_pitch;
+			cmd_list->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+		}
+		texture.state = D3D12_RESOURCE_STATE_GENERIC_READ;
+		texture.upload_fence = d3d->copy_queue.getFenceValue();
+		texture.upload_pending = true;
+		d3d->residency.pin(getResidency(texture));
+		d3d->copy_queue.releaseStaging(prepared->staging);
+	}
+	prepared->staging.resource = nullptr;
+	destroy(prepared);
 
-	d3d->frame->to_release.push(staging);
 	if (debug_name) {
 		WCHAR tmp[MAX_PATH];
 		toWChar(tmp, debug_name);
@@ -2048,14 +4415,42 @@ bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, co
 	return true;
 }
 
-bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, u32 flags, const void* data, const char* debug_name) {
+bool loadTexture(TextureHandle handle, const void* data, int size, u32 flags, const char* debug_name) {
+	PreparedTexture* prepared = prepareTexture(data, size, flags, debug_name);
+	if (!prepared) return false;
+	return commitTexture(handle, prepared, debug_name);
+}
+
+static D3D12_RESOURCE_DESC getTextureDesc(u32 w, u32 h, u32 depth, TextureFormat format, u32 flags) {
+	const bool no_mips = flags & (u32)TextureFlags::NO_MIPS;
+	const bool is_3d = flags & (u32)TextureFlags::IS_3D;
+	const bool compute_write = flags & (u32)TextureFlags::COMPUTE_WRITE;
+	const bool render_target = flags & (u32)TextureFlags::RENDER_TARGET;
+	const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(w, h, depth));
+
+	D3D12_RESOURCE_DESC desc = {};
+	desc.Dimension = is_3d ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	desc.Width = w;
+	desc.Height = h;
+	desc.DepthOrArraySize = flags & (u32)TextureFlags::IS_CUBE ? 6 : depth;
+	desc.MipLevels = mip_count;
+	desc.Format = getDXGIFormat(format);
+	desc.SampleDesc.Count = 1;
+	desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+	desc.Flags = render_target ? (isDepthFormat(desc.Format) ? D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL : D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) : D3D12_RESOURCE_FLAG_NONE;
+	if (compute_write) desc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	if (compute_write && desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) desc.Format = DXGI_FORMAT_R8G8B8A8_TYPELESS;
+	return desc;
+}
+
+// `placement_heap` is used by transient textures, they do not own their memory
+static bool initTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, u32 flags, const void* data, const char* debug_name, ID3D12Heap* placement_heap, u64 placement_offset) {
 	ASSERT(handle);
 
 	const bool is_srgb = flags & (u32)TextureFlags::SRGB;
 	const bool no_mips = flags & (u32)TextureFlags::NO_MIPS;
 	const bool readback = flags & (u32)TextureFlags::READBACK;
 	const bool is_3d = flags & (u32)TextureFlags::IS_3D;
-	const bool is_cubemap = flags & (u32)TextureFlags::IS_CUBE;
 	const bool compute_write = flags & (u32)TextureFlags::COMPUTE_WRITE;
 	const bool render_target = flags & (u32)TextureFlags::RENDER_TARGET;
 
@@ -2078,25 +4473,11 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 		default: ASSERT(false); return false;
 	}
 
-	const u32 mip_count = no_mips ? 1 : 1 + log2(maximum(w, h, depth));
-	Texture& texture = *handle;
-
-	D3D12_HEAP_PROPERTIES props = {};
-	props.Type = D3D12_HEAP_TYPE_DEFAULT;
-	props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-	props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+	ASSERT(no_mips || !data || getMipPixelSize(format) != 0);
 
-	D3D12_RESOURCE_DESC desc = {};
-	desc.Dimension = is_3d ? D3D12_RESOURCE_DIMENSION_TEXTURE3D : D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	desc.Width = w;
-	desc.Height = h;
-	desc.DepthOrArraySize = depth;
-	desc.MipLevels = mip_count;
-	desc.Format = getDXGIFormat(format);
-	desc.SampleDesc.Count = 1;
-	desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	desc.Flags = render_target ? (isDepthFormat(desc.Format) ? D3D12_RESOURCE_FLAG_ALLOW_DEPTH_STENCIL : D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET) : D3D12_RESOURCE_FLAG_NONE;
-	if (compute_write) desc.Flags |= D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS;
+	Texture& texture = *handle;
+	const D3D12_RESOURCE_DESC desc = getTextureDesc(w, h, depth, format, flags);
+	const u32 mip_count = desc.MipLevels;
 
 	D3D12_CLEAR_VALUE clear_val = {};
 	D3D12_CLEAR_VALUE* clear_val_ptr = nullptr;
@@ -2117,7 +4498,16 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 	}
 
 	texture.state = compute_write ? D3D12_RESOURCE_STATE_UNORDERED_ACCESS : D3D12_RESOURCE_STATE_GENERIC_READ;
-	if (d3d->device->CreateCommittedResource(&props, D3D12_HEAP_FLAG_NONE, &desc, texture.state, clear_val_ptr, IID_PPV_ARGS(&texture.resource)) != S_OK) return false;
+	const D3D12_RESOURCE_STATES initial_state = data ? D3D12_RESOURCE_STATE_COMMON : texture.state;
+	if (placement_heap) {
+		ASSERT(!data);
+		if (d3d->device->CreatePlacedResource(placement_heap, placement_offset, &desc, initial_state, clear_val_ptr, IID_PPV_ARGS(&texture.resource)) != S_OK) return false;
+	}
+	else {
+		if (createResource(D3D12_HEAP_TYPE_DEFAULT, desc, initial_state, clear_val_ptr, Ref(texture.allocation), &texture.resource) != S_OK) return false;
+		d3d->memory_tracker.add(texture.resource, render_target ? ResourceCategory::RENDER_TARGET : ResourceCategory::TEXTURE, texture.allocation.size, debug_name);
+		addResidency(texture.residency, texture.resource, texture.allocation);
+	}
 
 	#ifdef LUMIX_DEBUG
 		texture.name = debug_name;
@@ -2125,10 +4515,14 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 
 	texture.flags = flags;
 	texture.dxgi_format = desc.Format;
+	texture.w = w;
+	texture.h = h;
+	texture.depth = desc.DepthOrArraySize;
+	texture.mips = mip_count;
 	D3D12_SHADER_RESOURCE_VIEW_DESC srv_desc = {};
 	D3D12_UNORDERED_ACCESS_VIEW_DESC uav_desc = {};
 	srv_desc.Format = toViewFormat(desc.Format);
-	uav_desc.Format = srv_desc.Format;
+	uav_desc.Format = toUAVFormat(desc.Format);
 	srv_desc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	if (is_3d) {
 		srv_desc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE3D;
@@ -2160,64 +4554,263 @@ bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat
 		texture.resource->SetName(tmp);
 	}
 
-	const u32 bytes_per_pixel = getSize(desc.Format);
-	Array<Array<u8>> mips_data(d3d->allocator);
-	mips_data.reserve(mip_count - 1);
 	if (data) {
-		D3D12_SUBRESOURCE_DATA* srd = (D3D12_SUBRESOURCE_DATA*)_alloca(sizeof(D3D12_SUBRESOURCE_DATA) * mip_count * (is_cubemap ? 6 : depth));
-		const u8* ptr = (u8*)data;
-
-		// TODO some formats are transformed to different sized dxgi formats
-		u32 idx = 0;
-		for (u32 layer = 0; layer < (is_cubemap ? 6 : depth); ++layer) {
-			srd[idx].pData = ptr;
-			srd[idx].RowPitch = w * bytes_per_pixel;
-			srd[idx].SlicePitch = h * srd[idx].SlicePitch;
-			++idx;
-			u32 prev_mip_w = w;
-			u32 prev_mip_h = h;
-			const u8* prev_mip_data = ptr;
-			ptr += w * h * bytes_per_pixel;
+		const u32 bytes_per_pixel = getSize(desc.Format);
+		const u32 slices = is_3d ? 1 : desc.DepthOrArraySize;
+		const u32 subresource_count = mip_count * slices;
+		D3D12_PLACED_SUBRESOURCE_FOOTPRINT* footprints = (D3D12_PLACED_SUBRESOURCE_FOOTPRINT*)_alloca(sizeof(D3D12_PLACED_SUBRESOURCE_FOOTPRINT) * subresource_count);
+		UINT64 upload_buffer_size;
+		d3d->device->GetCopyableFootprints(&desc, 0, subresource_count, 0, footprints, nullptr, nullptr, &upload_buffer_size);
+
+		ID3D12Resource* staging;
+		GPUAllocation staging_allocation;
+		u8* staging_ptr;
+		if (!createStagingBuffer(upload_buffer_size, &staging, Ref(staging_allocation), &staging_ptr)) {
+			logError("Failed to create staging buffer (", debug_name, ")");
+			// nothing was recorded with the texture yet, so it's released right away
+			d3d->residency.remove(texture.residency);
+			d3d->memory_tracker.remove(texture.resource);
+			texture.resource->Release();
+			texture.resource = nullptr;
+			MutexGuard guard(d3d->resource_mutex);
+			freeMemory(texture.allocation);
+			texture.allocation = {};
+			d3d->srv_heap.free(texture.heap_id);
+			texture.heap_id = INVALID_HEAP_ID;
+			return false;
+		}
+
+		// each mip is generated from the previous one kept in cached memory, reading back upload memory would be slow
+		// mips alternate between the two halves of `scratch`
+		const u32 mip_depth = is_3d ? depth : 1;
+		const u32 mip1_size = maximum(w >> 1, 1) * maximum(h >> 1, 1) * maximum(mip_depth >> 1, 1) * bytes_per_pixel;
+		const u32 mip2_size = maximum(w >> 2, 1) * maximum(h >> 2, 1) * maximum(mip_depth >> 2, 1) * bytes_per_pixel;
+		Array<u8> scratch(d3d->allocator);
+		if (mip_count > 1) scratch.resize(mip1_size + mip2_size);
+
+		const u8* ptr = (const u8*)data;
+		for (u32 slice = 0; slice < slices; ++slice) {
+			const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& footprint = footprints[slice * mip_count];
+			const u32 row_size = w * bytes_per_pixel;
+			const u32 row_count = h * mip_depth;
+			for (u32 row = 0; row < row_count; ++row) {
+				memcpy(staging_ptr + footprint.Offset + row * footprint.Footprint.RowPitch, ptr + row * row_size, row_size);
+			}
+
+			MipLevel src = {ptr, w, h, row_size, mip_depth};
 			for (u32 mip = 1; mip < mip_count; ++mip) {
-				Array<u8>& mip_data = mips_data.emplace(d3d->allocator);
-				const u32 mip_w = maximum(w >> mip, 1);
-				const u32 mip_h = maximum(h >> mip, 1);
-				mip_data.resize(bytes_per_pixel * mip_w * mip_h);
-				switch (format) {
-					case TextureFormat::R8: stbir_resize_uint8(prev_mip_data, prev_mip_w, prev_mip_h, 0, mip_data.begin(), maximum(1, prev_mip_w >> 1), maximum(1, prev_mip_h >> 1), 0, 1); break;
-					case TextureFormat::SRGBA:
-					case TextureFormat::RGBA8: stbir_resize_uint8(prev_mip_data, prev_mip_w, prev_mip_h, 0, mip_data.begin(), maximum(1, prev_mip_w >> 1), maximum(1, prev_mip_h >> 1), 0, 4); break;
-					case TextureFormat::SRGB: stbir_resize_uint8(prev_mip_data, prev_mip_w, prev_mip_h, 0, mip_data.begin(), maximum(1, prev_mip_w >> 1), maximum(1, prev_mip_h >> 1), 0, 3); break;
-					case TextureFormat::R32F:
-						stbir_resize_float((const float*)prev_mip_data, prev_mip_w, prev_mip_h, 0, (float*)mip_data.begin(), maximum(1, prev_mip_w >> 1), maximum(1, prev_mip_h >> 1), 0, 1);
-						break;
-					case TextureFormat::RGBA32F:
-						stbir_resize_float((const float*)prev_mip_data, prev_mip_w, prev_mip_h, 0, (float*)mip_data.begin(), maximum(1, prev_mip_w >> 1), maximum(1, prev_mip_h >> 1), 0, 4);
-						break;
-					default: ASSERT(false); return false;
-				}
-				prev_mip_w = mip_w;
-				prev_mip_h = mip_h;
-				prev_mip_data = mip_data.begin();
-				srd[idx].pData = mip_data.begin();
-				srd[idx].RowPitch = mip_w * bytes_per_pixel;
-				srd[idx].SlicePitch = mip_h * srd[idx].SlicePitch;
-				++idx;
+				const D3D12_PLACED_SUBRESOURCE_FOOTPRINT& mip_footprint = footprints[slice * mip_count + mip];
+				u8* mip_data = scratch.begin() + (mip & 1 ? 0 : mip1_size);
+				const u32 mip_pitch = maximum(src.w >> 1, 1) * bytes_per_pixel;
+				generateMip(format, MipFilter::BOX, src, mip_data, mip_pitch, staging_ptr + mip_footprint.Offset, mip_footprint.Footprint.RowPitch, d3d->allocator);
+				src = {mip_data, maximum(src.w >> 1, 1), maximum(src.h >> 1, 1), mip_pitch, maximum(src.depth >> 1, 1)};
 			}
+			ptr += row_count * row_size;
 		}
+		staging->Unmap(0, nullptr);
+
+		MutexGuard guard(d3d->copy_queue.mutex);
+		ID3D12GraphicsCommandList* cmd_list = d3d->copy_queue.getCmdList();
+		for (u32 i = 0; i < subresource_count; ++i) {
+			const CD3DX12_TEXTURE_COPY_LOCATION dst_loc(texture.resource, i);
+			const CD3DX12_TEXTURE_COPY_LOCATION src_loc(staging, footprints[i]);
+			cmd_list->CopyTextureRegion(&dst_loc, 0, 0, 0, &src_loc, nullptr);
+		}
+		texture.upload_fence = d3d->copy_queue.getFenceValue();
+		texture.upload_pending = true;
+		d3d->residency.pin(getResidency(texture));
+		d3d->copy_queue.to_release.push({staging, texture.upload_fence, staging_allocation});
+	}
+	return true;
+}
 
-		UINT64 upload_buffer_size;
-		d3d->device->GetCopyableFootprints(&desc, 0, idx, 0, NULL, NULL, NULL, &upload_buffer_size);
+bool createTexture(TextureHandle handle, u32 w, u32 h, u32 depth, TextureFormat format, u32 flags, const void* data, const char* debug_name) {
+	return initTexture(handle, w, h, depth, format, flags, data, debug_name, nullptr, 0);
+}
+
+static void releaseTransientTextures() {
+	TransientPool& pool = d3d->transient_pool;
+	for (const TransientPool::Entry& entry : pool.entries) destroy(entry.texture);
+	pool.entries.clear();
+	if (pool.heap) {
+		// after the textures placed in it
+		MutexGuard guard(d3d->resource_mutex);
+		d3d->frame->to_release.push(pool.heap);
+	}
+	pool.heap = nullptr;
+	pool.heap_size = 0;
+}
+
+bool createTransientTextures(const TransientTextureDesc* descs, u32 count, TextureHandle* handles) {
+	checkThread();
+	TransientPool& pool = d3d->transient_pool;
+	ASSERT(!pool.created);
+	pool.created = true;
+	for (u32 i = 0; i < count; ++i) handles[i] = INVALID_TEXTURE;
+
+	pool.layout.resize(count);
+	u64 requested_size = 0;
+	for (u32 i = 0; i < count; ++i) {
+		const TransientTextureDesc& td = descs[i];
+		ASSERT(td.flags & (u32)TextureFlags::RENDER_TARGET);
+		ASSERT(!(td.flags & (u32)TextureFlags::IS_3D));
+		const D3D12_RESOURCE_DESC desc = getTextureDesc(td.w, td.h, 1, td.format, td.flags);
+		const D3D12_RESOURCE_ALLOCATION_INFO info = d3d->device->GetResourceAllocationInfo(0, 1, &desc);
+		TransientResource& res = pool.layout[i];
+		res.size = info.SizeInBytes;
+		res.align = info.Alignment;
+		res.first_pass = td.first_pass;
+		res.last_pass = td.last_pass;
+		requested_size += info.SizeInBytes;
+	}
+	const u64 heap_size = placeTransientResources(pool.layout.begin(), count, d3d->allocator);
+
+	if (heap_size > pool.heap_size) {
+		// textures placed in the old heap can not be reused
+		releaseTransientTextures();
+		D3D12_HEAP_DESC heap_desc = {};
+		heap_desc.SizeInBytes = heap_size;
+		heap_desc.Properties.Type = D3D12_HEAP_TYPE_DEFAULT;
+		heap_desc.Properties.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+		heap_desc.Properties.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+		heap_desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+		heap_desc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+		if (d3d->device->CreateHeap(&heap_desc, IID_PPV_ARGS(&pool.heap)) != S_OK) {
+			logError("Failed to create heap for transient textures (", heap_size / 1024, " KB)");
+			pool.heap = nullptr;
+			return false;
+		}
+		pool.heap->SetName(L"transient_heap");
+		pool.heap_size = heap_size;
+		d3d->memory_tracker.add(pool.heap, ResourceCategory::RENDER_TARGET, heap_size, "transient_heap");
+	}
 
-		ID3D12Resource* staging = createBuffer(d3d->device, nullptr, upload_buffer_size, D3D12_HEAP_TYPE_UPLOAD);
-		D3D12_RESOURCE_STATES old_state = texture.setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
-		UpdateSubresources(d3d->cmd_list, texture.resource, staging, 0, 0, idx, srd);
-		texture.setState(d3d->cmd_list, old_state);
-		d3d->frame->to_release.push(staging);
+	for (u32 i = 0; i < count; ++i) {
+		const TransientTextureDesc& td = descs[i];
+		const u64 offset = pool.layout[i].offset;
+		TransientPool::Entry* entry = nullptr;
+		for (TransientPool::Entry& e : pool.entries) {
+			if (e.used || e.offset != offset || e.w != td.w || e.h != td.h || e.format != td.format || e.flags != td.flags) continue;
+			entry = &e;
+			break;
+		}
+		if (!entry) {
+			TextureHandle texture = allocTextureHandle();
+			if (!initTexture(texture, td.w, td.h, 1, td.format, td.flags, nullptr, td.debug_name, pool.heap, offset)) {
+				logError("Failed to create transient texture ", td.debug_name);
+				LUMIX_DELETE(d3d->allocator, texture);
+				return false;
+			}
+			entry = &pool.entries.emplace();
+			entry->texture = texture;
+			entry->w = td.w;
+			entry->h = td.h;
+			entry->format = td.format;
+			entry->flags = td.flags;
+			entry->offset = offset;
+		}
+		entry->used = true;
+		entry->idle_frames = 0;
+		entry->first_pass = td.first_pass;
+		handles[i] = entry->texture;
 	}
+
+	pool.stats.heap_size = pool.heap_size;
+	pool.stats.requested_size = requested_size;
+	pool.stats.texture_count = count;
+	pool.stats.cached_count = pool.entries.size();
 	return true;
 }
 
+void beginTransientPass(u32 pass) {
+	checkThread();
+	TransientPool& pool = d3d->transient_pool;
+	pool.barriers.clear();
+	for (const TransientPool::Entry& entry : pool.entries) {
+		if (!entry.used || entry.first_pass != pass) continue;
+		D3D12_RESOURCE_BARRIER& barrier = pool.barriers.emplace();
+		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+		barrier.Aliasing.pResourceBefore = nullptr;
+		barrier.Aliasing.pResourceAfter = entry.texture->resource;
+	}
+	if (pool.barriers.empty()) return;
+
+	// split transitions must not be open on memory which is aliased
+	for (const TransientPool::Entry& entry : pool.entries) {
+		entry.texture->endSplit(d3d->cmd_list);
+	}
+	for (const D3D12_RESOURCE_BARRIER& barrier : pool.barriers) queueBarrier(d3d->cmd_list, barrier);
+
+	// content of aliased memory is undefined, placed render targets must be discarded or cleared before first use
+	for (const TransientPool::Entry& entry : pool.entries) {
+		if (!entry.used || entry.first_pass != pass) continue;
+		Texture& t = *entry.texture;
+		t.setState(d3d->cmd_list, isDepthFormat(t.dxgi_format) ? D3D12_RESOURCE_STATE_DEPTH_WRITE : D3D12_RESOURCE_STATE_RENDER_TARGET);
+		flushBarriers();
+		d3d->cmd_list->DiscardResource(t.resource, nullptr);
+	}
+}
+
+// textures which were not used for some time are released, so the pool does not keep targets of old resolutions
+static void updateTransientPool() {
+	TransientPool& pool = d3d->transient_pool;
+	pool.created = false;
+	for (i32 i = pool.entries.size() - 1; i >= 0; --i) {
+		TransientPool::Entry& entry = pool.entries[i];
+		if (entry.used) {
+			entry.used = false;
+			continue;
+		}
+		if (++entry.idle_frames <= TRANSIENT_TEXTURE_MAX_IDLE_FRAMES) continue;
+		destroy(entry.texture);
+		pool.entries.swapAndPop(i);
+	}
+	pool.stats.cached_count = pool.entries.size();
+}
+
+TransientStats getTransientStats() {
+	return d3d->transient_pool.stats;
+}
+
+void setMaxRenderResolution(u32 w, u32 h) {
+	d3d->render_target_pool.max_w = w;
+	d3d->render_target_pool.max_h = h;
+}
+
+TextureHandle acquireRenderTarget(u32 w, u32 h, TextureFormat format, u32 flags, const char* debug_name) {
+	return d3d->render_target_pool.acquire(w, h, format, flags, debug_name);
+}
+
+void releaseRenderTarget(TextureHandle texture) {
+	d3d->render_target_pool.release(texture);
+}
+
+RenderTargetPoolStats getRenderTargetPoolStats() {
+	return d3d->render_target_pool.getStats();
+}
+
+void setDynamicResolution(bool enabled, float target_frame_ms, float min_scale, float max_scale) {
+	ASSERT(min_scale > 0 && min_scale <= max_scale && max_scale <= 1);
+	DynamicResolution& dr = d3d->dynamic_resolution;
+	dr.enabled = enabled;
+	dr.target_ms = target_frame_ms;
+	dr.min_scale = min_scale;
+	dr.max_scale = max_scale;
+}
+
+void updateDynamicResolution(float gpu_frame_ms) {
+	d3d->dynamic_resolution.update(gpu_frame_ms);
+}
+
+float getDynamicResolutionScale() {
+	return d3d->dynamic_resolution.scale;
+}
+
+DynamicResolutionView getDynamicResolutionView(TextureHandle target, u32 w, u32 h) {
+	return d3d->render_target_pool.getView(target, w, h, d3d->dynamic_resolution.scale);
+}
+
 void setState(u64 state) {
 	if (state != d3d->current_state) {
 		d3d->pso_cache.last = nullptr;
@@ -2242,6 +4835,8 @@ void viewport(u32 x, u32 y, u32 w, u32 h) {
 	scissor.right = x + w;
 	scissor.bottom = y + h;
 	d3d->cmd_list->RSSetScissorRects(1, &scissor);
+	d3d->current_viewport = vp;
+	d3d->current_scissor = scissor;
 }
 
 void useProgram(ProgramHandle handle) {
@@ -2258,13 +4853,63 @@ void scissor(u32 x, u32 y, u32 w, u32 h) {
 	rect.right = x + w;
 	rect.bottom = y + h;
 	d3d->cmd_list->RSSetScissorRects(1, &rect);
+	d3d->current_scissor = rect;
+}
+
+static void bindRootArguments(bool compute) {
+	ASSERT(d3d->current_program);
+	// resources updated since the last draw or dispatch
+	flushUpdates();
+	Program& p = *d3d->current_program;
+	ID3D12GraphicsCommandList* cmd_list = d3d->cmd_list;
+	D3D::RootState& root = compute ? d3d->compute_root : d3d->graphics_root;
+	if (root.signature != p.root_signature) {
+		root.signature = p.root_signature;
+		if (compute) cmd_list->SetComputeRootSignature(p.root_signature);
+		else cmd_list->SetGraphicsRootSignature(p.root_signature);
+		root.dirty_cbvs = 0xffFFffFF;
+		root.dirty_samplers = true;
+		root.dirty_draw_constants = true;
+	}
+
+	if (p.draw_constants_param != INVALID_ROOT_PARAM && root.dirty_draw_constants) {
+		if (compute) cmd_list->SetComputeRoot32BitConstants(p.draw_constants_param, p.draw_constants_count, d3d->draw_constants, 0);
+		else cmd_list->SetGraphicsRoot32BitConstants(p.draw_constants_param, p.draw_constants_count, d3d->draw_constants, 0);
+		root.dirty_draw_constants = false;
+	}
+
+	for (u32 i = 0; i < MAX_CBVS; ++i) {
+		if (p.cbv_params[i] == INVALID_ROOT_PARAM || (root.dirty_cbvs & (1 << i)) == 0) continue;
+		if (compute) cmd_list->SetComputeRootConstantBufferView(p.cbv_params[i], d3d->current_cbvs[i]);
+		else cmd_list->SetGraphicsRootConstantBufferView(p.cbv_params[i], d3d->current_cbvs[i]);
+	}
+	root.dirty_cbvs = 0;
+
+	if (p.sampler_param != INVALID_ROOT_PARAM && root.dirty_samplers) {
+		const D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, p.srv_count);
+		if (compute) cmd_list->SetComputeRootDescriptorTable(p.sampler_param, samplers);
+		else cmd_list->SetGraphicsRootDescriptorTable(p.sampler_param, samplers);
+		root.dirty_samplers = false;
+	}
+
+	if (p.srv_param != INVALID_ROOT_PARAM || p.uav_param != INVALID_ROOT_PARAM) {
+		const D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(p, d3d->srv_heap, d3d->current_srvs, p.srv_count);
+		if (compute) {
+			if (p.srv_param != INVALID_ROOT_PARAM) cmd_list->SetComputeRootDescriptorTable(p.srv_param, srv);
+			if (p.uav_param != INVALID_ROOT_PARAM) cmd_list->SetComputeRootDescriptorTable(p.uav_param, srv);
+		}
+		else {
+			if (p.srv_param != INVALID_ROOT_PARAM) cmd_list->SetGraphicsRootDescriptorTable(p.srv_param, srv);
+			if (p.uav_param != INVALID_ROOT_PARAM) cmd_list->SetGraphicsRootDescriptorTable(p.uav_param, srv);
+		}
+	}
 }
 
 void drawTrianglesInstancedInternal(u32 offset, u32 indices_count, u32 instances_count, DataType index_type) {
 	ASSERT(d3d->current_program);
 	D3D12_PRIMITIVE_TOPOLOGY pt = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	D3D12_PRIMITIVE_TOPOLOGY_TYPE ptt = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	d3d->pso_cache.set(d3d->device, d3d->cmd_list, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->root_signature, ptt);
+	d3d->pso_cache.set(d3d->device, d3d->cmd_list, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->current_program->root_signature, ptt);
 
 	DXGI_FORMAT dxgi_index_type;
 	u32 offset_shift = 0;
@@ -2280,23 +4925,16 @@ void drawTrianglesInstancedInternal(u32 offset, u32 indices_count, u32 instances
 	}
 
 	ASSERT(d3d->current_index_buffer);
-	ID3D12Resource* b = d3d->current_index_buffer->resource;
 	D3D12_INDEX_BUFFER_VIEW ibv = {};
-	ibv.BufferLocation = b->GetGPUVirtualAddress() + offset;
+	ibv.BufferLocation = d3d->current_index_buffer->getGPUAddress() + offset;
 	ibv.Format = dxgi_index_type;
 	ibv.SizeInBytes = indices_count * (1 << offset_shift);
 	d3d->cmd_list->IASetIndexBuffer(&ibv);
 	d3d->cmd_list->IASetPrimitiveTopology(pt);
 
-	if (d3d->dirty_samplers) {
-		D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-		d3d->cmd_list->SetGraphicsRootDescriptorTable(5, samplers);
-		d3d->dirty_samplers = false;
-	}
-	
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(6, srv);
+	bindRootArguments(false);
 
+	flushBarriers();
 	d3d->cmd_list->DrawIndexedInstanced(indices_count, instances_count, 0, 0, 0);
 }
 
@@ -2328,18 +4966,12 @@ void drawArrays(u32 offset, u32 count, PrimitiveType type) {
 		default: ASSERT(0); break;
 	}
 
-	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->root_signature, ptt));
+	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->current_program->root_signature, ptt));
 	d3d->cmd_list->IASetPrimitiveTopology(pt);
 
-	if (d3d->dirty_samplers) {
-		D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-		d3d->cmd_list->SetGraphicsRootDescriptorTable(5, samplers);
-		d3d->dirty_samplers = false;
-	}
-
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(6, srv);
+	bindRootArguments(false);
 
+	flushBarriers();
 	d3d->cmd_list->DrawInstanced(count, 1, offset, 0);
 }
 
@@ -2368,64 +5000,108 @@ TextureInfo getTextureInfo(const void* data) {
 }
 
 void destroy(BufferHandle buffer) {
-	checkThread();
 	ASSERT(buffer);
+	if (d3d->thread != GetCurrentThreadId()) {
+		// buffer_updates and buffer promotion are not locked, they are used only on the render thread
+		MutexGuard guard(d3d->resource_mutex);
+		d3d->deferred_buffer_destroys.push(buffer);
+		return;
+	}
 	Buffer& t = *buffer;
-	if (t.resource) d3d->frame->to_release.push(t.resource);
-	if (t.heap_id != INVALID_HEAP_ID) d3d->frame->to_heap_release.push(t.heap_id);
+	// buffer_updates point to the buffer
+	resolveUpdates(t);
+	if (t.upload_pending) {
+		MutexGuard guard(d3d->copy_queue.mutex);
+		d3d->copy_queue.wait(t.upload_fence);
+		d3d->residency.unpin(getResidency(t));
+	}
+	MutexGuard guard(d3d->resource_mutex);
+	if (t.upload_resource) demote(t);
+	d3d->residency.remove(t.residency);
+	unregisterMappable(t);
+	if (t.mega_range.mega) {
+		d3d->frame->to_free_ranges.push(t.mega_range);
+	}
+	else if (t.resource) {
+		if (t.persistent_ptr) t.resource->Unmap(0, nullptr);
+		d3d->frame->to_release.push(t.resource);
+		d3d->frame->to_free_memory.push(t.allocation);
+	}
+	if (t.copy_count > 1) {
+		for (u32 i = 0; i < t.copy_count; ++i) d3d->frame->to_heap_release.push(t.copy_heap_ids[i]);
+	}
+	else if (t.heap_id != INVALID_HEAP_ID) d3d->frame->to_heap_release.push(t.heap_id);
 
 	LUMIX_DELETE(d3d->allocator, buffer);
 }
 
 void bindShaderBuffer(BufferHandle buffer, u32 binding_point, u32 flags) {
 	ASSERT(binding_point < 10);
+	if (buffer) resolveUpload(*buffer);
 	d3d->current_srvs[binding_point].texture = INVALID_TEXTURE;
 	d3d->current_srvs[binding_point].buffer = buffer;
 }
 
 void bindUniformBuffer(u32 index, BufferHandle buffer, size_t offset, size_t size) {
+	ASSERT(index < MAX_CBVS);
+	D3D12_GPU_VIRTUAL_ADDRESS address = {};
 	if (buffer) {
-		ID3D12Resource* b = buffer->resource;
-		ASSERT(b);
-		d3d->cmd_list->SetGraphicsRootConstantBufferView(index, b->GetGPUVirtualAddress() + offset);
-		d3d->cmd_list->SetComputeRootConstantBufferView(index, b->GetGPUVirtualAddress() + offset);
-	} else {
-		D3D12_GPU_VIRTUAL_ADDRESS dummy = {};
-		d3d->cmd_list->SetGraphicsRootConstantBufferView(index, dummy);
-		d3d->cmd_list->SetComputeRootConstantBufferView(index, dummy);
+		ASSERT(buffer->resource);
+		resolveUpload(*buffer);
+		markUsed(*buffer);
+		address = buffer->getGPUAddress() + offset;
 	}
+	if (d3d->current_cbvs[index] == address) return;
+	d3d->current_cbvs[index] = address;
+	d3d->graphics_root.dirty_cbvs |= 1 << index;
+	d3d->compute_root.dirty_cbvs |= 1 << index;
+}
+
+void setDrawConstants(const void* data, u32 size) {
+	ASSERT(size <= sizeof(d3d->draw_constants));
+	memcpy(d3d->draw_constants, data, size);
+	d3d->graphics_root.dirty_draw_constants = true;
+	d3d->compute_root.dirty_draw_constants = true;
+}
+
+void setDynamicResolutionConstants(const DynamicResolutionView& view) {
+	const float values[] = { view.uv_scale[0], view.uv_scale[1], view.uv_max[0], view.uv_max[1] };
+	memcpy((u8*)d3d->draw_constants + DYNAMIC_RESOLUTION_CONSTANTS_OFFSET, values, sizeof(values));
+	d3d->graphics_root.dirty_draw_constants = true;
+	d3d->compute_root.dirty_draw_constants = true;
 }
 
 void bindIndirectBuffer(BufferHandle handle) {
 	d3d->current_indirect_buffer = handle;
-	if (handle) handle->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+	if (handle) {
+		resolveUpload(*handle);
+		markUsed(*handle);
+		handle->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+	}
 }
 
 void bindIndexBuffer(BufferHandle handle) {
+	if (handle) {
+		resolveUpload(*handle);
+		markUsed(*handle);
+	}
 	d3d->current_index_buffer = handle;
 }
 
 void dispatch(u32 num_groups_x, u32 num_groups_y, u32 num_groups_z) {
 	ASSERT(d3d->current_program);
-	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineStateCompute(d3d->device, d3d->root_signature, d3d->current_program));
-	
-	if (d3d->dirty_samplers) {
-		D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-		d3d->cmd_list->SetComputeRootDescriptorTable(5, samplers);
-		d3d->dirty_samplers = false;
-	}
-
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-
-	d3d->cmd_list->SetComputeRootDescriptorTable(6, srv);
-	d3d->cmd_list->SetComputeRootDescriptorTable(7, srv);
+	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineStateCompute(d3d->device, d3d->current_program->root_signature, d3d->current_program));
+	bindRootArguments(true);
+	flushBarriers();
 	d3d->cmd_list->Dispatch(num_groups_x, num_groups_y, num_groups_z);
 }
 
 void bindVertexBuffer(u32 binding_idx, BufferHandle buffer, u32 buffer_offset, u32 stride_in_bytes) {
 	if (buffer) {
+		resolveUpload(*buffer);
+		markUsed(*buffer);
 		D3D12_VERTEX_BUFFER_VIEW vbv;
-		vbv.BufferLocation = buffer->resource->GetGPUVirtualAddress() + buffer_offset;
+		vbv.BufferLocation = buffer->getGPUAddress() + buffer_offset;
 		vbv.StrideInBytes = stride_in_bytes;
 		vbv.SizeInBytes = UINT(buffer->size - buffer_offset);
 		d3d->cmd_list->IASetVertexBuffers(binding_idx, 1, &vbv);
@@ -2442,9 +5118,11 @@ void bindImageTexture(TextureHandle handle, u32 unit) {
 	d3d->current_srvs[unit].buffer = INVALID_BUFFER;
 	d3d->current_srvs[unit].texture = handle;
 	if (handle) {
+		resolveUpload(*handle);
 		if (d3d->current_sampler_flags[unit] != handle->flags) {
 			d3d->current_sampler_flags[unit] = handle->flags;
-			d3d->dirty_samplers = true;
+			d3d->graphics_root.dirty_samplers = true;
+			d3d->compute_root.dirty_samplers = true;
 		}
 		handle->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 	}
@@ -2455,9 +5133,11 @@ void bindTextures(const TextureHandle* handles, u32 offset, u32 count) {
 		d3d->current_srvs[i + offset].buffer = INVALID_BUFFER;
 		d3d->current_srvs[i + offset].texture = handles[i];
 		if (handles[i]) {
+			resolveUpload(*handles[i]);
 			if (d3d->current_sampler_flags[i + offset] != handles[i]->flags) {
 				d3d->current_sampler_flags[i + offset] = handles[i]->flags;
-				d3d->dirty_samplers = true;
+				d3d->graphics_root.dirty_samplers = true;
+				d3d->compute_root.dirty_samplers = true;
 			}
 		}
 	}
@@ -2467,7 +5147,7 @@ void drawIndirect(DataType index_type) {
 	ASSERT(d3d->current_program);
 	D3D12_PRIMITIVE_TOPOLOGY pt = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	D3D12_PRIMITIVE_TOPOLOGY_TYPE ptt = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->root_signature, ptt));
+	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->current_program->root_signature, ptt));
 
 	DXGI_FORMAT dxgi_index_type;
 	u32 offset_shift = 0;
@@ -2483,22 +5163,14 @@ void drawIndirect(DataType index_type) {
 	}
 
 	ASSERT(d3d->current_index_buffer);
-	ID3D12Resource* b = d3d->current_index_buffer->resource;
 	D3D12_INDEX_BUFFER_VIEW ibv = {};
-	ibv.BufferLocation = b->GetGPUVirtualAddress();
+	ibv.BufferLocation = d3d->current_index_buffer->getGPUAddress();
 	ibv.Format = dxgi_index_type;
 	ibv.SizeInBytes = d3d->current_index_buffer->size;
 	d3d->cmd_list->IASetIndexBuffer(&ibv);
 	d3d->cmd_list->IASetPrimitiveTopology(pt);
 
-	if (d3d->dirty_samplers) {
-		D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-		d3d->cmd_list->SetGraphicsRootDescriptorTable(5, samplers);
-		d3d->dirty_samplers = false;
-	}
-	
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(6, srv);
+	bindRootArguments(false);
 
 	static ID3D12CommandSignature* signature = [&]() {
 		D3D12_INDIRECT_ARGUMENT_DESC arg_desc = {};
@@ -2514,25 +5186,20 @@ void drawIndirect(DataType index_type) {
 		return signature;
 	}();
 
-	d3d->cmd_list->ExecuteIndirect(signature, 1, d3d->current_indirect_buffer->resource, 0, nullptr, 0);
+	flushBarriers();
+	d3d->cmd_list->ExecuteIndirect(signature, 1, d3d->current_indirect_buffer->resource, d3d->current_indirect_buffer->offset, nullptr, 0);
 }
 
 void drawTriangleStripArraysInstanced(u32 indices_count, u32 instances_count) {
 	ASSERT(d3d->current_program);
 	D3D12_PRIMITIVE_TOPOLOGY pt = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP;
 	D3D12_PRIMITIVE_TOPOLOGY_TYPE ptt = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->root_signature, ptt));
+	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->current_program->root_signature, ptt));
 	d3d->cmd_list->IASetPrimitiveTopology(pt);
 
-	if (d3d->dirty_samplers) {
-		D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-		d3d->cmd_list->SetGraphicsRootDescriptorTable(5, samplers);
-		d3d->dirty_samplers = false;
-	}
-	
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(6, srv);
+	bindRootArguments(false);
 
+	flushBarriers();
 	d3d->cmd_list->DrawInstanced(indices_count, instances_count, 0, 0);
 }
 
@@ -2563,7 +5230,7 @@ void drawElements(u32 offset_bytes, u32 count, PrimitiveType primitive_type, Dat
 		default: ASSERT(0); break;
 	}
 
-	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->root_signature, ptt));
+	d3d->cmd_list->SetPipelineState(d3d->pso_cache.getPipelineState(d3d->device, d3d->current_state, d3d->current_program, d3d->current_framebuffer, d3d->current_program->root_signature, ptt));
 
 	DXGI_FORMAT dxgi_index_type;
 	u32 offset_shift = 0;
@@ -2580,20 +5247,16 @@ void drawElements(u32 offset_bytes, u32 count, PrimitiveType primitive_type, Dat
 
 	ASSERT((offset_bytes & (offset_shift - 1)) == 0);
 	ASSERT(d3d->current_index_buffer);
-	ID3D12Resource* b = d3d->current_index_buffer->resource;
 	D3D12_INDEX_BUFFER_VIEW ibv = {};
-	ibv.BufferLocation = b->GetGPUVirtualAddress() + offset_bytes;
+	ibv.BufferLocation = d3d->current_index_buffer->getGPUAddress() + offset_bytes;
 	ibv.Format = dxgi_index_type;
 	ibv.SizeInBytes = count * (1 << offset_shift);
 	d3d->cmd_list->IASetIndexBuffer(&ibv);
 	d3d->cmd_list->IASetPrimitiveTopology(pt);
 
-	D3D12_GPU_DESCRIPTOR_HANDLE samplers = allocSamplers(d3d->sampler_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-	D3D12_GPU_DESCRIPTOR_HANDLE srv = allocSRV(*d3d->current_program, d3d->srv_heap, d3d->current_srvs, lengthOf(d3d->current_srvs));
-
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(5, samplers);
-	d3d->cmd_list->SetGraphicsRootDescriptorTable(6, srv);
+	bindRootArguments(false);
 
+	flushBarriers();
 	d3d->cmd_list->DrawIndexedInstanced(count, 1, 0, 0, 0);
 }
 
@@ -2602,24 +5265,147 @@ void copy(BufferHandle dst, BufferHandle src, u32 dst_offset, u32 size) {
 	ASSERT(dst);
 	ASSERT(!dst->mapped_ptr);
 	ASSERT(!src->mapped_ptr);
-	D3D12_RESOURCE_STATES state = dst->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
-	d3d->cmd_list->CopyBufferRegion(dst->resource, dst_offset, src->resource, 0, size);
-	dst->setState(d3d->cmd_list, state);
+	resolveUpload(*dst);
+	resolveUpload(*src);
+	resolveUpdates(*dst);
+	resolveUpdates(*src);
+	markUsed(*dst);
+	markUsed(*src);
+	ID3D12GraphicsCommandList* cmd_list = d3d->cmd_list;
+	if (dst->resource == src->resource) {
+		// views into one mega buffer, the resource can not be a copy source and destination at the same time
+		D3D12_RESOURCE_DESC desc = src->resource->GetDesc();
+		desc.Width = size;
+		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+		ID3D12Resource* tmp;
+		GPUAllocation tmp_allocation;
+		if (createResource(D3D12_HEAP_TYPE_DEFAULT, desc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, Ref(tmp_allocation), &tmp) != S_OK) {
+			logError("gpu: failed to create a temporary buffer for a copy");
+			return;
+		}
+		const D3D12_RESOURCE_STATES state = src->setState(cmd_list, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		flushBarriers();
+		cmd_list->CopyBufferRegion(tmp, 0, src->resource, src->offset, size);
+		switchState(cmd_list, tmp, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		dst->setState(cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
+		flushBarriers();
+		cmd_list->CopyBufferRegion(dst->resource, dst->offset + dst_offset, tmp, 0, size);
+		dst->setState(cmd_list, state);
+
+		MutexGuard guard(d3d->resource_mutex);
+		d3d->frame->to_release.push(tmp);
+		d3d->frame->to_free_memory.push(tmp_allocation);
+		return;
+	}
+
+	const D3D12_RESOURCE_STATES dst_state = dst->setState(cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
+	// GENERIC_READ includes COPY_SOURCE
+	const D3D12_RESOURCE_STATES src_state = src->mega_range.mega ? src->mega_range.mega->state : src->state;
+	const bool transition_src = !(src_state & D3D12_RESOURCE_STATE_COPY_SOURCE);
+	if (transition_src) src->setState(cmd_list, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	flushBarriers();
+	cmd_list->CopyBufferRegion(dst->resource, dst->offset + dst_offset, src->resource, src->offset, size);
+	dst->setState(cmd_list, dst_state);
+	if (transition_src) src->setState(cmd_list, src_state);
 }
 
-void update(BufferHandle buffer, const void* data, size_t size) {
+void update(BufferHandle buffer, u32 offset, const void* data, size_t size) {
 	checkThread();
 	ASSERT(buffer);
+	ASSERT(offset + size <= buffer->size);
+	if (size == 0) return;
+	if (buffer->persistent_ptr) {
+		// upload heap can not be a copy destination and frames in flight might still read it,
+		// so only rotating buffers can be updated, written data is visible to the whole frame
+		ASSERT(buffer->copy_count > 1);
+		ASSERT(!buffer->mapped_ptr);
+		const u32 prev_offset = buffer->offset;
+		u8* dst = buffer->persistent_ptr;
+		if (rotate(*buffer) && size < buffer->size) {
+			// the rest is preserved, it is read from write-combined memory, so full updates are faster
+			const u8* prev = dst + prev_offset;
+			const u32 end = offset + u32(size);
+			memcpy(dst + buffer->offset, prev, offset);
+			memcpy(dst + buffer->offset + end, prev + end, buffer->size - end);
+		}
+		memcpy(dst + buffer->offset + offset, data, size);
+		markWritten(*buffer, offset, u32(offset + size));
+		return;
+	}
+	resolveUpload(*buffer);
+	markUsed(*buffer);
 
-	u8* dst = d3d->frame->scratch_buffer_ptr;
-	ASSERT(size + dst <= d3d->frame->scratch_buffer_begin + SCRATCH_BUFFER_SIZE);
+	Buffer* src;
+	u32 src_offset;
+	u8* dst = allocScratch((u32)size, 4, Ref(src), Ref(src_offset));
 	memcpy(dst, data, size);
-	UINT64 src_offset = dst - d3d->frame->scratch_buffer_begin;
-	D3D12_RESOURCE_STATES state = buffer->setState(d3d->cmd_list, D3D12_RESOURCE_STATE_COPY_DEST);
-	d3d->cmd_list->CopyBufferRegion(buffer->resource, 0, d3d->frame->scratch_buffer, src_offset, size);
-	buffer->setState(d3d->cmd_list, state);
 
-	d3d->frame->scratch_buffer_ptr += size;
+	const u32 dst_offset = buffer->offset + offset;
+	if (buffer->pending_updates) {
+		// the last update of the buffer, merge if both source and destination ranges continue it
+		for (i32 i = d3d->buffer_updates.size() - 1; i >= 0; --i) {
+			BufferUpdate& u = d3d->buffer_updates[i];
+			if (u.buffer != buffer) continue;
+			if (u.src == src->resource && u.src_offset + u.size == src_offset && u.dst_offset + u.size == dst_offset) {
+				u.size += (u32)size;
+				return;
+			}
+			break;
+		}
+	}
+
+	// copied in a batch with other updates when the buffer is used or at the end of the frame
+	BufferUpdate& u = d3d->buffer_updates.emplace();
+	u.buffer = buffer;
+	u.dst_offset = dst_offset;
+	u.src = src->resource;
+	u.src_offset = src_offset;
+	u.size = (u32)size;
+	buffer->pending_updates = true;
+}
+
+void update(BufferHandle buffer, const void* data, size_t size) {
+	update(buffer, 0, data, size);
+}
+
+TransientSlice allocTransientUniform(u32 size) {
+	checkThread();
+	TransientSlice slice;
+	slice.ptr = allocScratch(size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, Ref(slice.buffer), Ref(slice.offset));
+	slice.size = size;
+	return slice;
+}
+
+ScratchStats getScratchStats() {
+	return d3d->scratch_stats;
+}
+
+bool isUploadComplete(BufferHandle buffer) {
+	return d3d->copy_queue.isComplete(buffer->upload_fence);
+}
+
+bool isUploadComplete(TextureHandle texture) {
+	return d3d->copy_queue.isComplete(texture->upload_fence);
+}
+
+HeapStats getHeapStats() {
+	HeapStats stats = {};
+	u64 largest_free_sum = 0;
+	MutexGuard guard(d3d->resource_mutex);
+	for (MemoryBlock* block : d3d->memory_blocks) {
+		const TLSF::Stats s = block->tlsf.getStats();
+		stats.reserved += s.size;
+		stats.used += s.used;
+		stats.placed_count += s.allocation_count;
+		stats.largest_free_block = maximum(stats.largest_free_block, s.largest_free_block);
+		largest_free_sum += s.largest_free_block;
+	}
+	stats.block_count = d3d->memory_blocks.size();
+	stats.committed = d3d->committed_size;
+	stats.committed_count = d3d->committed_count;
+	const u64 free = stats.reserved - stats.used;
+	stats.fragmentation = free > 0 ? 1.f - float(double(largest_free_sum) / double(free)) : 0.f;
+	return stats;
 }
 
 bool createProgram(ProgramHandle program
@@ -2636,7 +5422,8 @@ bool createProgram(ProgramHandle program
 		program->name = name;
 	#endif
 	ShaderCompiler::Input args { decl, Span(srcs, num), Span(types, num), Span(prefixes, prefixes_count) };
-	return d3d->shader_compiler.compile(decl, args, name, Ref(*program));
+	if (!d3d->shader_compiler.compile(decl, args, name, Ref(*program))) return false;
+	return createRootSignature(*program);
 }
 
 } // namespace gpu
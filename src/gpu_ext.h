@@ -0,0 +1,210 @@
+#pragma once
+
+#include "renderer/gpu/gpu.h"
+
+namespace Lumix::gpu {
+
+// shaders access draw constants through `layout(binding = 5, std140) uniform ...`
+static constexpr u32 DRAW_CONSTANTS_BINDING = 5;
+static constexpr u32 MAX_DRAW_CONSTANTS_SIZE = 64;
+// programs sampling pooled render targets end their draw constants with `vec4 u_dynamic_resolution`,
+// xy = uv_scale, zw = uv_max of DynamicResolutionView, see setDynamicResolutionConstants
+static constexpr u32 DYNAMIC_RESOLUTION_CONSTANTS_OFFSET = MAX_DRAW_CONSTANTS_SIZE - 16;
+
+// valid until the end of the frame, write `ptr` before the slice is used by a draw call
+struct TransientSlice {
+	BufferHandle buffer;
+	u32 offset;
+	u32 size;
+	u8* ptr;
+};
+
+// DDS parsed and written to staging memory, see prepareTexture
+struct PreparedTexture;
+
+struct ScratchStats {
+	u64 frame_usage; // bytes allocated by the last finished frame
+	u64 peak_usage;
+	u64 reserved;
+	u32 page_count;
+};
+
+// memory of resources placed in shared heaps and of standalone committed resources
+struct HeapStats {
+	u64 reserved;
+	u64 used;
+	u64 largest_free_block;
+	u64 committed;
+	u32 block_count;
+	u32 placed_count;
+	u32 committed_count;
+	float fragmentation; // 0 if free memory is contiguous in each block, close to 1 if it's scattered
+};
+
+enum class ResourceCategory : u8 {
+	STATIC_BUFFER,
+	DYNAMIC_BUFFER,
+	TEXTURE,
+	RENDER_TARGET,
+	UPLOAD,
+	DESCRIPTOR_HEAP,
+	PIPELINE,
+	READBACK,
+
+	COUNT
+};
+
+// refreshed once per frame in swapBuffers
+struct ResourceMemoryStats {
+	u64 size[(u32)ResourceCategory::COUNT];
+	u32 count[(u32)ResourceCategory::COUNT];
+	// reported by DXGI for this process, 0 if unavailable
+	u64 budget;
+	u64 usage;
+	u64 non_local_budget;
+	u64 non_local_usage;
+};
+
+// objects evicted from video memory under budget pressure, least recently used first
+struct ResidencyStats {
+	u64 resident_size;
+	u64 evicted_size;
+	u32 resident_count;
+	u32 evicted_count;
+	u32 evictions; // since init
+	u32 made_resident; // evicted objects which were used again, since init
+};
+
+// MAPPABLE buffers which the GPU reads much more often than the CPU writes them get a copy in video memory
+struct BufferPromotionStats {
+	u64 promoted_size;
+	u32 promoted_count;
+	u32 promotions; // since init
+	u32 demotions; // since init
+};
+
+// resource barriers of the last finished frame
+struct BarrierStats {
+	u32 requested; // transitions and other barriers requested by the backend
+	u32 recorded; // barriers left after redundant transitions were merged or cancelled
+	u32 batches; // ResourceBarrier calls
+	u32 split; // transitions split into begin and end, so the GPU can overlap them with other commands
+};
+
+// render target which is used only by passes first_pass..last_pass (inclusive) of a frame, see createTransientTextures
+struct TransientTextureDesc {
+	u32 w;
+	u32 h;
+	TextureFormat format;
+	u32 flags; // must contain TextureFlags::RENDER_TARGET
+	u32 first_pass;
+	u32 last_pass;
+	const char* debug_name;
+};
+
+struct TransientStats {
+	u64 heap_size; // memory shared by transient textures
+	u64 requested_size; // memory they would need without aliasing
+	u32 texture_count; // in the last frame
+	u32 cached_count; // kept for reuse in next frames
+};
+
+struct RenderTargetPoolStats {
+	u32 texture_count;
+	u32 in_use_count;
+	u32 allocations; // since init, does not grow when resolution changes within max render resolution
+};
+
+// part of a pooled render target rendered at the current dynamic resolution scale,
+// set `viewport(0, 0, w, h)` when rendering to it, UVs sampling it are multiplied by `uv_scale` and clamped to `uv_max`
+struct DynamicResolutionView {
+	u32 w;
+	u32 h;
+	float uv_scale[2]; // rendered size / allocated size
+	float uv_max[2]; // (rendered size - half texel) / allocated size, bilinear filtering does not read texels which were not rendered
+	float scale; // rendered size / full resolution size
+};
+
+// data copied from GPU memory at the end of the frame which issued the readback, see readTextureAsync
+struct ReadbackTicket {
+	u32 id; // 0 if invalid
+	u64 fence_value; // the data are available once the GPU passes this value
+};
+
+// readback memory returned by mapReadback, rows are `row_pitch` bytes apart
+struct ReadbackData {
+	const u8* data;
+	u32 row_size;
+	u32 row_pitch;
+	u32 row_count;
+};
+
+// called from swapBuffers when usage starts to exceed budget
+using MemoryBudgetCallback = void (*)(const ResourceMemoryStats& stats, void* user_ptr);
+
+void setDrawConstants(const void* data, u32 size);
+// writes `view` to the last 16 bytes of draw constants, they are kept by setDrawConstants with
+// size <= DYNAMIC_RESOLUTION_CONSTANTS_OFFSET
+void setDynamicResolutionConstants(const DynamicResolutionView& view);
+TransientSlice allocTransientUniform(u32 size);
+ScratchStats getScratchStats();
+// initial data of buffers and textures can be uploaded asynchronously, resources are usable before the upload is complete
+bool isUploadComplete(BufferHandle buffer);
+bool isUploadComplete(TextureHandle texture);
+HeapStats getHeapStats();
+// two-phase loadTexture - prepareTexture does the expensive CPU work and can run on any thread,
+// commitTexture only creates the texture and records copies, it consumes `prepared` even if it fails,
+// `data` must stay alive until `prepared` is committed or destroyed
+PreparedTexture* prepareTexture(const void* data, u64 size, u32 flags, const char* debug_name);
+bool commitTexture(TextureHandle handle, PreparedTexture* prepared, const char* debug_name);
+void destroy(PreparedTexture* prepared);
+ResourceMemoryStats getResourceMemoryStats();
+// name shown in memory reports and graphics debuggers, createBuffer does not take one
+void setDebugName(BufferHandle buffer, const char* debug_name);
+void setMemoryBudgetCallback(MemoryBudgetCallback callback, void* user_ptr);
+ResidencyStats getResidencyStats();
+// at most once per frame, textures whose pass intervals do not overlap share memory
+// handles are valid until swapBuffers, do not destroy them
+bool createTransientTextures(const TransientTextureDesc* descs, u32 count, TextureHandle* handles);
+// call before the first command of each pass, content of textures whose first pass is `pass` is undefined
+void beginTransientPass(u32 pass);
+TransientStats getTransientStats();
+// render targets from the pool are allocated at least at this size, so resizing within it does not reallocate
+void setMaxRenderResolution(u32 w, u32 h);
+// `w`x`h` is the full resolution size, content of the returned texture is undefined
+TextureHandle acquireRenderTarget(u32 w, u32 h, TextureFormat format, u32 flags, const char* debug_name);
+void releaseRenderTarget(TextureHandle texture);
+RenderTargetPoolStats getRenderTargetPoolStats();
+void setDynamicResolution(bool enabled, float target_frame_ms, float min_scale, float max_scale);
+// call once per frame with measured GPU time, scale adapts to hold target frame time
+void updateDynamicResolution(float gpu_frame_ms);
+float getDynamicResolutionScale();
+// `w`x`h` is the full resolution size `target` was acquired with
+DynamicResolutionView getDynamicResolutionView(TextureHandle target, u32 w, u32 h);
+// asynchronous readback of a region of one mip of one face, or of a part of a buffer, render thread only
+ReadbackTicket readTextureAsync(TextureHandle texture, u32 mip, u32 face, u32 x, u32 y, u32 w, u32 h);
+ReadbackTicket readBufferAsync(BufferHandle buffer, u32 offset, u32 size);
+bool isReadbackReady(ReadbackTicket ticket);
+// waits if the GPU is not done yet, each ticket must be consumed by unmapReadback or getReadbackData
+// can not wait for a readback issued in the current frame, it returns false and the ticket stays valid
+bool mapReadback(ReadbackTicket ticket, Ref<ReadbackData> data);
+void unmapReadback(ReadbackTicket ticket);
+// writes tightly packed rows to `out`, can be called from any thread, e.g. from a job, until the readback is unmapped
+void unpackReadback(const ReadbackData& data, Span<u8> out);
+// mapReadback, unpackReadback and unmapReadback on the calling thread
+bool getReadbackData(ReadbackTicket ticket, Span<u8> out);
+// MAPPABLE buffer with a copy for each frame in flight, the first map in a frame returns the next copy,
+// so CPU never overwrites data the GPU still reads, content is not preserved between copies
+void createRotatingBuffer(BufferHandle buffer, u32 flags, size_t size);
+// like unmap, only [written_offset, written_offset + written_size) was written
+void unmap(BufferHandle buffer, size_t written_offset, size_t written_size);
+// writes `size` bytes at `offset`, the rest of the buffer is preserved, the write is ordered with GPU work,
+// MAPPABLE buffers must be rotating, the written data is visible to the whole frame,
+// DX11 writes MAPPABLE buffers in place, so the range must not be read by draws which are not finished yet
+void update(BufferHandle buffer, u32 offset, const void* data, size_t size);
+BufferPromotionStats getBufferPromotionStats();
+// writes at most `max_count` currently promoted buffers to `buffers`, returns the number of promoted buffers
+u32 getPromotedBuffers(BufferHandle* buffers, u32 max_count);
+BarrierStats getBarrierStats();
+
+} // namespace Lumix::gpu
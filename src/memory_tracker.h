@@ -0,0 +1,111 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/hash_map.h"
+#include "engine/log.h"
+#include "engine/string.h"
+#include "engine/sync.h"
+#include "gpu_ext.h"
+#include <string.h>
+
+namespace Lumix::gpu {
+
+// sizes of live GPU objects by category, keyed by the API object, so any released object can be untracked
+// can be used from any thread
+struct ResourceMemoryTracker {
+	struct Entry {
+		ResourceCategory category;
+		u64 size;
+		StaticString<64> name;
+	};
+
+	ResourceMemoryTracker(IAllocator& allocator)
+		: allocator(allocator)
+		, entries(allocator)
+	{}
+
+	void add(const void* object, ResourceCategory category, u64 size, const char* name) {
+		ASSERT(object);
+		Entry entry;
+		entry.category = category;
+		entry.size = size;
+		entry.name = name ? name : "";
+		MutexGuard guard(mutex);
+		ASSERT(!entries.find(object).isValid());
+		entries.insert(object, entry);
+		sizes[(u32)category] += size;
+		++counts[(u32)category];
+	}
+
+	// objects which are not tracked are ignored
+	void remove(const void* object) {
+		MutexGuard guard(mutex);
+		auto iter = entries.find(object);
+		if (!iter.isValid()) return;
+		const ResourceCategory category = iter.value().category;
+		sizes[(u32)category] -= iter.value().size;
+		--counts[(u32)category];
+		entries.erase(object);
+	}
+
+	// objects which are not tracked are ignored
+	void setName(const void* object, const char* name) {
+		MutexGuard guard(mutex);
+		auto iter = entries.find(object);
+		if (iter.isValid()) iter.value().name = name ? name : "";
+	}
+
+	StaticString<64> getName(const void* object) {
+		MutexGuard guard(mutex);
+		auto iter = entries.find(object);
+		return iter.isValid() ? iter.value().name : StaticString<64>();
+	}
+
+	void getStats(ResourceMemoryStats& stats) {
+		MutexGuard guard(mutex);
+		memcpy(stats.size, sizes, sizeof(sizes));
+		memcpy(stats.count, counts, sizeof(counts));
+	}
+
+	// lists the largest buffers and textures which are still alive, descriptor heaps, PSOs and upload memory are owned by the backend
+	void logLeaks(u32 max_count) {
+		MutexGuard guard(mutex);
+		Array<const Entry*> leaks(allocator);
+		u64 total = 0;
+		for (const Entry& entry : entries) {
+			switch (entry.category) {
+				case ResourceCategory::STATIC_BUFFER:
+				case ResourceCategory::DYNAMIC_BUFFER:
+				case ResourceCategory::TEXTURE:
+				case ResourceCategory::RENDER_TARGET:
+					leaks.push(&entry);
+					total += entry.size;
+					break;
+				default: break;
+			}
+		}
+		if (leaks.empty()) return;
+
+		logError("gpu: ", leaks.size(), " resources (", total / 1024, " KB) were not destroyed");
+		for (u32 i = 0; i < max_count && i < (u32)leaks.size(); ++i) {
+			u32 largest = i;
+			for (u32 j = i + 1; j < (u32)leaks.size(); ++j) {
+				if (leaks[j]->size > leaks[largest]->size) largest = j;
+			}
+			const Entry* tmp = leaks[i];
+			leaks[i] = leaks[largest];
+			leaks[largest] = tmp;
+			logError("gpu:   ", leaks[i]->name.data[0] ? leaks[i]->name.data : "(unnamed)", " - ", leaks[i]->size / 1024, " KB");
+		}
+	}
+
+private:
+	IAllocator& allocator;
+	Mutex mutex;
+	HashMap<const void*, Entry> entries;
+	u64 sizes[(u32)ResourceCategory::COUNT] = {};
+	u32 counts[(u32)ResourceCategory::COUNT] = {};
+};
+
+} // namespace Lumix::gpu
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/job_system.h"
+#include "engine/math.h"
+#include "renderer/gpu/gpu.h"
+#include <emmintrin.h>
+#include <math.h>
+#include <string.h>
+
+namespace Lumix::gpu {
+
+enum class MipFilter : u8 {
+	BOX,   // 2x2 average
+	KAISER // 6 tap Kaiser windowed sinc, sharper than box
+};
+
+struct MipLevel {
+	const u8* data;
+	u32 w;
+	u32 h;
+	u32 pitch;
+	u32 depth = 1; // 3D textures, slices follow each other `h` rows apart
+};
+
+namespace MipDetail {
+
+struct SRGBTables {
+	SRGBTables() {
+		for (u32 i = 0; i < 256; ++i) {
+			const float c = i / 255.f;
+			to_linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (u32 i = 0; i < lengthOf(to_srgb); ++i) {
+			const float l = i / float(lengthOf(to_srgb) - 1);
+			const float s = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1 / 2.4f) - 0.055f;
+			to_srgb[i] = u8(s * 255.f + 0.5f);
+		}
+	}
+
+	float to_linear[256];
+	u8 to_srgb[4096];
+};
+
+inline const SRGBTables& getSRGBTables() {
+	static const SRGBTables tables;
+	return tables;
+}
+
+struct KaiserWeights {
+	static constexpr u32 TAPS = 6;
+
+	KaiserWeights() {
+		const float beta = 4.f;
+		float sum = 0;
+		for (u32 i = 0; i < TAPS; ++i) {
+			// distance of source pixel 2x - 2 + i from the destination pixel center 2x + 0.5
+			const float d = i - 2.5f;
+			const float x = 3.14159265f * d * 0.5f;
+			const float sinc = fabsf(x) < 1e-6f ? 1.f : sinf(x) / x;
+			const float t = d / 3.f;
+			const float window = besselI0(beta * sqrtf(1 - t * t)) / besselI0(beta);
+			weights[i] = sinc * window;
+			sum += weights[i];
+		}
+		for (float& w : weights) w /= sum;
+	}
+
+	static float besselI0(float x) {
+		float sum = 1;
+		float term = 1;
+		for (u32 k = 1; k < 20; ++k) {
+			term *= (x * 0.5f / k) * (x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	float weights[TAPS];
+};
+
+inline const KaiserWeights& getKaiserWeights() {
+	static const KaiserWeights weights;
+	return weights;
+}
+
+inline __m128 saturate(__m128 v) { return _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(1)); }
+
+// pixels are filtered as 4 floats, unused channels are 0
+struct CodecR8 {
+	static constexpr u32 SIZE = 1;
+	static __m128 decode(const u8* p) { return _mm_set_ss(p[0] / 255.f); }
+	static void encode(__m128 v, u8* p) { p[0] = u8(_mm_cvtss_f32(saturate(v)) * 255.f + 0.5f); }
+};
+
+struct CodecRGBA8 {
+	static constexpr u32 SIZE = 4;
+
+	static __m128 decode(const u8* p) {
+		const __m128i zero = _mm_setzero_si128();
+		i32 packed;
+		memcpy(&packed, p, sizeof(packed));
+		const __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero);
+		return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1 / 255.f));
+	}
+
+	static void encode(__m128 v, u8* p) {
+		const __m128i i = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate(v), _mm_set1_ps(255.f)), _mm_set1_ps(0.5f)));
+		const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(i, i), _mm_setzero_si128());
+		const i32 res = _mm_cvtsi128_si32(packed);
+		memcpy(p, &res, sizeof(res));
+	}
+};
+
+struct CodecSRGB8 {
+	static constexpr u32 SIZE = 3;
+
+	static __m128 decode(const u8* p) {
+		const float* lut = getSRGBTables().to_linear;
+		return _mm_setr_ps(lut[p[0]], lut[p[1]], lut[p[2]], 0);
+	}
+
+	static void encode(__m128 v, u8* p) {
+		const u8* lut = getSRGBTables().to_srgb;
+		alignas(16) i32 idx[4];
+		_mm_store_si128((__m128i*)idx, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate(v), _mm_set1_ps(4095.f)), _mm_set1_ps(0.5f))));
+		p[0] = lut[idx[0]];
+		p[1] = lut[idx[1]];
+		p[2] = lut[idx[2]];
+	}
+};
+
+// RGB is averaged in linear space, alpha is linear
+struct CodecSRGBA8 {
+	static constexpr u32 SIZE = 4;
+
+	static __m128 decode(const u8* p) {
+		const float* lut = getSRGBTables().to_linear;
+		return _mm_setr_ps(lut[p[0]], lut[p[1]], lut[p[2]], p[3] / 255.f);
+	}
+
+	static void encode(__m128 v, u8* p) {
+		const u8* lut = getSRGBTables().to_srgb;
+		alignas(16) i32 idx[4];
+		const __m128 scale = _mm_setr_ps(4095.f, 4095.f, 4095.f, 255.f);
+		_mm_store_si128((__m128i*)idx, _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(saturate(v), scale), _mm_set1_ps(0.5f))));
+		p[0] = lut[idx[0]];
+		p[1] = lut[idx[1]];
+		p[2] = lut[idx[2]];
+		p[3] = u8(idx[3]);
+	}
+};
+
+struct CodecR32F {
+	static constexpr u32 SIZE = 4;
+	static __m128 decode(const u8* p) { return _mm_load_ss((const float*)p); }
+	static void encode(__m128 v, u8* p) { _mm_store_ss((float*)p, v); }
+};
+
+struct CodecRG32F {
+	static constexpr u32 SIZE = 8;
+	static __m128 decode(const u8* p) { return _mm_castpd_ps(_mm_load_sd((const double*)p)); }
+	static void encode(__m128 v, u8* p) { _mm_store_sd((double*)p, _mm_castps_pd(v)); }
+};
+
+struct CodecRGBA32F {
+	static constexpr u32 SIZE = 16;
+	static __m128 decode(const u8* p) { return _mm_loadu_ps((const float*)p); }
+	static void encode(__m128 v, u8* p) { _mm_storeu_ps((float*)p, v); }
+};
+
+// exact integer average with rounding, for linear 8bit formats
+template <u32 CHANNELS>
+void boxRowU8(const MipLevel& src, u8* dst, u32 dst_w, u32 y) {
+	const u8* row0 = src.data + minimum(2 * y, src.h - 1) * src.pitch;
+	const u8* row1 = src.data + minimum(2 * y + 1, src.h - 1) * src.pitch;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+	u32 x = 0;
+	if constexpr (CHANNELS == 4) {
+		// 4 destination pixels from 8x2 source pixels
+		for (; 2 * x + 8 <= src.w; x += 4) {
+			const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x * 8));
+			const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x * 8 + 16));
+			const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x * 8));
+			const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x * 8 + 16));
+			auto sum = [&](__m128i a, __m128i b) {
+				const __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+				const __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+				// lo has pixels 0, 1 and hi 2, 3, add horizontal neighbours
+				const __m128i h = _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+				return _mm_srli_epi16(_mm_add_epi16(h, two), 2);
+			};
+			_mm_storeu_si128((__m128i*)(dst + x * 4), _mm_packus_epi16(sum(a0, b0), sum(a1, b1)));
+		}
+	}
+	else {
+		// 8 destination pixels from 16x2 source pixels
+		const __m128i low_bytes = _mm_set1_epi16(0xff);
+		for (; 2 * x + 16 <= src.w; x += 8) {
+			const __m128i a = _mm_loadu_si128((const __m128i*)(row0 + x * 2));
+			const __m128i b = _mm_loadu_si128((const __m128i*)(row1 + x * 2));
+			const __m128i even = _mm_add_epi16(_mm_and_si128(a, low_bytes), _mm_and_si128(b, low_bytes));
+			const __m128i odd = _mm_add_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+			const __m128i avg = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(even, odd), two), 2);
+			_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(avg, zero));
+		}
+	}
+
+	for (; x < dst_w; ++x) {
+		const u32 x0 = minimum(2 * x, src.w - 1) * CHANNELS;
+		const u32 x1 = minimum(2 * x + 1, src.w - 1) * CHANNELS;
+		for (u32 c = 0; c < CHANNELS; ++c) {
+			dst[x * CHANNELS + c] = u8((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+template <typename C>
+void boxRow(const MipLevel& src, u8* dst, u32 dst_w, u32 y) {
+	const u8* row0 = src.data + minimum(2 * y, src.h - 1) * src.pitch;
+	const u8* row1 = src.data + minimum(2 * y + 1, src.h - 1) * src.pitch;
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	for (u32 x = 0; x < dst_w; ++x) {
+		const u32 x0 = minimum(2 * x, src.w - 1) * C::SIZE;
+		const u32 x1 = minimum(2 * x + 1, src.w - 1) * C::SIZE;
+		__m128 v = _mm_add_ps(C::decode(row0 + x0), C::decode(row0 + x1));
+		v = _mm_add_ps(v, _mm_add_ps(C::decode(row1 + x0), C::decode(row1 + x1)));
+		C::encode(_mm_mul_ps(v, quarter), dst + x * C::SIZE);
+	}
+}
+
+// 2x2x2 average, slices are clamped the same way as rows
+template <typename C>
+void boxRow3D(const MipLevel& src, u8* dst, u32 dst_w, u32 y, u32 z) {
+	const u8* slice0 = src.data + minimum(2 * z, src.depth - 1) * src.h * src.pitch;
+	const u8* slice1 = src.data + minimum(2 * z + 1, src.depth - 1) * src.h * src.pitch;
+	const u32 y0 = minimum(2 * y, src.h - 1) * src.pitch;
+	const u32 y1 = minimum(2 * y + 1, src.h - 1) * src.pitch;
+	const u8* rows[] = { slice0 + y0, slice0 + y1, slice1 + y0, slice1 + y1 };
+	const __m128 eighth = _mm_set1_ps(0.125f);
+	for (u32 x = 0; x < dst_w; ++x) {
+		const u32 x0 = minimum(2 * x, src.w - 1) * C::SIZE;
+		const u32 x1 = minimum(2 * x + 1, src.w - 1) * C::SIZE;
+		__m128 v = _mm_setzero_ps();
+		for (const u8* row : rows) v = _mm_add_ps(v, _mm_add_ps(C::decode(row + x0), C::decode(row + x1)));
+		C::encode(_mm_mul_ps(v, eighth), dst + x * C::SIZE);
+	}
+}
+
+// separable, `tmp` holds the vertically filtered source row, 4 floats per pixel
+template <typename C>
+void kaiserRow(const MipLevel& src, u8* dst, u32 dst_w, u32 y, float* tmp) {
+	const float* weights = getKaiserWeights().weights;
+	const u8* rows[KaiserWeights::TAPS];
+	for (u32 i = 0; i < KaiserWeights::TAPS; ++i) {
+		const i32 sy = clamp(i32(2 * y + i) - 2, 0, i32(src.h) - 1);
+		rows[i] = src.data + sy * src.pitch;
+	}
+
+	for (u32 x = 0; x < src.w; ++x) {
+		__m128 v = _mm_setzero_ps();
+		for (u32 i = 0; i < KaiserWeights::TAPS; ++i) {
+			v = _mm_add_ps(v, _mm_mul_ps(C::decode(rows[i] + x * C::SIZE), _mm_set1_ps(weights[i])));
+		}
+		_mm_storeu_ps(tmp + x * 4, v);
+	}
+
+	for (u32 x = 0; x < dst_w; ++x) {
+		__m128 v = _mm_setzero_ps();
+		for (u32 i = 0; i < KaiserWeights::TAPS; ++i) {
+			const i32 sx = clamp(i32(2 * x + i) - 2, 0, i32(src.w) - 1);
+			v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(tmp + sx * 4), _mm_set1_ps(weights[i])));
+		}
+		C::encode(v, dst + x * C::SIZE);
+	}
+}
+
+template <typename C, bool LINEAR_U8>
+void generate(MipFilter filter, const MipLevel& src, u8* dst, u32 dst_pitch, u8* upload, u32 upload_pitch, IAllocator& allocator) {
+	const u32 dst_w = maximum(1u, src.w >> 1);
+	const u32 dst_h = maximum(1u, src.h >> 1);
+	const u32 dst_depth = maximum(1u, src.depth >> 1);
+	const u32 row_size = dst_w * C::SIZE;
+	// ~64KB of output per job, small mips are done on the calling thread
+	const i32 step = maximum(1, i32(64 * 1024 / row_size));
+	const bool kaiser = filter == MipFilter::KAISER && src.depth == 1;
+
+	// rows of all slices are split between jobs, slices are `dst_h` rows apart in both `dst` and `upload`
+	jobs::forEach(dst_h * dst_depth, step, [&](i32 from, i32 to) {
+		Array<float> tmp(allocator);
+		if (kaiser) tmp.resize(src.w * 4);
+		for (i32 row = from; row < to; ++row) {
+			u8* dst_row = dst + row * dst_pitch;
+			if (src.depth > 1) boxRow3D<C>(src, dst_row, dst_w, row % dst_h, row / dst_h);
+			else if (kaiser) kaiserRow<C>(src, dst_row, dst_w, row, tmp.begin());
+			else if constexpr (LINEAR_U8) boxRowU8<C::SIZE>(src, dst_row, dst_w, row);
+			else boxRow<C>(src, dst_row, dst_w, row);
+			// copy while the row is hot in cache, upload memory is write-combined, so it's never read
+			if (upload) memcpy(upload + row * upload_pitch, dst_row, row_size);
+		}
+	});
+}
+
+} // namespace MipDetail
+
+// bytes per pixel, 0 if mips of the format can not be generated on CPU
+inline u32 getMipPixelSize(TextureFormat format) {
+	switch (format) {
+		case TextureFormat::R8: return 1;
+		case TextureFormat::RGBA8: return 4;
+		case TextureFormat::SRGB: return 3;
+		case TextureFormat::SRGBA: return 4;
+		case TextureFormat::R32F: return 4;
+		case TextureFormat::RG32F: return 8;
+		case TextureFormat::RGBA32F: return 16;
+		default: return 0;
+	}
+}
+
+// writes mip one level below `src` to `dst` (cached memory, the next level is generated from it)
+// and optionally to `upload`; large mips are split by rows across worker threads
+// 3D textures are always filtered with a 2x2x2 box
+inline void generateMip(TextureFormat format
+	, MipFilter filter
+	, const MipLevel& src
+	, u8* dst
+	, u32 dst_pitch
+	, u8* upload
+	, u32 upload_pitch
+	, IAllocator& allocator)
+{
+	using namespace MipDetail;
+	switch (format) {
+		case TextureFormat::R8: generate<CodecR8, true>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::RGBA8: generate<CodecRGBA8, true>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::SRGB: generate<CodecSRGB8, false>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::SRGBA: generate<CodecSRGBA8, false>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::R32F: generate<CodecR32F, false>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::RG32F: generate<CodecRG32F, false>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		case TextureFormat::RGBA32F: generate<CodecRGBA32F, false>(filter, src, dst, dst_pitch, upload, upload_pitch, allocator); break;
+		default: ASSERT(false); break;
+	}
+}
+
+} // namespace Lumix::gpu
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string.h>
+
+namespace Lumix::gpu {
+
+// copies rows from GPU readback memory with `src_pitch` to tightly packed `dst`
+// runs on the calling thread, callers of unpackReadback decide which thread that is
+inline void unpackReadbackRows(u8* dst, const u8* src, u32 row_size, u32 src_pitch, u32 row_count) {
+	if (row_size == src_pitch) {
+		memcpy(dst, src, u64(row_size) * row_count);
+		return;
+	}
+	for (u32 row = 0; row < row_count; ++row) {
+		memcpy(dst + u64(row) * row_size, src + u64(row) * src_pitch, row_size);
+	}
+}
+
+} // namespace Lumix::gpu
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "gpu_ext.h"
+#include <math.h>
+
+namespace Lumix::gpu {
+
+// picks a render scale which keeps GPU frame time under the target, render targets stay allocated at full resolution
+// and only their top left part is rendered, see RenderTargetPool::getView
+struct DynamicResolution {
+	void update(float gpu_frame_ms) {
+		if (!enabled) {
+			scale = 1;
+			return;
+		}
+		if (gpu_frame_ms <= 0) return;
+
+		// GPU time is roughly proportional to the number of pixels, i.e. scale^2, keep 5% headroom
+		float desired = scale * sqrtf(target_ms * 0.95f / gpu_frame_ms);
+		// go down fast, so we do not miss many frames, and up slowly, so the scale does not oscillate
+		const float t = desired < scale ? 0.5f : 0.05f;
+		float s = scale + (desired - scale) * t;
+		// quantized, so viewports do not change every frame because of noise
+		s = floorf(s * 64 + 0.5f) / 64;
+		scale = s < min_scale ? min_scale : (s > max_scale ? max_scale : s);
+	}
+
+	bool enabled = false;
+	float target_ms = 16.6f;
+	float min_scale = 0.5f;
+	float max_scale = 1;
+	float scale = 1;
+};
+
+// render targets are allocated at least at max render resolution and reused by description,
+// so window resizes and resolution changes do not reallocate memory and descriptors
+// render thread only
+struct RenderTargetPool {
+	struct Entry {
+		TextureHandle texture;
+		u32 w; // allocated size
+		u32 h;
+		TextureFormat format;
+		u32 flags;
+		u32 idle_frames = 0;
+		bool in_use = false;
+	};
+
+	// free targets unused for this many frames are destroyed, e.g. after max resolution changed
+	static constexpr u32 MAX_IDLE_FRAMES = 120;
+
+	RenderTargetPool(IAllocator& allocator)
+		: entries(allocator)
+	{}
+
+	TextureHandle acquire(u32 w, u32 h, TextureFormat format, u32 flags, const char* debug_name) {
+		ASSERT(flags & (u32)TextureFlags::RENDER_TARGET);
+		ASSERT(!(flags & (u32)TextureFlags::IS_3D));
+		// the smallest free target which is big enough
+		Entry* best = nullptr;
+		for (Entry& e : entries) {
+			if (e.in_use || e.format != format || e.flags != flags || e.w < w || e.h < h) continue;
+			if (!best || u64(e.w) * e.h < u64(best->w) * best->h) best = &e;
+		}
+
+		if (!best) {
+			const u32 alloc_w = w > max_w ? w : max_w;
+			const u32 alloc_h = h > max_h ? h : max_h;
+			TextureHandle texture = allocTextureHandle();
+			if (!createTexture(texture, alloc_w, alloc_h, 1, format, flags, nullptr, debug_name)) {
+				destroy(texture);
+				return INVALID_TEXTURE;
+			}
+			best = &entries.emplace();
+			best->texture = texture;
+			best->w = alloc_w;
+			best->h = alloc_h;
+			best->format = format;
+			best->flags = flags;
+			++stats.allocations;
+		}
+		best->in_use = true;
+		best->idle_frames = 0;
+		return best->texture;
+	}
+
+	// GPU can still use the texture, but only commands recorded later can write it, so it can be acquired again right away
+	void release(TextureHandle texture) {
+		Entry* entry = find(texture);
+		ASSERT(entry && entry->in_use);
+		if (entry) entry->in_use = false;
+	}
+
+	// `w`x`h` is the full resolution size the target was acquired with
+	DynamicResolutionView getView(TextureHandle texture, u32 w, u32 h, float scale) {
+		DynamicResolutionView view;
+		view.w = u32(w * scale + 0.5f);
+		view.h = u32(h * scale + 0.5f);
+		view.w = view.w < 1 ? 1 : view.w;
+		view.h = view.h < 1 ? 1 : view.h;
+		view.scale = scale;
+		const Entry* entry = find(texture);
+		ASSERT(entry);
+		view.uv_scale[0] = entry ? view.w / (float)entry->w : 1;
+		view.uv_scale[1] = entry ? view.h / (float)entry->h : 1;
+		view.uv_max[0] = entry ? (view.w - 0.5f) / entry->w : 1;
+		view.uv_max[1] = entry ? (view.h - 0.5f) / entry->h : 1;
+		return view;
+	}
+
+	// call once per frame
+	void update() {
+		for (i32 i = entries.size() - 1; i >= 0; --i) {
+			Entry& e = entries[i];
+			if (e.in_use) continue;
+			if (++e.idle_frames <= MAX_IDLE_FRAMES) continue;
+			destroy(e.texture);
+			entries.swapAndPop(i);
+		}
+	}
+
+	void clear() {
+		for (const Entry& e : entries) destroy(e.texture);
+		entries.clear();
+	}
+
+	RenderTargetPoolStats getStats() const {
+		RenderTargetPoolStats res = stats;
+		res.texture_count = entries.size();
+		res.in_use_count = 0;
+		for (const Entry& e : entries) {
+			if (e.in_use) ++res.in_use_count;
+		}
+		return res;
+	}
+
+	u32 max_w = 0;
+	u32 max_h = 0;
+
+private:
+	Entry* find(TextureHandle texture) {
+		for (Entry& e : entries) {
+			if (e.texture == texture) return &e;
+		}
+		return nullptr;
+	}
+
+	Array<Entry> entries;
+	RenderTargetPoolStats stats = {};
+};
+
+} // namespace Lumix::gpu
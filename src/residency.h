@@ -0,0 +1,147 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/sync.h"
+#include "gpu_ext.h"
+#include <stdlib.h>
+
+namespace Lumix::gpu {
+
+// one per evictable API object - a committed resource or a heap with placed resources
+struct ResidencyEntry {
+	static constexpr u32 INVALID_INDEX = 0xffFFffFF;
+
+	bool isManaged() const { return index != INVALID_INDEX; }
+
+	void* object = nullptr;
+	u64 size = 0;
+	u64 last_used_frame = 0;
+	u32 index = INVALID_INDEX; // in ResidencyManager::entries
+	u32 pins = 0; // pinned entries are not evicted, e.g. while the copy queue writes to them
+	bool resident = true;
+};
+
+// LRU eviction policy, it only decides what to evict, the caller does the actual Evict/MakeResident calls,
+// so it does not depend on any graphics API
+// add, remove, pin, unpin and markResident can be called from any thread
+struct ResidencyManager {
+	ResidencyManager(IAllocator& allocator)
+		: entries(allocator)
+		, candidates(allocator)
+	{}
+
+	// resources used by frames which can still be in flight are not evicted
+	u32 min_idle_frames = 3;
+	// evict a bit more than necessary, so we do not evict something every frame
+	float target_budget_ratio = 0.95f;
+
+	void add(ResidencyEntry& entry, void* object, u64 size, u64 frame) {
+		ASSERT(!entry.isManaged());
+		entry.object = object;
+		entry.size = size;
+		entry.last_used_frame = frame;
+		entry.resident = true;
+		MutexGuard guard(mutex);
+		entry.index = entries.size();
+		entries.push(&entry);
+		stats.resident_size += size;
+		++stats.resident_count;
+	}
+
+	// entries which are not managed are ignored
+	void remove(ResidencyEntry& entry) {
+		MutexGuard guard(mutex);
+		if (!entry.isManaged()) return;
+		if (entry.resident) {
+			stats.resident_size -= entry.size;
+			--stats.resident_count;
+		}
+		else {
+			stats.evicted_size -= entry.size;
+			--stats.evicted_count;
+		}
+		entries.back()->index = entry.index;
+		entries.swapAndPop(entry.index);
+		entry.index = ResidencyEntry::INVALID_INDEX;
+	}
+
+	void pin(ResidencyEntry& entry) {
+		MutexGuard guard(mutex);
+		if (entry.isManaged()) ++entry.pins;
+	}
+
+	void unpin(ResidencyEntry& entry) {
+		MutexGuard guard(mutex);
+		if (!entry.isManaged()) return;
+		ASSERT(entry.pins > 0);
+		--entry.pins;
+	}
+
+	// cheap enough to call on every bind, returns false if the entry is evicted, call markResident and make it resident then
+	bool use(ResidencyEntry& entry, u64 frame) {
+		entry.last_used_frame = frame;
+		return entry.resident;
+	}
+
+	void markResident(ResidencyEntry& entry) {
+		MutexGuard guard(mutex);
+		if (entry.resident) return;
+		entry.resident = true;
+		stats.evicted_size -= entry.size;
+		--stats.evicted_count;
+		stats.resident_size += entry.size;
+		++stats.resident_count;
+		++stats.made_resident;
+	}
+
+	// picks least recently used entries until `usage` would drop under the target, they are marked as evicted
+	// and their objects are pushed to `to_evict`
+	void selectEvictions(u64 usage, u64 budget, u64 frame, Array<void*>& to_evict) {
+		if (budget == 0 || usage <= budget) return;
+
+		MutexGuard guard(mutex);
+		candidates.clear();
+		for (ResidencyEntry* entry : entries) {
+			if (!entry->resident || entry->pins > 0) continue;
+			if (entry->last_used_frame + min_idle_frames > frame) continue;
+			candidates.push(entry);
+		}
+		if (candidates.empty()) return;
+
+		qsort(candidates.begin(), candidates.size(), sizeof(candidates[0]), [](const void* a, const void* b) -> int {
+			const ResidencyEntry* ea = *(const ResidencyEntry**)a;
+			const ResidencyEntry* eb = *(const ResidencyEntry**)b;
+			if (ea->last_used_frame != eb->last_used_frame) return ea->last_used_frame < eb->last_used_frame ? -1 : 1;
+			// bigger first, so we evict fewer objects
+			if (ea->size != eb->size) return ea->size > eb->size ? -1 : 1;
+			return 0;
+		});
+
+		const u64 target = u64(budget * (double)target_budget_ratio);
+		for (ResidencyEntry* entry : candidates) {
+			if (usage <= target) break;
+			entry->resident = false;
+			to_evict.push(entry->object);
+			usage = usage > entry->size ? usage - entry->size : 0;
+			stats.resident_size -= entry->size;
+			--stats.resident_count;
+			stats.evicted_size += entry->size;
+			++stats.evicted_count;
+			++stats.evictions;
+		}
+	}
+
+	ResidencyStats getStats() {
+		MutexGuard guard(mutex);
+		return stats;
+	}
+
+private:
+	Mutex mutex;
+	Array<ResidencyEntry*> entries;
+	Array<ResidencyEntry*> candidates;
+	ResidencyStats stats = {};
+};
+
+} // namespace Lumix::gpu
@@ -4,6 +4,7 @@
 #include "engine/crc32.h"
 #include "engine/hash_map.h"
 #include "engine/os.h"
+#include "gpu_ext.h"
 #include <d3dcompiler.h>
 
 #pragma comment(lib, "d3dcompiler.lib")
@@ -147,8 +148,10 @@ struct ShaderCompiler {
 		return sc ? sc + input.prefixes.length() + input.decl.attributes_count + 1 : 0;
 	};
 
-	static bool glsl2hlsl(const char** srcs, u32 count, ShaderType type, const char* shader_name, Ref<std::string> out, Ref<u32> readonly_bitset, Ref<u32> used_bitset) {
+	static bool glsl2hlsl(const char** srcs, u32 count, ShaderType type, const char* shader_name, Ref<std::string> out, Ref<u32> readonly_bitset, Ref<u32> used_bitset, Ref<u32> cbv_bitset, Ref<u32> draw_constants_size) {
 		readonly_bitset.value = 0xffFFffFF;
+		cbv_bitset.value = 0;
+		draw_constants_size.value = 0;
 		glslang::TProgram p;
 		EShLanguage lang = EShLangVertex;
 		switch (type) {
@@ -196,6 +199,20 @@ struct ShaderCompiler {
 			out = hlsl.compile();
 
 			spirv_cross::ShaderResources resources = hlsl.get_shader_resources(hlsl.get_active_interface_variables());
+
+			for (spirv_cross::Resource& resource : resources.uniform_buffers) {
+				const u32 binding = hlsl.get_decoration(resource.id, spv::DecorationBinding);
+				if (binding == DRAW_CONSTANTS_BINDING) {
+					const u32 size = (u32)hlsl.get_declared_struct_size(hlsl.get_type(resource.base_type_id));
+					if (size > MAX_DRAW_CONSTANTS_SIZE) {
+						logError(shader_name, ": draw constants are limited to ", MAX_DRAW_CONSTANTS_SIZE, " bytes");
+						return false;
+					}
+					draw_constants_size.value = size;
+					continue;
+				}
+				cbv_bitset.value |= 1 << binding;
+			}
 		
 			for (spirv_cross::Resource& resource : resources.storage_buffers) {
 				const u32 binding = hlsl.get_decoration(resource.id, spv::DecorationBinding);
@@ -241,7 +258,7 @@ struct ShaderCompiler {
 		return hash;
 	}
 
-	ID3DBlob* compile(u32 hash, const char* src, ShaderType type, const char* name, u32 readonly_bitset, u32 used_bitset) {
+	ID3DBlob* compile(u32 hash, const char* src, ShaderType type, const char* name, u32 readonly_bitset, u32 used_bitset, u32 cbv_bitset, u32 draw_constants_size) {
 		ID3DBlob* output = NULL;
 		ID3DBlob* errors = NULL;
 		HRESULT hr = D3DCompile(src,
@@ -269,6 +286,8 @@ struct ShaderCompiler {
 		cached.data.write(output->GetBufferPointer(), output->GetBufferSize());
 		cached.readonly_bitset = readonly_bitset;
 		cached.used_srvs_bitset = used_bitset;
+		cached.cbv_bitset = cbv_bitset;
+		cached.draw_constants_size = draw_constants_size;
 		m_cache.insert(hash, static_cast<CachedShader&&>(cached));
 		return output;
 	};
@@ -276,17 +295,19 @@ struct ShaderCompiler {
 	void save(const char* filename) {
 		OS::OutputFile file;
 		if (file.open(filename)) {
-			u32 version = 0;
+			u32 version = CACHE_VERSION;
 			bool success = file.write(&version, sizeof(version));
 			for (auto iter = m_cache.begin(), end = m_cache.end(); iter != end; ++iter) {
 				const u32 hash = iter.key();
 				const CachedShader& s = iter.value();
 				const u32 size = (u32)s.data.size();
-				success = success || file.write(&hash, sizeof(hash));
-				success = success || file.write(&size, sizeof(size));
-				success = success || file.write(s.data.data(), size);
-				success = success || file.write(&s.readonly_bitset, sizeof(s.readonly_bitset));
-				success = success || file.write(&s.used_srvs_bitset, sizeof(s.used_srvs_bitset));
+				success = file.write(&hash, sizeof(hash)) && success;
+				success = file.write(&size, sizeof(size)) && success;
+				success = file.write(s.data.data(), size) && success;
+				success = file.write(&s.readonly_bitset, sizeof(s.readonly_bitset)) && success;
+				success = file.write(&s.used_srvs_bitset, sizeof(s.used_srvs_bitset)) && success;
+				success = file.write(&s.cbv_bitset, sizeof(s.cbv_bitset)) && success;
+				success = file.write(&s.draw_constants_size, sizeof(s.draw_constants_size)) && success;
 			}
 			if (!success) {
 				logError("Could not write ", filename);
@@ -302,7 +323,11 @@ struct ShaderCompiler {
 			if (!file.read(&version, sizeof(version))) {
 				logError("Could not read ", filename);
 			}
-			ASSERT(version == 0);
+			if (version != CACHE_VERSION) {
+				logInfo("Ignoring outdated shader cache ", filename);
+				file.close();
+				return;
+			}
 			u32 hash;
 			while (file.read(&hash, sizeof(hash))) {
 				u32 size;
@@ -312,6 +337,8 @@ struct ShaderCompiler {
 					if (!file.read(value.data.getMutableData(), size)) break;
 					if (!file.read(&value.readonly_bitset, sizeof(value.readonly_bitset))) break;
 					if (!file.read(&value.used_srvs_bitset, sizeof(value.used_srvs_bitset))) break;
+					if (!file.read(&value.cbv_bitset, sizeof(value.cbv_bitset))) break;
+					if (!file.read(&value.draw_constants_size, sizeof(value.draw_constants_size))) break;
 					m_cache.insert(hash, value);
 				} else {
 					break;
@@ -350,12 +377,16 @@ struct ShaderCompiler {
 		}
 	}
 
+	static constexpr u32 CACHE_VERSION = 2;
+
 	IAllocator& m_allocator;
 	struct CachedShader {
 		CachedShader(IAllocator& allocator) : data(allocator) {}
 		OutputMemoryStream data;
 		u32 used_srvs_bitset;
 		u32 readonly_bitset;
+		u32 cbv_bitset;
+		u32 draw_constants_size;
 	};
 	HashMap<u32, CachedShader> m_cache;
 };
@@ -0,0 +1,275 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include <string.h>
+#ifdef _MSC_VER
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+#include <immintrin.h>
+
+// intrinsics above SSE2 need the target attribute on gcc/clang, MSVC allows them anywhere
+#ifdef _MSC_VER
+	#define LUMIX_TARGET(x)
+#else
+	#define LUMIX_TARGET(x) __attribute__((target(x)))
+#endif
+
+namespace Lumix::gpu {
+
+// legacy uncompressed DDS formats are expanded to R8G8B8A8 while rows are written to staging memory
+enum class PixelConversion : u8 {
+	NONE,
+	BGRA8,
+	BGR8,
+	BGR5A1,
+	BGR565,
+	INDEX8
+};
+
+// bytes per source pixel
+inline u32 getSourcePixelSize(PixelConversion conversion) {
+	switch (conversion) {
+		case PixelConversion::NONE: return 4;
+		case PixelConversion::BGRA8: return 4;
+		case PixelConversion::BGR8: return 3;
+		case PixelConversion::BGR5A1: return 2;
+		case PixelConversion::BGR565: return 2;
+		case PixelConversion::INDEX8: return 1;
+	}
+	ASSERT(false);
+	return 4;
+}
+
+namespace PixelConvertDetail {
+
+inline u32 expand5(u32 v) { return (v << 3) | (v >> 2); }
+inline u32 expand6(u32 v) { return (v << 2) | (v >> 4); }
+
+inline void swizzleBGRA8Scalar(u8* dst, const u8* src, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = src[i * 4 + 2];
+		dst[i * 4 + 1] = src[i * 4 + 1];
+		dst[i * 4 + 2] = src[i * 4 + 0];
+		dst[i * 4 + 3] = src[i * 4 + 3];
+	}
+}
+
+inline void expandBGR8Scalar(u8* dst, const u8* src, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = src[i * 3 + 2];
+		dst[i * 4 + 1] = src[i * 3 + 1];
+		dst[i * 4 + 2] = src[i * 3 + 0];
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+inline void unpackBGR5A1Scalar(u8* dst, const u8* src, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		const u32 v = src[i * 2] | (src[i * 2 + 1] << 8);
+		dst[i * 4 + 0] = (u8)expand5((v >> 10) & 0x1f);
+		dst[i * 4 + 1] = (u8)expand5((v >> 5) & 0x1f);
+		dst[i * 4 + 2] = (u8)expand5(v & 0x1f);
+		dst[i * 4 + 3] = v & 0x8000 ? 0xff : 0;
+	}
+}
+
+inline void unpackBGR565Scalar(u8* dst, const u8* src, u32 count) {
+	for (u32 i = 0; i < count; ++i) {
+		const u32 v = src[i * 2] | (src[i * 2 + 1] << 8);
+		dst[i * 4 + 0] = (u8)expand5(v >> 11);
+		dst[i * 4 + 1] = (u8)expand6((v >> 5) & 0x3f);
+		dst[i * 4 + 2] = (u8)expand5(v & 0x1f);
+		dst[i * 4 + 3] = 0xff;
+	}
+}
+
+// `palette` is already in RGBA order
+inline void lookupIndex8Scalar(u8* dst, const u8* src, u32 count, const u32* palette) {
+	for (u32 i = 0; i < count; ++i) {
+		memcpy(dst + i * 4, &palette[src[i]], 4);
+	}
+}
+
+// 5/6 bit channels in 16bit lanes to RGBA8 in 32bit lanes, 8 pixels
+inline void storeRGBA16(u8* dst, __m128i r, __m128i g, __m128i b, __m128i a) {
+	const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+	const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+	_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(rg, ba));
+	_mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(rg, ba));
+}
+
+inline u32 unpackBGR565SSE2(u8* dst, const u8* src, u32 count) {
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i mask6 = _mm_set1_epi16(0x3f);
+	const __m128i alpha = _mm_set1_epi16(0xff);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+		const __m128i r = _mm_srli_epi16(v, 11);
+		const __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+		const __m128i b = _mm_and_si128(v, mask5);
+		storeRGBA16(dst + i * 4
+			, _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2))
+			, _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4))
+			, _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2))
+			, alpha);
+	}
+	return i;
+}
+
+inline u32 unpackBGR5A1SSE2(u8* dst, const u8* src, u32 count) {
+	const __m128i mask5 = _mm_set1_epi16(0x1f);
+	const __m128i byte_mask = _mm_set1_epi16(0xff);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+		const __m128i r = _mm_and_si128(_mm_srli_epi16(v, 10), mask5);
+		const __m128i g = _mm_and_si128(_mm_srli_epi16(v, 5), mask5);
+		const __m128i b = _mm_and_si128(v, mask5);
+		// arithmetic shift smears the alpha bit to 0 or 0xffff
+		const __m128i a = _mm_and_si128(_mm_srai_epi16(v, 15), byte_mask);
+		storeRGBA16(dst + i * 4
+			, _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2))
+			, _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2))
+			, _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2))
+			, a);
+	}
+	return i;
+}
+
+LUMIX_TARGET("ssse3") inline u32 swizzleBGRA8SSSE3(u8* dst, const u8* src, u32 count) {
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	u32 i = 0;
+	for (; i + 4 <= count; i += 4) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 4));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_shuffle_epi8(v, shuffle));
+	}
+	return i;
+}
+
+LUMIX_TARGET("ssse3") inline u32 expandBGR8SSSE3(u8* dst, const u8* src, u32 count) {
+	// -1 zeroes the alpha byte, it's then set by the or
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+	u32 i = 0;
+	// each load reads 16 bytes but uses 12, so stop early enough not to read past the row
+	for (; i + 6 <= count; i += 4) {
+		const __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 3));
+		_mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+	}
+	return i;
+}
+
+LUMIX_TARGET("avx2") inline u32 swizzleBGRA8AVX2(u8* dst, const u8* src, u32 count) {
+	const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+		, 2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(v, shuffle));
+	}
+	return i;
+}
+
+LUMIX_TARGET("avx2") inline u32 unpackBGR565AVX2(u8* dst, const u8* src, u32 count) {
+	const __m256i mask5 = _mm256_set1_epi16(0x1f);
+	const __m256i mask6 = _mm256_set1_epi16(0x3f);
+	const __m256i alpha = _mm256_set1_epi16((short)0xff00);
+	u32 i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 2));
+		__m256i r = _mm256_srli_epi16(v, 11);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi16(v, 5), mask6);
+		__m256i b = _mm256_and_si256(v, mask5);
+		r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+		g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+		b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+		const __m256i rg = _mm256_or_si256(r, _mm256_slli_epi16(g, 8));
+		const __m256i ba = _mm256_or_si256(b, alpha);
+		// unpack works within 128bit lanes, so the halves have to be put back in order
+		const __m256i lo = _mm256_unpacklo_epi16(rg, ba);
+		const __m256i hi = _mm256_unpackhi_epi16(rg, ba);
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+		_mm256_storeu_si256((__m256i*)(dst + i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+	}
+	return i;
+}
+
+LUMIX_TARGET("avx2") inline u32 lookupIndex8AVX2(u8* dst, const u8* src, u32 count, const u32* palette) {
+	u32 i = 0;
+	for (; i + 8 <= count; i += 8) {
+		const __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		const __m256i v = _mm256_i32gather_epi32((const int*)palette, idx, 4);
+		_mm256_storeu_si256((__m256i*)(dst + i * 4), v);
+	}
+	return i;
+}
+
+struct CPUFeatures {
+	CPUFeatures() {
+		#ifdef _MSC_VER
+			int regs[4];
+			__cpuid(regs, 1);
+			ssse3 = (regs[2] & (1 << 9)) != 0;
+			const bool osxsave = (regs[2] & (1 << 27)) != 0;
+			__cpuidex(regs, 7, 0);
+			avx2 = osxsave && (regs[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6;
+		#else
+			__builtin_cpu_init();
+			ssse3 = __builtin_cpu_supports("ssse3");
+			avx2 = __builtin_cpu_supports("avx2");
+		#endif
+	}
+
+	bool ssse3 = false;
+	bool avx2 = false;
+};
+
+inline const CPUFeatures& getCPUFeatures() {
+	static const CPUFeatures features;
+	return features;
+}
+
+} // namespace PixelConvertDetail
+
+// reference implementation, convertPixels must produce the same output
+inline void convertPixelsScalar(PixelConversion conversion, u8* dst, const u8* src, u32 count, const u32* palette) {
+	using namespace PixelConvertDetail;
+	switch (conversion) {
+		case PixelConversion::NONE: memcpy(dst, src, count * 4); break;
+		case PixelConversion::BGRA8: swizzleBGRA8Scalar(dst, src, count); break;
+		case PixelConversion::BGR8: expandBGR8Scalar(dst, src, count); break;
+		case PixelConversion::BGR5A1: unpackBGR5A1Scalar(dst, src, count); break;
+		case PixelConversion::BGR565: unpackBGR565Scalar(dst, src, count); break;
+		case PixelConversion::INDEX8: lookupIndex8Scalar(dst, src, count, palette); break;
+	}
+}
+
+// converts `count` pixels to R8G8B8A8, SIMD kernels do the bulk and the scalar version the tail
+inline void convertPixels(PixelConversion conversion, u8* dst, const u8* src, u32 count, const u32* palette) {
+	using namespace PixelConvertDetail;
+	const CPUFeatures& cpu = getCPUFeatures();
+	u32 done = 0;
+	switch (conversion) {
+		case PixelConversion::NONE: break;
+		case PixelConversion::BGRA8:
+			if (cpu.avx2) done = swizzleBGRA8AVX2(dst, src, count);
+			else if (cpu.ssse3) done = swizzleBGRA8SSSE3(dst, src, count);
+			break;
+		case PixelConversion::BGR8:
+			if (cpu.ssse3) done = expandBGR8SSSE3(dst, src, count);
+			break;
+		case PixelConversion::BGR5A1: done = unpackBGR5A1SSE2(dst, src, count); break;
+		case PixelConversion::BGR565:
+			done = cpu.avx2 ? unpackBGR565AVX2(dst, src, count) : unpackBGR565SSE2(dst, src, count);
+			break;
+		case PixelConversion::INDEX8:
+			if (cpu.avx2) done = lookupIndex8AVX2(dst, src, count, palette);
+			break;
+	}
+	convertPixelsScalar(conversion, dst + done * 4, src + done * getSourcePixelSize(conversion), count - done, palette);
+}
+
+} // namespace Lumix::gpu
@@ -0,0 +1,224 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/log.h"
+#include "renderer/gpu/dds.h"
+#include "texture_convert.h"
+#include <string.h>
+
+namespace Lumix::gpu {
+
+// CPU part of texture loading - parses DDS and computes where subresources go in staging memory,
+// it does not need a GPU device, so it can run on any thread (or in tests and fuzzers)
+struct SubresourceLayout {
+	u64 offset;       // in staging memory
+	const u8* src;    // in DDS blob, rows are tightly packed
+	u32 width;        // rounded up to block size
+	u32 height;       // rounded up to block size
+	u32 row_pitch;    // in staging memory
+	u32 row_size;     // bytes in one row of blocks
+	u32 src_row_size; // differs from row_size if pixels are converted
+	u32 row_count;    // rows of blocks
+};
+
+struct TextureLayout {
+	TextureLayout(IAllocator& allocator)
+		: subresources(allocator)
+	{}
+
+	u32 dxgi_format = 0; // raw DXGI_FORMAT value, so this does not depend on Windows headers
+	u32 width = 0;
+	u32 height = 0;
+	u32 array_size = 1; // faces * layers
+	u32 layers = 1;
+	u32 mips = 1;
+	bool is_cubemap = false;
+	u32 block_width = 1;
+	u32 block_bytes = 4;
+	u64 staging_size = 0;
+	PixelConversion conversion = PixelConversion::NONE;
+	u32 palette[256]; // RGBA, only for PixelConversion::INDEX8
+	Array<SubresourceLayout> subresources;
+};
+
+namespace TextureLayoutDetail {
+
+struct BlockFormat {
+	u32 format;
+	u32 srgb_format;
+	u32 block_width;
+	u32 block_bytes;
+	PixelConversion conversion;
+};
+
+// DXGI_FORMAT values
+static constexpr BlockFormat BC1 = {71, 72, 4, 8, PixelConversion::NONE};
+static constexpr BlockFormat BC2 = {74, 75, 4, 16, PixelConversion::NONE};
+static constexpr BlockFormat BC3 = {77, 78, 4, 16, PixelConversion::NONE};
+static constexpr BlockFormat BC4 = {80, 80, 4, 8, PixelConversion::NONE};
+static constexpr BlockFormat BC5 = {83, 83, 4, 16, PixelConversion::NONE};
+static constexpr BlockFormat RGBA8 = {28, 29, 1, 4, PixelConversion::NONE};
+static constexpr BlockFormat BGRA8 = {87, 91, 1, 4, PixelConversion::NONE};
+// legacy uncompressed formats, converted to RGBA8, so they all have an sRGB variant
+static constexpr BlockFormat LEGACY_BGRA8 = {28, 29, 1, 4, PixelConversion::BGRA8};
+static constexpr BlockFormat LEGACY_BGR8 = {28, 29, 1, 4, PixelConversion::BGR8};
+static constexpr BlockFormat LEGACY_BGR5A1 = {28, 29, 1, 4, PixelConversion::BGR5A1};
+static constexpr BlockFormat LEGACY_BGR565 = {28, 29, 1, 4, PixelConversion::BGR565};
+static constexpr BlockFormat LEGACY_INDEX8 = {28, 29, 1, 4, PixelConversion::INDEX8};
+
+inline u64 alignUp(u64 value, u64 align) { return (value + align - 1) / align * align; }
+
+inline const BlockFormat* getDXT10Format(u32 dxgi_format) {
+	switch (dxgi_format) {
+		case 71: case 72: return &BC1;
+		case 74: case 75: return &BC2;
+		case 77: case 78: return &BC3;
+		case 80: return &BC4;
+		case 83: return &BC5;
+		case 28: case 29: return &RGBA8;
+		case 87: case 91: return &BGRA8;
+		default: return nullptr;
+	}
+}
+
+} // namespace TextureLayoutDetail
+
+// `pitch_alignment` and `placement_alignment` are 256 and 512 for D3D12 copyable footprints, 1 for tightly packed data
+inline bool computeTextureLayout(const void* data
+	, u64 size
+	, bool srgb
+	, u32 pitch_alignment
+	, u32 placement_alignment
+	, TextureLayout& layout
+	, const char* debug_name)
+{
+	using namespace TextureLayoutDetail;
+
+	DDS::Header hdr;
+	if (size < sizeof(hdr)) {
+		logError("Corrupted dds (", debug_name, ")");
+		return false;
+	}
+	memcpy(&hdr, data, sizeof(hdr));
+	u64 data_offset = sizeof(hdr);
+
+	if (hdr.dwMagic != DDS::DDS_MAGIC || hdr.dwSize != 124 || !(hdr.dwFlags & DDS::DDSD_PIXELFORMAT) || !(hdr.dwFlags & DDS::DDSD_CAPS)) {
+		logError("Wrong dds format or corrupted dds (", debug_name, ")");
+		return false;
+	}
+
+	const BlockFormat* format = nullptr;
+	u32 layers = 1;
+	if (isDXT1(hdr.pixelFormat)) format = &BC1;
+	else if (isDXT3(hdr.pixelFormat)) format = &BC2;
+	else if (isDXT5(hdr.pixelFormat)) format = &BC3;
+	else if (isATI1(hdr.pixelFormat)) format = &BC4;
+	else if (isATI2(hdr.pixelFormat)) format = &BC5;
+	else if (isBGRA8(hdr.pixelFormat)) format = &LEGACY_BGRA8;
+	else if (isBGR8(hdr.pixelFormat)) format = &LEGACY_BGR8;
+	else if (isBGR5A1(hdr.pixelFormat)) format = &LEGACY_BGR5A1;
+	else if (isBGR565(hdr.pixelFormat)) format = &LEGACY_BGR565;
+	else if (isINDEX8(hdr.pixelFormat)) format = &LEGACY_INDEX8;
+	else if (isDXT10(hdr.pixelFormat)) {
+		DDS::DXT10Header dxt10_hdr;
+		if (size < data_offset + sizeof(dxt10_hdr)) {
+			logError("Corrupted dds (", debug_name, ")");
+			return false;
+		}
+		memcpy(&dxt10_hdr, (const u8*)data + data_offset, sizeof(dxt10_hdr));
+		data_offset += sizeof(dxt10_hdr);
+		format = getDXT10Format((u32)dxt10_hdr.dxgi_format);
+		layers = dxt10_hdr.array_size;
+	}
+
+	if (!format) {
+		logError("Unsupported dds format (", debug_name, ")");
+		return false;
+	}
+	// limits of D3D feature level 11
+	if (hdr.dwWidth == 0 || hdr.dwHeight == 0 || layers == 0 || hdr.dwWidth > 16384 || hdr.dwHeight > 16384 || layers > 2048) {
+		logError("Invalid dds size (", debug_name, ")");
+		return false;
+	}
+
+	layout.dxgi_format = srgb ? format->srgb_format : format->format;
+	layout.block_width = format->block_width;
+	layout.block_bytes = format->block_bytes;
+	layout.conversion = format->conversion;
+	layout.is_cubemap = (hdr.caps2.dwCaps2 & DDS::DDSCAPS2_CUBEMAP) != 0;
+	layout.width = hdr.dwWidth > format->block_width ? hdr.dwWidth : format->block_width;
+	layout.height = hdr.dwHeight > format->block_width ? hdr.dwHeight : format->block_width;
+	layout.layers = layers;
+	layout.array_size = (layout.is_cubemap ? 6 : 1) * layers;
+	layout.mips = (hdr.dwFlags & DDS::DDSD_MIPMAPCOUNT) ? hdr.dwMipMapCount : 1;
+	if (layout.mips == 0 || layout.mips > 16) {
+		logError("Invalid dds mip count (", debug_name, ")");
+		return false;
+	}
+
+	if (layout.conversion == PixelConversion::INDEX8) {
+		// BGRA palette precedes pixel data
+		u8 palette[256 * 4];
+		if (data_offset + sizeof(palette) > size) {
+			logError("Corrupted dds, missing palette (", debug_name, ")");
+			return false;
+		}
+		memcpy(palette, (const u8*)data + data_offset, sizeof(palette));
+		data_offset += sizeof(palette);
+		convertPixelsScalar(PixelConversion::BGRA8, (u8*)layout.palette, palette, 256, nullptr);
+	}
+
+	// same order as D3D subresource indices - mips of the first slice, mips of the second slice, ...
+	const u32 bw = format->block_width;
+	layout.subresources.clear();
+	u64 staging_offset = 0;
+	for (u32 slice = 0; slice < layout.array_size; ++slice) {
+		for (u32 mip = 0; mip < layout.mips; ++mip) {
+			const u32 w = hdr.dwWidth >> mip > 1 ? hdr.dwWidth >> mip : 1;
+			const u32 h = hdr.dwHeight >> mip > 1 ? hdr.dwHeight >> mip : 1;
+
+			SubresourceLayout& sub = layout.subresources.emplace();
+			sub.width = u32(alignUp(w, bw));
+			sub.height = u32(alignUp(h, bw));
+			sub.row_size = sub.width / bw * format->block_bytes;
+			sub.row_count = sub.height / bw;
+			sub.src_row_size = layout.conversion == PixelConversion::NONE ? sub.row_size : sub.width * getSourcePixelSize(layout.conversion);
+			sub.row_pitch = u32(alignUp(sub.row_size, pitch_alignment));
+			sub.offset = alignUp(staging_offset, placement_alignment);
+			staging_offset = sub.offset + u64(sub.row_pitch) * sub.row_count;
+
+			const u64 src_size = u64(sub.src_row_size) * sub.row_count;
+			if (data_offset + src_size > size) {
+				logError("Corrupted dds, data out of bounds (", debug_name, ")");
+				return false;
+			}
+			sub.src = (const u8*)data + data_offset;
+			data_offset += src_size;
+		}
+	}
+	layout.staging_size = staging_offset;
+	return true;
+}
+
+// `dst` must have at least layout.staging_size bytes
+inline void writeTextureRows(const TextureLayout& layout, u8* dst) {
+	for (const SubresourceLayout& sub : layout.subresources) {
+		u8* sub_dst = dst + sub.offset;
+		if (layout.conversion != PixelConversion::NONE) {
+			for (u32 row = 0; row < sub.row_count; ++row) {
+				convertPixels(layout.conversion, sub_dst + u64(row) * sub.row_pitch, sub.src + u64(row) * sub.src_row_size, sub.width, layout.palette);
+			}
+			continue;
+		}
+		if (sub.row_pitch == sub.row_size) {
+			memcpy(sub_dst, sub.src, u64(sub.row_size) * sub.row_count);
+			continue;
+		}
+		for (u32 row = 0; row < sub.row_count; ++row) {
+			memcpy(sub_dst + u64(row) * sub.row_pitch, sub.src + u64(row) * sub.row_size, sub.row_size);
+		}
+	}
+}
+
+} // namespace Lumix::gpu
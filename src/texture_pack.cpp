@@ -0,0 +1,57 @@
+#include "texture_pack.h"
+#include <Windows.h>
+
+namespace Lumix::gpu {
+
+bool TexturePack::open(const char* path) {
+	close();
+	const HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	file = f;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(f, &file_size) || file_size.QuadPart == 0) {
+		close();
+		return false;
+	}
+	size = file_size.QuadPart;
+	mapping = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	data = (const u8*)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data || !validate()) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TexturePack::close() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle((HANDLE)mapping);
+	if (file) CloseHandle((HANDLE)file);
+	data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+	entries = nullptr;
+	count = 0;
+}
+
+void TexturePack::prefetch(u32 index) const {
+	ASSERT(index < count);
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = (void*)getData(index);
+	range.NumberOfBytes = (SIZE_T)entries[index].size;
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+}
+
+void TexturePack::discard(u32 index) const {
+	ASSERT(index < count);
+	// unlocking pages which are not locked removes them from the working set
+	VirtualUnlock((void*)getData(index), (SIZE_T)entries[index].size);
+}
+
+} // namespace Lumix::gpu
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#include "engine/stream.h"
+#include "renderer/gpu/dds.h"
+#include "renderer/gpu/gpu.h"
+#include <string.h>
+
+namespace Lumix::gpu {
+
+// texture pack archive - header, entry table sorted by name hash, page aligned DDS payloads
+// TexturePack maps the archive, payloads go to prepareTexture straight from mapped pages and are written to staging memory,
+// so the whole file is never read to RAM; texture info is in the entry table, looking it up does not touch payload pages
+struct TexturePackHeader {
+	static constexpr u32 MAGIC = 0x4B50544C; // 'LTPK'
+	static constexpr u32 VERSION = 1;
+
+	u32 magic = MAGIC;
+	u32 version = VERSION;
+	u32 count = 0;
+	u32 payload_alignment = 0;
+};
+
+struct TexturePackEntry {
+	u64 name_hash;
+	u64 offset;
+	u64 size;
+	u32 width;
+	u32 height;
+	u32 depth;
+	u32 layers;
+	u32 mips;
+	u32 is_cubemap;
+};
+
+static constexpr u32 TEXTURE_PACK_PAYLOAD_ALIGNMENT = 4096;
+
+// FNV-1a, stable across runs, since the hashes are stored in archives
+inline u64 hashTexturePackName(const char* name) {
+	u64 hash = 0xcbf29ce484222325;
+	for (const char* c = name; *c; ++c) {
+		hash ^= (u8)*c;
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+struct TexturePackWriter {
+	TexturePackWriter(IAllocator& allocator)
+		: entries(allocator)
+		, payloads(allocator)
+	{}
+
+	// `data` is a DDS file and must be valid until write()
+	bool add(const char* name, const void* data, u64 size) {
+		DDS::Header hdr;
+		if (size < sizeof(hdr)) return false;
+		memcpy(&hdr, data, sizeof(hdr));
+		if (hdr.dwMagic != DDS::DDS_MAGIC || hdr.dwSize != 124) return false;
+
+		TexturePackEntry entry = {};
+		entry.name_hash = hashTexturePackName(name);
+		entry.size = size;
+		entry.width = hdr.dwWidth;
+		entry.height = hdr.dwHeight;
+		entry.depth = (hdr.dwFlags & DDS::DDSD_DEPTH) ? hdr.dwDepth : 1;
+		entry.mips = (hdr.dwFlags & DDS::DDSD_MIPMAPCOUNT) ? hdr.dwMipMapCount : 1;
+		entry.is_cubemap = (hdr.caps2.dwCaps2 & DDS::DDSCAPS2_CUBEMAP) != 0;
+		entry.layers = 1;
+		if (isDXT10(hdr.pixelFormat)) {
+			DDS::DXT10Header dxt10_hdr;
+			if (size < sizeof(hdr) + sizeof(dxt10_hdr)) return false;
+			memcpy(&dxt10_hdr, (const u8*)data + sizeof(hdr), sizeof(dxt10_hdr));
+			entry.layers = dxt10_hdr.array_size;
+		}
+
+		for (const TexturePackEntry& e : entries) {
+			if (e.name_hash == entry.name_hash) return false;
+		}
+
+		// keep entries sorted, so TexturePack::find can use binary search
+		i32 idx = entries.size();
+		while (idx > 0 && entries[idx - 1].name_hash > entry.name_hash) --idx;
+		entries.insert(idx, entry);
+		payloads.insert(idx, (const u8*)data);
+		return true;
+	}
+
+	void write(OutputMemoryStream& out) {
+		TexturePackHeader header;
+		header.count = entries.size();
+		header.payload_alignment = TEXTURE_PACK_PAYLOAD_ALIGNMENT;
+
+		u64 offset = alignUp(sizeof(header) + sizeof(TexturePackEntry) * entries.size());
+		for (TexturePackEntry& entry : entries) {
+			entry.offset = offset;
+			offset = alignUp(offset + entry.size);
+		}
+
+		const u64 start = out.size();
+		out.write(&header, sizeof(header));
+		out.write(entries.begin(), sizeof(TexturePackEntry) * entries.size());
+		for (u32 i = 0, c = entries.size(); i < c; ++i) {
+			pad(out, start + entries[i].offset);
+			out.write(payloads[i], entries[i].size);
+		}
+		pad(out, start + offset);
+	}
+
+private:
+	static u64 alignUp(u64 value) { return (value + TEXTURE_PACK_PAYLOAD_ALIGNMENT - 1) & ~u64(TEXTURE_PACK_PAYLOAD_ALIGNMENT - 1); }
+
+	static void pad(OutputMemoryStream& out, u64 size) {
+		static const u8 zeros[256] = {};
+		while (out.size() < size) {
+			const u64 chunk = size - out.size() < sizeof(zeros) ? size - out.size() : sizeof(zeros);
+			out.write(zeros, chunk);
+		}
+	}
+
+	Array<TexturePackEntry> entries;
+	Array<const u8*> payloads;
+};
+
+// read-only mapping of a pack, owns the file and the mapping, see texture_pack.cpp
+struct TexturePack {
+	static constexpr u32 INVALID_INDEX = 0xffFFffFF;
+
+	TexturePack() = default;
+	TexturePack(const TexturePack&) = delete;
+	void operator =(const TexturePack&) = delete;
+	~TexturePack() { close(); }
+
+	bool open(const char* path);
+	void close();
+
+	u32 getCount() const { return count; }
+
+	u32 find(const char* name) const {
+		const u64 hash = hashTexturePackName(name);
+		u32 lo = 0;
+		u32 hi = count;
+		while (lo < hi) {
+			const u32 mid = (lo + hi) / 2;
+			if (entries[mid].name_hash < hash) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo < count && entries[lo].name_hash == hash ? lo : INVALID_INDEX;
+	}
+
+	// reads only the entry table
+	TextureInfo getTextureInfo(u32 index) const {
+		ASSERT(index < count);
+		const TexturePackEntry& entry = entries[index];
+		TextureInfo info;
+		info.width = entry.width;
+		info.height = entry.height;
+		info.depth = entry.depth;
+		info.layers = entry.layers;
+		info.mips = entry.mips;
+		info.is_cubemap = entry.is_cubemap != 0;
+		return info;
+	}
+
+	// DDS file in mapped memory, pass it to gpu::prepareTexture, the pack must stay open until the texture is committed
+	const u8* getData(u32 index) const {
+		ASSERT(index < count);
+		return data + entries[index].offset;
+	}
+
+	u64 getSize(u32 index) const {
+		ASSERT(index < count);
+		return entries[index].size;
+	}
+
+	// starts reading payload pages from disk before prepareTexture touches them
+	void prefetch(u32 index) const;
+	// payload pages are clean, so dropping them from the working set is free, they are read again if touched
+	void discard(u32 index) const;
+
+private:
+	bool validate() {
+		TexturePackHeader header;
+		if (size < sizeof(header)) return false;
+		memcpy(&header, data, sizeof(header));
+		if (header.magic != TexturePackHeader::MAGIC || header.version != TexturePackHeader::VERSION) return false;
+		if (header.payload_alignment != TEXTURE_PACK_PAYLOAD_ALIGNMENT) return false;
+		if ((size - sizeof(header)) / sizeof(TexturePackEntry) < header.count) return false;
+
+		entries = (const TexturePackEntry*)(data + sizeof(header));
+		for (u32 i = 0; i < header.count; ++i) {
+			const TexturePackEntry& entry = entries[i];
+			if (entry.offset % TEXTURE_PACK_PAYLOAD_ALIGNMENT != 0) return false;
+			if (entry.offset > size || entry.size > size - entry.offset) return false;
+			if (i > 0 && entries[i - 1].name_hash >= entry.name_hash) return false;
+		}
+		count = header.count;
+		return true;
+	}
+
+	const u8* data = nullptr;
+	u64 size = 0;
+	const TexturePackEntry* entries = nullptr;
+	u32 count = 0;
+	// OS handles, so this header does not need Windows.h
+	void* file = nullptr;
+	void* mapping = nullptr;
+};
+
+} // namespace Lumix::gpu
@@ -0,0 +1,286 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace Lumix {
+
+// two-level segregated fit allocator, it only manages offsets in an external range (e.g. ID3D12Heap)
+// and never touches the memory itself, so it does not need a GPU device
+struct TLSF {
+	static constexpr u32 INVALID_NODE = 0xffFFffFF;
+	static constexpr u32 SL_BITS = 4;
+	static constexpr u32 SL_COUNT = 1 << SL_BITS;
+	static constexpr u32 FL_COUNT = 64 - SL_BITS + 1;
+
+	struct Allocation {
+		bool isValid() const { return node != INVALID_NODE; }
+
+		u64 offset = 0;
+		u64 size = 0;
+		u32 node = INVALID_NODE;
+	};
+
+	struct Stats {
+		u64 size;
+		u64 used;
+		u64 largest_free_block;
+		u32 allocation_count;
+	};
+
+	TLSF(IAllocator& allocator)
+		: nodes(allocator)
+	{}
+
+	void init(u64 size) {
+		ASSERT(size > 0);
+		nodes.clear();
+		free_nodes = INVALID_NODE;
+		fl_bitmap = 0;
+		for (u32 fl = 0; fl < FL_COUNT; ++fl) {
+			sl_bitmap[fl] = 0;
+			for (u32 sl = 0; sl < SL_COUNT; ++sl) heads[fl][sl] = INVALID_NODE;
+		}
+		total_size = size;
+		used_size = 0;
+		allocation_count = 0;
+
+		const u32 n = newNode();
+		nodes[n].offset = 0;
+		nodes[n].size = size;
+		insertFree(n);
+	}
+
+	Allocation alloc(u64 size, u64 align) {
+		ASSERT(size > 0);
+		ASSERT(align > 0 && (align & (align - 1)) == 0);
+
+		// try the exact size first, padding for alignment is only needed if the block is not aligned
+		u32 n = findFree(size);
+		if (n != INVALID_NODE && alignUp(nodes[n].offset, align) + size > nodes[n].offset + nodes[n].size) n = INVALID_NODE;
+		if (n == INVALID_NODE) n = findFree(size + align - 1);
+		if (n == INVALID_NODE) n = findFit(size, align);
+		if (n == INVALID_NODE) return {};
+
+		removeFree(n);
+		const u64 aligned = alignUp(nodes[n].offset, align);
+		if (aligned != nodes[n].offset) {
+			const u32 rest = split(n, aligned - nodes[n].offset);
+			insertFree(n);
+			n = rest;
+		}
+		if (nodes[n].size > size) {
+			const u32 tail = split(n, size);
+			insertFree(tail);
+		}
+
+		Node& node = nodes[n];
+		node.is_free = false;
+		used_size += node.size;
+		++allocation_count;
+
+		Allocation res;
+		res.offset = node.offset;
+		res.size = node.size;
+		res.node = n;
+		return res;
+	}
+
+	void free(u32 n) {
+		ASSERT(n < (u32)nodes.size());
+		ASSERT(!nodes[n].is_free);
+		used_size -= nodes[n].size;
+		--allocation_count;
+
+		const u32 prev = nodes[n].prev_phys;
+		if (prev != INVALID_NODE && nodes[prev].is_free) {
+			removeFree(prev);
+			merge(prev, n);
+			n = prev;
+		}
+		const u32 next = nodes[n].next_phys;
+		if (next != INVALID_NODE && nodes[next].is_free) {
+			removeFree(next);
+			merge(n, next);
+		}
+		insertFree(n);
+	}
+
+	bool isEmpty() const { return allocation_count == 0; }
+	u64 getSize() const { return total_size; }
+
+	Stats getStats() const {
+		Stats stats;
+		stats.size = total_size;
+		stats.used = used_size;
+		stats.allocation_count = allocation_count;
+		stats.largest_free_block = 0;
+		if (fl_bitmap) {
+			const u32 fl = highestBit(fl_bitmap);
+			const u32 sl = highestBit(sl_bitmap[fl]);
+			for (u32 n = heads[fl][sl]; n != INVALID_NODE; n = nodes[n].next_free) {
+				if (nodes[n].size > stats.largest_free_block) stats.largest_free_block = nodes[n].size;
+			}
+		}
+		return stats;
+	}
+
+private:
+	struct Node {
+		u64 offset = 0;
+		u64 size = 0;
+		u32 prev_phys = INVALID_NODE;
+		u32 next_phys = INVALID_NODE;
+		u32 prev_free = INVALID_NODE;
+		u32 next_free = INVALID_NODE;
+		bool is_free = false;
+	};
+
+	static u64 alignUp(u64 value, u64 align) { return (value + align - 1) & ~(align - 1); }
+
+	static u32 lowestBit(u64 value) {
+		ASSERT(value);
+		#ifdef _MSC_VER
+			unsigned long idx;
+			_BitScanForward64(&idx, value);
+			return idx;
+		#else
+			return __builtin_ctzll(value);
+		#endif
+	}
+
+	static u32 highestBit(u64 value) {
+		ASSERT(value);
+		#ifdef _MSC_VER
+			unsigned long idx;
+			_BitScanReverse64(&idx, value);
+			return idx;
+		#else
+			return 63 - __builtin_clzll(value);
+		#endif
+	}
+
+	static void mapping(u64 size, u32& fl, u32& sl) {
+		if (size < SL_COUNT) {
+			fl = 0;
+			sl = u32(size);
+			return;
+		}
+		const u32 log2 = highestBit(size);
+		fl = log2 - SL_BITS + 1;
+		sl = u32(size >> (log2 - SL_BITS)) - SL_COUNT;
+	}
+
+	// returns head of the first list with blocks guaranteed to be at least `size` big
+	u32 findFree(u64 size) const {
+		if (size >= SL_COUNT) size += (u64(1) << (highestBit(size) - SL_BITS)) - 1;
+		u32 fl, sl;
+		mapping(size, fl, sl);
+		if (fl >= FL_COUNT) return INVALID_NODE;
+
+		u32 sl_map = sl_bitmap[fl] & (~0U << sl);
+		if (!sl_map) {
+			const u64 fl_map = fl + 1 < 64 ? fl_bitmap & (~u64(0) << (fl + 1)) : 0;
+			if (!fl_map) return INVALID_NODE;
+			fl = lowestBit(fl_map);
+			sl_map = sl_bitmap[fl];
+		}
+		sl = lowestBit(sl_map);
+		return heads[fl][sl];
+	}
+
+	// findFree rounds up to the next class, so a block in the class of `size` is only found by scanning its list,
+	// e.g. allocating the whole range when its size is not a class boundary
+	u32 findFit(u64 size, u64 align) const {
+		u32 fl, sl;
+		mapping(size, fl, sl);
+		if (fl >= FL_COUNT) return INVALID_NODE;
+		for (u32 n = heads[fl][sl]; n != INVALID_NODE; n = nodes[n].next_free) {
+			if (alignUp(nodes[n].offset, align) + size <= nodes[n].offset + nodes[n].size) return n;
+		}
+		return INVALID_NODE;
+	}
+
+	void insertFree(u32 n) {
+		u32 fl, sl;
+		mapping(nodes[n].size, fl, sl);
+		Node& node = nodes[n];
+		node.is_free = true;
+		node.prev_free = INVALID_NODE;
+		node.next_free = heads[fl][sl];
+		if (node.next_free != INVALID_NODE) nodes[node.next_free].prev_free = n;
+		heads[fl][sl] = n;
+		fl_bitmap |= u64(1) << fl;
+		sl_bitmap[fl] |= 1 << sl;
+	}
+
+	void removeFree(u32 n) {
+		u32 fl, sl;
+		mapping(nodes[n].size, fl, sl);
+		Node& node = nodes[n];
+		if (node.prev_free != INVALID_NODE) nodes[node.prev_free].next_free = node.next_free;
+		else heads[fl][sl] = node.next_free;
+		if (node.next_free != INVALID_NODE) nodes[node.next_free].prev_free = node.prev_free;
+
+		if (heads[fl][sl] == INVALID_NODE) {
+			sl_bitmap[fl] &= ~(1 << sl);
+			if (!sl_bitmap[fl]) fl_bitmap &= ~(u64(1) << fl);
+		}
+		node.is_free = false;
+		node.prev_free = INVALID_NODE;
+		node.next_free = INVALID_NODE;
+	}
+
+	// n keeps the first `size` bytes, returns node with the rest
+	u32 split(u32 n, u64 size) {
+		ASSERT(nodes[n].size > size);
+		const u32 rest = newNode();
+		Node& node = nodes[n];
+		Node& rest_node = nodes[rest];
+		rest_node.offset = node.offset + size;
+		rest_node.size = node.size - size;
+		rest_node.prev_phys = n;
+		rest_node.next_phys = node.next_phys;
+		if (node.next_phys != INVALID_NODE) nodes[node.next_phys].prev_phys = rest;
+		node.next_phys = rest;
+		node.size = size;
+		return rest;
+	}
+
+	void merge(u32 n, u32 next) {
+		Node& node = nodes[n];
+		Node& next_node = nodes[next];
+		ASSERT(node.next_phys == next);
+		node.size += next_node.size;
+		node.next_phys = next_node.next_phys;
+		if (next_node.next_phys != INVALID_NODE) nodes[next_node.next_phys].prev_phys = n;
+		next_node = {};
+		next_node.next_free = free_nodes;
+		free_nodes = next;
+	}
+
+	u32 newNode() {
+		if (free_nodes == INVALID_NODE) {
+			nodes.emplace();
+			return nodes.size() - 1;
+		}
+		const u32 n = free_nodes;
+		free_nodes = nodes[n].next_free;
+		nodes[n] = {};
+		return n;
+	}
+
+	Array<Node> nodes;
+	u32 free_nodes = INVALID_NODE;
+	u64 fl_bitmap = 0;
+	u32 sl_bitmap[FL_COUNT] = {};
+	u32 heads[FL_COUNT][SL_COUNT];
+	u64 total_size = 0;
+	u64 used_size = 0;
+	u32 allocation_count = 0;
+};
+
+} // namespace Lumix
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include "engine/array.h"
+
+namespace Lumix::gpu {
+
+// resource which is used only by passes first_pass..last_pass (inclusive) of a frame
+struct TransientResource {
+	u64 size;
+	u64 align;
+	u32 first_pass;
+	u32 last_pass;
+	u64 offset; // output of placeTransientResources
+};
+
+// assigns offsets in one heap, resources with overlapping pass intervals do not overlap in memory,
+// the rest can alias, returns required heap size
+// greedy - the biggest resources are placed first, each one at the lowest offset where it fits
+inline u64 placeTransientResources(TransientResource* resources, u32 count, IAllocator& allocator) {
+	Array<u32> order(allocator);
+	Array<u32> placed(allocator);
+	order.resize(count);
+	for (u32 i = 0; i < count; ++i) {
+		order[i] = i;
+		resources[i].offset = ~u64(0);
+	}
+	// insertion sort, there are only tens of transient resources in a frame
+	for (u32 i = 1; i < count; ++i) {
+		const u32 idx = order[i];
+		u32 j = i;
+		while (j > 0 && resources[order[j - 1]].size < resources[idx].size) {
+			order[j] = order[j - 1];
+			--j;
+		}
+		order[j] = idx;
+	}
+
+	u64 heap_size = 0;
+	for (u32 idx : order) {
+		TransientResource& res = resources[idx];
+		ASSERT(res.align > 0 && (res.align & (res.align - 1)) == 0);
+		ASSERT(res.first_pass <= res.last_pass);
+
+		// already placed resources which are alive at the same time, sorted by offset
+		placed.clear();
+		for (u32 i = 0; i < count; ++i) {
+			if (i == idx) continue;
+			const TransientResource& other = resources[i];
+			if (other.offset == ~u64(0)) continue;
+			if (other.last_pass < res.first_pass || other.first_pass > res.last_pass) continue;
+			u32 j = placed.size();
+			placed.push(i);
+			while (j > 0 && resources[placed[j - 1]].offset > other.offset) {
+				placed[j] = placed[j - 1];
+				--j;
+			}
+			placed[j] = i;
+		}
+
+		u64 offset = 0;
+		for (u32 i : placed) {
+			const TransientResource& other = resources[i];
+			if (offset + res.size <= other.offset) break;
+			const u64 end = other.offset + other.size;
+			if (end > offset) offset = (end + res.align - 1) & ~(res.align - 1);
+		}
+		res.offset = offset;
+		if (offset + res.size > heap_size) heap_size = offset + res.size;
+	}
+	return heap_size;
+}
+
+} // namespace Lumix::gpu
@@ -0,0 +1,226 @@
+#include "test.h"
+#include "residency.h"
+#include <memory>
+#include <vector>
+
+using namespace Lumix;
+using namespace Lumix::gpu;
+
+// stands in for the device, usage is the size of resident objects, objects are evicted only through selectEvictions
+struct FakeDevice {
+	FakeDevice() : manager(allocator), rnd(0xbeef) {}
+
+	ResidencyEntry& create(u64 size, u64 frame) {
+		entries.push_back(std::make_unique<ResidencyEntry>());
+		ResidencyEntry& entry = *entries.back();
+		manager.add(entry, &entry, size, frame);
+		usage += size;
+		++expected_count;
+		return entry;
+	}
+
+	void destroy(u32 idx) {
+		ResidencyEntry& entry = *entries[idx];
+		if (entry.resident) usage -= entry.size;
+		manager.remove(entry);
+		CHECK(!entry.isManaged());
+		entries[idx] = std::move(entries.back());
+		entries.pop_back();
+		--expected_count;
+	}
+
+	void use(ResidencyEntry& entry, u64 frame) {
+		if (!manager.use(entry, frame)) {
+			manager.markResident(entry);
+			usage += entry.size;
+			++made_resident;
+		}
+	}
+
+	void endFrame(u64 budget, u64 frame) {
+		const u64 usage_before = usage;
+		Array<void*> to_evict(allocator);
+		manager.selectEvictions(usage, budget, frame, to_evict);
+
+		u64 max_evicted_frame = 0;
+		u64 last_evicted_size = 0;
+		for (void* object : to_evict) {
+			ResidencyEntry& entry = *(ResidencyEntry*)object;
+			CHECK(!entry.resident);
+			CHECK(entry.pins == 0);
+			CHECK(entry.last_used_frame + manager.min_idle_frames <= frame);
+			if (entry.last_used_frame > max_evicted_frame) max_evicted_frame = entry.last_used_frame;
+			usage -= entry.size;
+			last_evicted_size = entry.size;
+		}
+		evictions += to_evict.size();
+
+		// budget 0 means it is unknown
+		if (budget == 0 || usage_before <= budget) {
+			CHECK(to_evict.empty());
+			return;
+		}
+
+		const u64 target = u64(budget * (double)manager.target_budget_ratio);
+		bool any_candidate_left = false;
+		for (const std::unique_ptr<ResidencyEntry>& entry : entries) {
+			if (!entry->resident || entry->pins > 0 || entry->last_used_frame + manager.min_idle_frames > frame) continue;
+			any_candidate_left = true;
+			// least recently used are evicted first
+			CHECK(to_evict.empty() || entry->last_used_frame >= max_evicted_frame);
+		}
+		// evicts until usage drops under the target, not more
+		if (any_candidate_left) CHECK(usage <= target);
+		if (!to_evict.empty()) CHECK(usage + last_evicted_size > target);
+	}
+
+	void checkStats() {
+		u64 resident_size = 0;
+		u64 evicted_size = 0;
+		u32 resident_count = 0;
+		u32 evicted_count = 0;
+		for (const std::unique_ptr<ResidencyEntry>& entry : entries) {
+			if (entry->resident) {
+				resident_size += entry->size;
+				++resident_count;
+			}
+			else {
+				evicted_size += entry->size;
+				++evicted_count;
+			}
+		}
+		const ResidencyStats stats = manager.getStats();
+		CHECK(stats.resident_size == resident_size);
+		CHECK(stats.resident_size == usage);
+		CHECK(stats.evicted_size == evicted_size);
+		CHECK(stats.resident_count == resident_count);
+		CHECK(stats.evicted_count == evicted_count);
+		CHECK(stats.resident_count + stats.evicted_count == expected_count);
+		CHECK(stats.evictions == evictions);
+		CHECK(stats.made_resident == made_resident);
+	}
+
+	IAllocator allocator;
+	ResidencyManager manager;
+	TestRandom rnd;
+	std::vector<std::unique_ptr<ResidencyEntry>> entries;
+	u64 usage = 0;
+	u32 expected_count = 0;
+	u32 evictions = 0;
+	u32 made_resident = 0;
+};
+
+static void testLRUOrder() {
+	FakeDevice device;
+	ResidencyEntry& a = device.create(100, 0);
+	ResidencyEntry& b = device.create(100, 1);
+	ResidencyEntry& c = device.create(100, 2);
+	ResidencyEntry& d = device.create(100, 3);
+
+	// 400 used, target is 300 * 0.95, so the two least recently used go
+	device.endFrame(300, 10);
+	CHECK(!a.resident);
+	CHECK(!b.resident);
+	CHECK(c.resident);
+	CHECK(d.resident);
+	device.checkStats();
+
+	// under budget, nothing is evicted
+	device.endFrame(300, 11);
+	CHECK(c.resident && d.resident);
+
+	device.use(a, 12);
+	CHECK(a.resident);
+	device.checkStats();
+}
+
+static void testSameFrameBiggerFirst() {
+	FakeDevice device;
+	ResidencyEntry& small = device.create(10, 0);
+	ResidencyEntry& big = device.create(200, 0);
+	device.create(100, 5);
+	device.endFrame(250, 10);
+	CHECK(small.resident);
+	CHECK(!big.resident);
+	device.checkStats();
+}
+
+static void testPinsAndIdleFrames() {
+	FakeDevice device;
+	ResidencyEntry& pinned = device.create(100, 0);
+	ResidencyEntry& recent = device.create(100, 8);
+	ResidencyEntry& idle = device.create(100, 7);
+	device.manager.pin(pinned);
+
+	// frame 10 - `recent` can still be used by a frame in flight
+	device.endFrame(100, 10);
+	CHECK(pinned.resident);
+	CHECK(recent.resident);
+	CHECK(!idle.resident);
+
+	device.manager.unpin(pinned);
+	device.endFrame(100, 11);
+	CHECK(!pinned.resident);
+	CHECK(!recent.resident);
+	device.checkStats();
+}
+
+static void testNoBudget() {
+	FakeDevice device;
+	ResidencyEntry& entry = device.create(1000, 0);
+	// e.g. DXGI did not report the budget
+	device.endFrame(0, 100);
+	CHECK(entry.resident);
+	device.checkStats();
+}
+
+static void testRandom() {
+	FakeDevice device;
+	device.manager.min_idle_frames = 2;
+	device.manager.target_budget_ratio = 0.9f;
+	const u64 budget = 64 * 1024;
+	std::vector<ResidencyEntry*> pinned;
+
+	for (u64 frame = 0; frame < 2000; ++frame) {
+		const u32 creates = device.rnd.range(4);
+		for (u32 i = 0; i < creates; ++i) device.create(1 + device.rnd.range(8 * 1024), frame);
+		if (!device.entries.empty() && device.rnd.range(4) == 0) {
+			const u32 idx = device.rnd.range((u32)device.entries.size());
+			bool is_pinned = false;
+			for (ResidencyEntry* e : pinned) is_pinned = is_pinned || e == device.entries[idx].get();
+			if (!is_pinned) device.destroy(idx);
+		}
+
+		// a working set which moves slowly, so some evicted entries are used again
+		const u32 uses = device.entries.empty() ? 0 : device.rnd.range(8);
+		for (u32 i = 0; i < uses; ++i) {
+			const u32 idx = device.rnd.range((u32)device.entries.size());
+			device.use(*device.entries[idx], frame);
+		}
+
+		if (!device.entries.empty() && device.rnd.range(16) == 0) {
+			ResidencyEntry* entry = device.entries[device.rnd.range((u32)device.entries.size())].get();
+			device.manager.pin(*entry);
+			pinned.push_back(entry);
+		}
+		if (!pinned.empty() && device.rnd.range(8) == 0) {
+			device.manager.unpin(*pinned.back());
+			pinned.pop_back();
+		}
+
+		device.endFrame(budget, frame);
+		device.checkStats();
+	}
+
+	CHECK(device.evictions > 0);
+	CHECK(device.made_resident > 0);
+}
+
+int main() {
+	testLRUOrder();
+	testSameFrameBiggerFirst();
+	testPinsAndIdleFrames();
+	testNoBudget();
+	testRandom();
+	return g_failures == 0 ? 0 : 1;
+}
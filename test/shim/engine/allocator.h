@@ -0,0 +1,29 @@
+#pragma once
+
+// minimal stand-in for the engine headers, so the standalone headers in src can be built and tested without the engine
+#include <assert.h>
+#include <stdint.h>
+
+#define ASSERT(x) assert(x)
+
+namespace Lumix {
+
+using u8 = uint8_t;
+using u16 = uint16_t;
+using u32 = uint32_t;
+using u64 = uint64_t;
+using i16 = int16_t;
+using i32 = int32_t;
+using i64 = int64_t;
+
+template <typename T> struct Ref {
+	explicit Ref(T& value) : value(value) {}
+	operator T&() { return value; }
+	T* operator->() { return &value; }
+	void operator =(const T& v) { value = v; }
+	T& value;
+};
+
+struct IAllocator {};
+
+} // namespace Lumix
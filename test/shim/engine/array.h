@@ -0,0 +1,39 @@
+#pragma once
+
+#include "engine/allocator.h"
+#include <vector>
+
+namespace Lumix {
+
+template <typename T> struct Array {
+	Array(IAllocator&) {}
+
+	T& emplace() { values.emplace_back(); return values.back(); }
+	void push(const T& value) { values.push_back(value); }
+	void insert(u32 idx, const T& value) { values.insert(values.begin() + idx, value); }
+	void pop() { values.pop_back(); }
+	void swapAndPop(u32 idx) { values[idx] = values.back(); values.pop_back(); }
+	void erase(u32 idx) { values.erase(values.begin() + idx); }
+	void eraseItem(const T& value) {
+		for (u32 i = 0; i < size(); ++i) {
+			if (values[i] == value) { erase(i); return; }
+		}
+	}
+	void clear() { values.clear(); }
+	void resize(u32 size) { values.resize(size); }
+	void reserve(u32 size) { values.reserve(size); }
+	bool empty() const { return values.empty(); }
+	u32 size() const { return (u32)values.size(); }
+	T& back() { return values.back(); }
+	T* begin() { return values.data(); }
+	T* end() { return values.data() + values.size(); }
+	const T* begin() const { return values.data(); }
+	const T* end() const { return values.data() + values.size(); }
+	T& operator[](u32 idx) { return values[idx]; }
+	const T& operator[](u32 idx) const { return values[idx]; }
+
+private:
+	std::vector<T> values;
+};
+
+} // namespace Lumix
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "engine/allocator.h"
+
+namespace Lumix {
+
+template <typename T> struct Span {
+	Span() = default;
+	Span(T* begin, u64 length) : m_begin(begin), m_end(begin + length) {}
+
+	u64 length() const { return m_end - m_begin; }
+	T* begin() const { return m_begin; }
+	T* end() const { return m_end; }
+	T& operator[](u64 idx) const { return m_begin[idx]; }
+
+	T* m_begin = nullptr;
+	T* m_end = nullptr;
+};
+
+} // namespace Lumix
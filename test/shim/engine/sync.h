@@ -0,0 +1,21 @@
+#pragma once
+
+#include <mutex>
+
+namespace Lumix {
+
+struct Mutex {
+	void enter() { mutex.lock(); }
+	void exit() { mutex.unlock(); }
+
+	std::mutex mutex;
+};
+
+struct MutexGuard {
+	explicit MutexGuard(Mutex& mutex) : mutex(mutex) { mutex.enter(); }
+	~MutexGuard() { mutex.exit(); }
+
+	Mutex& mutex;
+};
+
+} // namespace Lumix
@@ -0,0 +1,40 @@
+#pragma once
+
+// only the declarations gpu_ext.h needs
+#include "engine/allocator.h"
+#include "engine/span.h"
+
+namespace Lumix::gpu {
+
+struct Buffer;
+struct Texture;
+using BufferHandle = Buffer*;
+using TextureHandle = Texture*;
+
+enum class TextureFormat : u32 {
+	R8,
+	RGBA8,
+	SRGBA,
+	R32F,
+	RG32F,
+	RGBA32F,
+	SRGB
+};
+
+enum class TextureFlags : u32 {
+	NONE = 0,
+	RENDER_TARGET = 1 << 0,
+	IS_3D = 1 << 1,
+	NO_MIPS = 1 << 2
+};
+
+struct TextureInfo {
+	u32 width;
+	u32 height;
+	u32 depth;
+	u32 layers;
+	u32 mips;
+	bool is_cubemap;
+};
+
+} // namespace Lumix::gpu
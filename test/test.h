@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+
+// tests are plain executables, a failed check is reported and the executable returns nonzero
+static int g_failures = 0;
+
+#define CHECK(x) \
+	do { \
+		if (!(x)) { \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+			++g_failures; \
+		} \
+	} while (false)
+
+// deterministic, so failures can be reproduced
+struct TestRandom {
+	explicit TestRandom(unsigned long long seed) : state(seed) {}
+
+	unsigned long long next() {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	// in [0, max)
+	unsigned int range(unsigned int max) { return (unsigned int)(next() % max); }
+
+	unsigned long long state;
+};
@@ -0,0 +1,120 @@
+#include "test.h"
+#include "texture_convert.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace Lumix;
+using namespace Lumix::gpu;
+
+static constexpr u8 SENTINEL = 0xcd;
+
+// source pixels end right before a PROT_NONE page, so a kernel reading past the row crashes the test
+struct GuardedSource {
+	GuardedSource() {
+		page_size = (u32)sysconf(_SC_PAGESIZE);
+		mem = (u8*)mmap(nullptr, SIZE + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		ASSERT(mem != MAP_FAILED);
+		mprotect(mem + SIZE, page_size, PROT_NONE);
+	}
+
+	~GuardedSource() { munmap(mem, SIZE + page_size); }
+
+	u8* place(u32 size) {
+		ASSERT(size <= SIZE);
+		return mem + SIZE - size;
+	}
+
+	static constexpr u32 SIZE = 64 * 1024;
+	u32 page_size;
+	u8* mem;
+};
+
+using Kernel = u32 (*)(u8* dst, const u8* src, u32 count, const u32* palette);
+
+static u32 unpackBGR565SSE2(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::unpackBGR565SSE2(dst, src, count); }
+static u32 unpackBGR5A1SSE2(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::unpackBGR5A1SSE2(dst, src, count); }
+static u32 swizzleBGRA8SSSE3(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::swizzleBGRA8SSSE3(dst, src, count); }
+static u32 expandBGR8SSSE3(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::expandBGR8SSSE3(dst, src, count); }
+static u32 swizzleBGRA8AVX2(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::swizzleBGRA8AVX2(dst, src, count); }
+static u32 unpackBGR565AVX2(u8* dst, const u8* src, u32 count, const u32*) { return PixelConvertDetail::unpackBGR565AVX2(dst, src, count); }
+static u32 lookupIndex8AVX2(u8* dst, const u8* src, u32 count, const u32* palette) { return PixelConvertDetail::lookupIndex8AVX2(dst, src, count, palette); }
+
+static const u32 COUNTS[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 12, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 255, 1000, 4096 };
+
+struct Harness {
+	Harness() : rnd(0x5eed) {
+		for (u32& c : palette) c = (u32)rnd.next();
+	}
+
+	// `kernel` == nullptr tests convertPixels
+	void run(PixelConversion conversion, Kernel kernel) {
+		const u32 src_pixel_size = getSourcePixelSize(conversion);
+		for (u32 count : COUNTS) {
+			for (u32 dst_misalign = 0; dst_misalign < 4; ++dst_misalign) {
+				// src ends at the guard page, its start alignment varies with count and the extra byte
+				for (u32 src_extra = 0; src_extra < 2; ++src_extra) {
+					u8* src = source.place(count * src_pixel_size + src_extra);
+					for (u32 i = 0; i < count * src_pixel_size + src_extra; ++i) src[i] = (u8)rnd.next();
+
+					std::vector<u8> expected(count * 4 + 1);
+					convertPixelsScalar(conversion, expected.data(), src, count, palette);
+
+					std::vector<u8> dst_mem(count * 4 + 64, SENTINEL);
+					u8* dst = dst_mem.data() + 16 + dst_misalign;
+					u32 done = count;
+					if (kernel) done = kernel(dst, src, count, palette);
+					else convertPixels(conversion, dst, src, count, palette);
+
+					CHECK(done <= count);
+					CHECK(memcmp(dst, expected.data(), done * 4) == 0);
+					bool untouched = true;
+					for (u8* p = dst_mem.data(); p < dst; ++p) untouched = untouched && *p == SENTINEL;
+					for (u8* p = dst + done * 4; p < dst_mem.data() + dst_mem.size(); ++p) untouched = untouched && *p == SENTINEL;
+					CHECK(untouched);
+					// kernels leave only a small tail to the scalar version
+					if (kernel) CHECK(count - done < 16);
+				}
+			}
+		}
+	}
+
+	TestRandom rnd;
+	GuardedSource source;
+	u32 palette[256];
+};
+
+int main() {
+	Harness harness;
+	const PixelConvertDetail::CPUFeatures& cpu = PixelConvertDetail::getCPUFeatures();
+
+	harness.run(PixelConversion::BGR565, unpackBGR565SSE2);
+	harness.run(PixelConversion::BGR5A1, unpackBGR5A1SSE2);
+	if (cpu.ssse3) {
+		harness.run(PixelConversion::BGRA8, swizzleBGRA8SSSE3);
+		harness.run(PixelConversion::BGR8, expandBGR8SSSE3);
+	}
+	else {
+		printf("SSSE3 not supported, skipping SSSE3 kernels\n");
+	}
+	if (cpu.avx2) {
+		harness.run(PixelConversion::BGRA8, swizzleBGRA8AVX2);
+		harness.run(PixelConversion::BGR565, unpackBGR565AVX2);
+		harness.run(PixelConversion::INDEX8, lookupIndex8AVX2);
+	}
+	else {
+		printf("AVX2 not supported, skipping AVX2 kernels\n");
+	}
+
+	const PixelConversion conversions[] = {
+		PixelConversion::NONE,
+		PixelConversion::BGRA8,
+		PixelConversion::BGR8,
+		PixelConversion::BGR5A1,
+		PixelConversion::BGR565,
+		PixelConversion::INDEX8
+	};
+	for (PixelConversion conversion : conversions) harness.run(conversion, nullptr);
+
+	return g_failures == 0 ? 0 : 1;
+}
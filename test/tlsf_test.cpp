@@ -0,0 +1,99 @@
+#include "test.h"
+#include "tlsf.h"
+#include <algorithm>
+#include <vector>
+
+using namespace Lumix;
+
+static void checkConsistency(const TLSF& tlsf, std::vector<TLSF::Allocation> allocations) {
+	u64 used = 0;
+	for (const TLSF::Allocation& a : allocations) {
+		CHECK(a.offset + a.size <= tlsf.getSize());
+		used += a.size;
+	}
+	std::sort(allocations.begin(), allocations.end(), [](const TLSF::Allocation& a, const TLSF::Allocation& b){ return a.offset < b.offset; });
+	for (u32 i = 1; i < allocations.size(); ++i) {
+		CHECK(allocations[i - 1].offset + allocations[i - 1].size <= allocations[i].offset);
+	}
+
+	const TLSF::Stats stats = tlsf.getStats();
+	CHECK(stats.used == used);
+	CHECK(stats.allocation_count == allocations.size());
+	CHECK(stats.largest_free_block <= stats.size - stats.used);
+	CHECK(tlsf.isEmpty() == allocations.empty());
+}
+
+static void testRandom(u64 heap_size, u32 iterations, u64 seed) {
+	IAllocator allocator;
+	TLSF tlsf(allocator);
+	tlsf.init(heap_size);
+	TestRandom rnd(seed);
+	std::vector<TLSF::Allocation> allocations;
+
+	for (u32 i = 0; i < iterations; ++i) {
+		if (allocations.empty() || rnd.range(100) < 55) {
+			// mostly small sizes, sometimes big ones, so both first level ranges and exhaustion are hit
+			const u64 size = rnd.range(8) == 0 ? 1 + rnd.range(u32(heap_size / 8)) : 1 + rnd.range(4096);
+			const u64 align = u64(1) << rnd.range(17);
+			const TLSF::Allocation a = tlsf.alloc(size, align);
+			if (!a.isValid()) continue;
+			CHECK(a.size >= size);
+			CHECK(a.offset % align == 0);
+			allocations.push_back(a);
+		}
+		else {
+			const u32 idx = rnd.range((u32)allocations.size());
+			tlsf.free(allocations[idx].node);
+			allocations[idx] = allocations.back();
+			allocations.pop_back();
+		}
+		if (i % 64 == 0) checkConsistency(tlsf, allocations);
+	}
+	checkConsistency(tlsf, allocations);
+
+	while (!allocations.empty()) {
+		const u32 idx = rnd.range((u32)allocations.size());
+		tlsf.free(allocations[idx].node);
+		allocations[idx] = allocations.back();
+		allocations.pop_back();
+	}
+
+	// everything merged back to a single block
+	const TLSF::Stats stats = tlsf.getStats();
+	CHECK(tlsf.isEmpty());
+	CHECK(stats.used == 0);
+	CHECK(stats.allocation_count == 0);
+	CHECK(stats.largest_free_block == heap_size);
+
+	const TLSF::Allocation all = tlsf.alloc(heap_size, 1);
+	CHECK(all.isValid());
+	CHECK(all.offset == 0 && all.size == heap_size);
+	CHECK(!tlsf.alloc(1, 1).isValid());
+}
+
+static void testExhaustion() {
+	IAllocator allocator;
+	TLSF tlsf(allocator);
+	tlsf.init(1024 * 1024);
+	std::vector<TLSF::Allocation> allocations;
+	for (;;) {
+		const TLSF::Allocation a = tlsf.alloc(64 * 1024, 64 * 1024);
+		if (!a.isValid()) break;
+		allocations.push_back(a);
+	}
+	CHECK(allocations.size() == 16);
+	checkConsistency(tlsf, allocations);
+
+	// free every other block, a bigger allocation must not fit in the holes
+	for (u32 i = 0; i < allocations.size(); i += 2) tlsf.free(allocations[i].node);
+	CHECK(!tlsf.alloc(128 * 1024, 1).isValid());
+	CHECK(tlsf.alloc(64 * 1024, 1).isValid());
+}
+
+int main() {
+	testRandom(1024 * 1024, 20000, 0x1234);
+	testRandom(64 * 1024 * 1024, 20000, 0xdead);
+	testRandom(1000003, 20000, 0x42);
+	testExhaustion();
+	return g_failures == 0 ? 0 : 1;
+}